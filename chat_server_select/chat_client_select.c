@@ -1,38 +1,156 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/select.h> // select 함수 사용
+#include <sys/epoll.h>  // 스웜 모드: 수천 개 연결을 한 쓰레드에서 감시
+#include <sys/resource.h>
 
 #define BUF_SIZE 1024
 #define SERVER_IP "127.0.0.1"
-#define PORT 8080
+#define PORT 8080           // 줄 단위 프로토콜 (-l)
+#define FRAME_PORT 8081     // 길이 접두 프레임 프로토콜 (기본)
+#define FRAME_HDR 4         // 프레임 머리: 본문 길이 (4바이트 빅엔디언)
+#define MAX_MSG (64 * 1024) // 메시지 본문 최대 길이 (서버와 같음)
+#define DEFAULT_ROOM "lobby" // 서버가 접속하자마자 넣는 방
+
+// 스웜 모드 (-s): 부하 측정용으로 연결 여러 개를 열어 정해진 속도로 메시지를 보내고 받은 메시지의 지연 시간을 잼
+#define SWARM_RATE 100        // 기본 전송 속도 (전체 초당 메시지 수)
+#define SWARM_DURATION 10     // 기본 측정 시간 (초)
+#define SWARM_HDR_MAX 64      // 측정 머리 "swarm <실행> <번호> <보낸 시각>" 최대 길이 (본문은 이보다 작을 수 없음)
+#define SWARM_MSG_SIZE 64     // 기본 메시지 본문 크기 (바이트)
+#define SWARM_SETUP_SECS 10   // 모든 연결이 방에 들어가기를 기다리는 최대 시간 (초)
+#define SWARM_DRAIN_SECS 3    // 보내기를 멈춘 뒤 아직 오지 않은 메시지를 기다리는 최대 시간 (초)
+#define SWARM_IN_SIZE 4096    // 연결별 수신 버퍼 처음 크기 (긴 메시지가 오면 한 메시지 크기까지 늘림)
+#define SWARM_OUT_MSGS 4      // 보내는 연결의 미전송 버퍼에 담을 수 있는 메시지 수 (넘치면 그 메시지는 건너뜀)
+#define MAX_EVENTS 256
+#define HIST_SUB_BITS 5       // 2의 거듭제곱 구간마다 32개 하위 구간 (상대 오차 약 3%, 부하 측정 도구와 같은 구간)
+#define HIST_MAX_BITS 40
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+
+// 스웜 설정 (명령행 옵션으로 변경)
+typedef struct {
+    int connections;    // 0 이면 대화형 모드
+    int senders;        // 보내는 연결 수 (0 이면 모든 연결)
+    double rate;
+    int duration;
+    int msg_size;
+    const char *room;   // NULL 이면 기본 방
+    const char *output; // 결과 JSON 파일
+} swarm_config_t;
+
+// 지연 시간 히스토그램 (µs, 로그-선형 구간)
+typedef struct {
+    unsigned long long counts[HIST_BUCKETS];
+    unsigned long long total;
+    unsigned long long sum;
+    unsigned long long max;
+} histogram_t;
+
+// 스웜 연결 하나 (epoll 이벤트의 data.ptr 가 가리킴)
+typedef struct {
+    int fd;
+    int ready;       // 측정할 방에 들어감
+    int dead;        // 서버가 연결을 끊음
+    char *in;        // 수신 버퍼 (메시지 단위로 잘라 처리하고 남은 조각은 앞으로 당김)
+    size_t in_len;
+    size_t in_cap;
+    char *out;       // 보내는 연결만: 송신 버퍼가 차서 못 보낸 바이트 (EPOLLOUT 때 이어서 보냄)
+    size_t out_len;
+    size_t out_cap;
+} swarm_conn_t;
+
+// 스웜 측정 결과
+typedef struct {
+    histogram_t latency;           // 보낸 시각부터 다른 연결이 받은 시각까지
+    unsigned long long sent;       // 보낸 메시지 수
+    unsigned long long skipped;    // 미전송 버퍼가 넘쳐 보내지 못한 메시지 수
+    unsigned long long expected;   // 보낸 메시지마다 그때 방에 있던 다른 연결 수를 더한 값
+    unsigned long long received;   // 이번 실행에서 보낸 메시지를 받은 수
+    unsigned long long foreign;    // 다른 실행이나 다른 사용자의 메시지
+    unsigned long long bytes_in;
+    unsigned long long disconnects;
+} swarm_stats_t;
 
 void error_handling(char *message);
+int send_frame(int sock, const char *msg, size_t len);
+int run_swarm(void);
+void swarm_poll(int timeout_ms);
+void swarm_read(swarm_conn_t *conn);
+void swarm_message(swarm_conn_t *conn, const char *payload, size_t len);
+int swarm_write(swarm_conn_t *conn, const char *payload, size_t len);
+void swarm_flush(swarm_conn_t *conn);
+void swarm_close(swarm_conn_t *conn);
+void swarm_report(double elapsed);
+void write_json_result(const char *path, double elapsed);
+void raise_fd_limit(void);
+uint64_t now_usec(void);
+void hist_record(histogram_t *hist, uint64_t value);
+uint64_t hist_percentile(const histogram_t *hist, double q);
+
+swarm_config_t swarm = { 0, 0, SWARM_RATE, SWARM_DURATION, SWARM_MSG_SIZE, NULL, NULL };
+swarm_stats_t stats;
+swarm_conn_t *conns;
+int conn_count;
+int ready_count;       // 방에 들어가 있고 끊기지 않은 연결 수
+int epfd;
+int line_mode = 0;     // 1 이면 예전처럼 줄 단위로 주고받음
+unsigned int run_id;   // 이번 실행에서 보낸 메시지만 세도록 메시지에 넣는 값
+uint64_t last_receive; // 마지막으로 측정 메시지를 받은 시각 (처리량 계산)
 
 int main(int argc, char *argv[]) {
     int sock;
     char buf[BUF_SIZE];
     int str_len;
     struct sockaddr_in serv_addr;
+    int opt;
+
+    // 프레임 모드 수신 버퍼: 한 번의 read 에 메시지가 잘려 오거나 여러 개가 붙어 와도 프레임 단위로 나눔
+    static char in[FRAME_HDR + MAX_MSG];
+    size_t in_len = 0;
 
     // select 관련 변수 정의
     fd_set reads, temps;
     int fd_max;
 
+    // 0. 옵션: -l 줄 단위 모드 (프레임을 모르는 서버나 도구와 호환), -s 스웜 모드 (키보드 입력 없이 부하 측정)
+    while ((opt = getopt(argc, argv, "ls:S:r:d:m:R:o:")) != -1) {
+        switch (opt) {
+        case 'l': line_mode = 1; break;
+        case 's': swarm.connections = atoi(optarg); break;
+        case 'S': swarm.senders = atoi(optarg); break;
+        case 'r': swarm.rate = atof(optarg); break;
+        case 'd': swarm.duration = atoi(optarg); break;
+        case 'm': swarm.msg_size = atoi(optarg); break;
+        case 'R': swarm.room = optarg; break;
+        case 'o': swarm.output = optarg; break;
+        default:
+            fprintf(stderr, "Usage: %s [-l] [-s connections [-S senders] [-r msgs_per_sec] [-d secs] "
+                            "[-m bytes] [-R room] [-o result.json]]\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (swarm.connections > 0)
+        return run_swarm();
+
     // 1. 클라이언트 소켓 생성 (TCP)
     sock = socket(PF_INET, SOCK_STREAM, 0);
     if (sock == -1)
         error_handling("socket() error");
 
-    // 2. 서버 주소 정보 설정
+    // 2. 서버 주소 정보 설정 (프로토콜마다 포트가 다름)
     memset(&serv_addr, 0, sizeof(serv_addr));
     serv_addr.sin_family = AF_INET;
     serv_addr.sin_addr.s_addr = inet_addr(SERVER_IP);
-    serv_addr.sin_port = htons(PORT);
+    serv_addr.sin_port = htons(line_mode ? PORT : FRAME_PORT);
 
     // 3. 서버에 연결 요청 (Connect)
     if (connect(sock, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) == -1)
@@ -57,17 +175,27 @@ int main(int argc, char *argv[]) {
         // 6. 이벤트 발생 확인 및 처리
         if (FD_ISSET(0, &temps)) { // A. 표준 입력(키보드) 이벤트 발생
             if (fgets(buf, BUF_SIZE, stdin) == NULL) continue;
-            
+
             // 'q' 입력 시 종료
             if (strcmp(buf, "q\n") == 0) break;
 
-            // 메시지 서버로 전송
-            write(sock, buf, strlen(buf));
+            // 메시지 서버로 전송 (프레임 모드는 줄바꿈을 빼고 한 프레임으로)
+            if (line_mode) {
+                write(sock, buf, strlen(buf));
+            } else {
+                size_t len = strcspn(buf, "\n");
+                if (send_frame(sock, buf, len) == -1)
+                    error_handling("write() error");
+            }
         }
 
         if (FD_ISSET(sock, &temps)) { // B. 서버 소켓으로부터 데이터 수신 이벤트 발생
-            str_len = read(sock, buf, BUF_SIZE - 1);
-            
+            if (line_mode) {
+                str_len = read(sock, buf, BUF_SIZE - 1);
+            } else {
+                str_len = read(sock, in + in_len, sizeof(in) - in_len);
+            }
+
             if (str_len == 0) { // 서버 연결 종료
                 puts("Server closed connection.");
                 break;
@@ -75,8 +203,27 @@ int main(int argc, char *argv[]) {
             if (str_len == -1)
                 error_handling("read() error");
 
-            buf[str_len] = '\0';
-            printf("[Message]: %s", buf); // 서버가 보낸 메시지(다른 클라이언트의 메시지) 출력
+            if (line_mode) {
+                buf[str_len] = '\0';
+                printf("[Message]: %s", buf); // 서버가 보낸 메시지(다른 클라이언트의 메시지) 출력
+                continue;
+            }
+
+            // 프레임 모드: 완성된 프레임마다 한 메시지로 출력하고 남은 조각은 앞으로 당김
+            in_len += str_len;
+            size_t off = 0;
+            while (in_len - off >= FRAME_HDR) {
+                uint32_t n;
+                memcpy(&n, in + off, FRAME_HDR);
+                n = ntohl(n);
+                if (n > MAX_MSG)
+                    error_handling("frame too large");
+                if (in_len - off < FRAME_HDR + n) break;
+                printf("[Message]: %.*s\n", (int)n, in + off + FRAME_HDR);
+                off += FRAME_HDR + n;
+            }
+            in_len -= off;
+            memmove(in, in + off, in_len);
         }
     }
 
@@ -85,8 +232,426 @@ int main(int argc, char *argv[]) {
     return 0;
 }
 
+// 스웜 모드: 연결을 모두 열어 방에 넣은 뒤 정해진 속도로 보내며 받는 쪽 지연 시간, 유실, 처리량을 측정
+// 보낸 시각을 메시지에 넣고 같은 프로세스가 받으므로 시계를 맞출 필요가 없음
+int run_swarm(void) {
+    struct sockaddr_in serv_addr;
+    struct epoll_event ev;
+    const char *room = swarm.room ? swarm.room : DEFAULT_ROOM;
+    char join[BUF_SIZE];
+    int join_len = 0;
+    int msg_len = swarm.msg_size > SWARM_HDR_MAX ? swarm.msg_size : SWARM_HDR_MAX;
+
+    if (swarm.senders <= 0 || swarm.senders > swarm.connections) swarm.senders = swarm.connections;
+    if (swarm.rate <= 0) swarm.rate = SWARM_RATE;
+    if (swarm.duration < 1) swarm.duration = 1;
+    if (msg_len > MAX_MSG) msg_len = MAX_MSG;
+    if (swarm.room)
+        join_len = snprintf(join, sizeof(join), "/join %s", swarm.room);
+    run_id = getpid() ^ (unsigned int)time(NULL);
+
+    // 1. 연결 열기: 수천 개를 열 수 있도록 fd 한도를 올리고, 서버가 먼저 끊어도 종료되지 않게 SIGPIPE 무시
+    raise_fd_limit();
+    signal(SIGPIPE, SIG_IGN);
+    epfd = epoll_create1(0);
+    if (epfd == -1)
+        error_handling("epoll_create1() error");
+    conns = calloc(swarm.connections, sizeof(swarm_conn_t));
+    if (conns == NULL)
+        error_handling("calloc() error");
+
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_addr.s_addr = inet_addr(SERVER_IP);
+    serv_addr.sin_port = htons(line_mode ? PORT : FRAME_PORT);
+
+    for (conn_count = 0; conn_count < swarm.connections; conn_count++) {
+        swarm_conn_t *conn = &conns[conn_count];
+        int sock = socket(PF_INET, SOCK_STREAM, 0);
+        if (sock == -1 || connect(sock, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) == -1) {
+            perror("connect() error"); // 연 만큼만으로 측정
+            if (sock != -1) close(sock);
+            break;
+        }
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+        conn->fd = sock;
+        conn->in_cap = SWARM_IN_SIZE;
+        conn->in = malloc(conn->in_cap);
+        if (conn_count < swarm.senders) { // 보내는 연결만 미전송 버퍼를 둠
+            conn->out_cap = SWARM_OUT_MSGS * (FRAME_HDR + msg_len + 1);
+            conn->out = malloc(conn->out_cap);
+        }
+        if (conn->in == NULL || (conn_count < swarm.senders && conn->out == NULL))
+            error_handling("malloc() error");
+
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = conn;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, sock, &ev) == -1)
+            error_handling("epoll_ctl() error");
+        if (join_len)
+            swarm_write(conn, join, join_len);
+    }
+    if (swarm.senders > conn_count)
+        swarm.senders = conn_count;
+
+    // 2. 모든 연결이 방에 들어가기를 기다림 (그 사이에 온 기록 재전송 등은 결과에서 뺌)
+    uint64_t deadline = now_usec() + SWARM_SETUP_SECS * 1000000ULL;
+    while (ready_count < conn_count && now_usec() < deadline)
+        swarm_poll(10);
+    if (ready_count < 2)
+        error_handling("not enough connections joined the room");
+    printf("Swarm: %d/%d connections in %s, %d senders, %.1f msgs/s for %ds, %d-byte messages\n",
+           ready_count, swarm.connections, room, swarm.senders, swarm.rate, swarm.duration, msg_len);
+    memset(&stats, 0, sizeof(stats));
+
+    // 3. 측정: 시작부터 지난 시간 × 속도만큼 보냄 (보내는 연결을 돌아가며 사용)
+    char *payload = malloc(msg_len);
+    if (payload == NULL)
+        error_handling("malloc() error");
+    uint64_t start = now_usec(), now;
+    uint64_t end = start + swarm.duration * 1000000ULL;
+    uint64_t next_report = start + 1000000;
+    unsigned long long last_received = 0;
+    int next_sender = 0;
+
+    while ((now = now_usec()) < end) {
+        unsigned long long due = (unsigned long long)(swarm.rate * (now - start) / 1000000);
+        while (stats.sent + stats.skipped < due) {
+            swarm_conn_t *conn = NULL;
+            for (int tries = 0; tries < swarm.senders && conn == NULL; tries++) {
+                conn = &conns[next_sender];
+                next_sender = (next_sender + 1) % swarm.senders;
+                if (conn->dead || !conn->ready) conn = NULL;
+            }
+            if (conn == NULL)
+                error_handling("all senders disconnected");
+
+            // 본문: "swarm <실행> <번호> <보낸 시각 µs> " 뒤를 채워 정해진 크기로
+            int n = snprintf(payload, msg_len, "swarm %u %llu %llu ", run_id, stats.sent + stats.skipped,
+                             (unsigned long long)now_usec());
+            memset(payload + n, 'x', msg_len - n);
+            if (swarm_write(conn, payload, msg_len) == -1) {
+                stats.skipped++;
+                continue;
+            }
+            stats.sent++;
+            stats.expected += ready_count - 1; // 서버는 보낸 연결을 뺀 방 멤버 모두에게 전달
+        }
+
+        swarm_poll(1);
+
+        if (now >= next_report) {
+            printf("[%3llus] sent %llu, delivered %llu (%llu/s), p99 %llu us\n",
+                   (unsigned long long)(now - start) / 1000000, stats.sent, stats.received,
+                   stats.received - last_received, (unsigned long long)hist_percentile(&stats.latency, 0.99));
+            fflush(stdout);
+            last_received = stats.received;
+            next_report += 1000000;
+        }
+    }
+
+    // 4. 보내기를 멈추고 오는 중인 메시지를 기다림 (받을 만큼 다 받거나 제한 시간까지)
+    deadline = now_usec() + SWARM_DRAIN_SECS * 1000000ULL;
+    while (stats.received < stats.expected && now_usec() < deadline)
+        swarm_poll(10);
+    now = last_receive > end ? last_receive : end;
+
+    swarm_report((now - start) / 1e6);
+    if (swarm.output)
+        write_json_result(swarm.output, (now - start) / 1e6);
+
+    // 5. 연결 닫기
+    for (int i = 0; i < conn_count; i++) {
+        if (!conns[i].dead)
+            close(conns[i].fd);
+        free(conns[i].in);
+        free(conns[i].out);
+    }
+    free(conns);
+    free(payload);
+    close(epfd);
+    return 0;
+}
+
+// 준비된 연결만 처리 (보낼 것이 남은 연결은 이어서 보내고, 받은 것은 메시지 단위로 처리)
+void swarm_poll(int timeout_ms) {
+    struct epoll_event events[MAX_EVENTS];
+    int n = epoll_wait(epfd, events, MAX_EVENTS, timeout_ms);
+
+    if (n == -1 && errno != EINTR)
+        error_handling("epoll_wait() error");
+    for (int i = 0; i < n; i++) {
+        swarm_conn_t *conn = events[i].data.ptr;
+        if (!conn->dead && (events[i].events & EPOLLOUT))
+            swarm_flush(conn);
+        if (!conn->dead && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+            swarm_read(conn);
+    }
+}
+
+// 읽을 수 있는 만큼 읽어 메시지 단위로 처리 (엣지 트리거이므로 EAGAIN 이 나올 때까지)
+// 잘려 온 메시지는 버퍼에 남겨 다음 read 에 이어 붙이고, 버퍼가 가득 차면 한 메시지 크기까지 늘림
+void swarm_read(swarm_conn_t *conn) {
+    size_t max = line_mode ? MAX_MSG + 1 : FRAME_HDR + MAX_MSG;
+
+    while (1) {
+        if (conn->in_len == conn->in_cap) {
+            size_t cap = conn->in_cap * 2 < max ? conn->in_cap * 2 : max;
+            char *p = conn->in_cap < max ? realloc(conn->in, cap) : NULL;
+            if (p == NULL) { // 한 메시지보다 긴 입력: 프로토콜 오류
+                swarm_close(conn);
+                return;
+            }
+            conn->in = p;
+            conn->in_cap = cap;
+        }
+
+        ssize_t n = read(conn->fd, conn->in + conn->in_len, conn->in_cap - conn->in_len);
+        if (n == -1 && errno == EINTR) continue;
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (n <= 0) {
+            swarm_close(conn);
+            return;
+        }
+        conn->in_len += n;
+        stats.bytes_in += n;
+
+        size_t off = 0;
+        while (off < conn->in_len) {
+            if (line_mode) {
+                char *nl = memchr(conn->in + off, '\n', conn->in_len - off);
+                if (nl == NULL) break;
+                swarm_message(conn, conn->in + off, nl - (conn->in + off));
+                off = nl - conn->in + 1;
+            } else {
+                uint32_t len;
+                if (conn->in_len - off < FRAME_HDR) break;
+                memcpy(&len, conn->in + off, FRAME_HDR);
+                len = ntohl(len);
+                if (len > MAX_MSG) {
+                    swarm_close(conn);
+                    return;
+                }
+                if (conn->in_len - off < FRAME_HDR + len) break;
+                swarm_message(conn, conn->in + off + FRAME_HDR, len);
+                off += FRAME_HDR + len;
+            }
+        }
+        conn->in_len -= off;
+        memmove(conn->in, conn->in + off, conn->in_len);
+    }
+}
+
+// 받은 메시지 하나 처리: 이번 실행의 측정 메시지면 지연 시간 기록, 아니면 방에 들어갔다는 안내인지 확인
+void swarm_message(swarm_conn_t *conn, const char *payload, size_t len) {
+    char head[SWARM_HDR_MAX + 1], expect[SWARM_HDR_MAX + 1];
+    unsigned int run;
+    unsigned long long sent_at;
+    size_t n = len < SWARM_HDR_MAX ? len : SWARM_HDR_MAX;
+
+    memcpy(head, payload, n);
+    head[n] = '\0';
+    if (sscanf(head, "swarm %u %*u %llu", &run, &sent_at) == 2 && run == run_id) {
+        uint64_t now = now_usec();
+        stats.received++;
+        hist_record(&stats.latency, now > sent_at ? now - sent_at : 0);
+        last_receive = now;
+        return;
+    }
+    if (strncmp(head, "[server] ", 9) != 0) { // 다른 실행이나 다른 사용자의 메시지
+        stats.foreign++;
+        return;
+    }
+    if (conn->ready) return;
+
+    // "joined <방> (N members)" 나 "already in <방>" 이면 측정 대상
+    const char *room = swarm.room ? swarm.room : DEFAULT_ROOM;
+    int m = snprintf(expect, sizeof(expect), "[server] joined %s (", room);
+    if (strncmp(head, expect, m) != 0) {
+        snprintf(expect, sizeof(expect), "[server] already in %s", room);
+        if (strcmp(head, expect) != 0) return;
+    }
+    conn->ready = 1;
+    ready_count++;
+}
+
+// 메시지 하나 전송 (프레임 모드는 프레임 머리를, 줄 단위 모드는 줄바꿈을 붙임)
+// 송신 버퍼가 차서 못 보낸 바이트는 미전송 버퍼에 두고 EPOLLOUT 때 이어서 보냄
+// 반환값: 미전송 버퍼도 넘치거나 연결이 끊겨 보내지 못했으면 -1
+int swarm_write(swarm_conn_t *conn, const char *payload, size_t len) {
+    static char wire[FRAME_HDR + MAX_MSG + 1];
+    size_t wire_len = 0;
+
+    if (!line_mode) {
+        uint32_t n = htonl(len);
+        memcpy(wire, &n, FRAME_HDR);
+        wire_len = FRAME_HDR;
+    }
+    memcpy(wire + wire_len, payload, len);
+    wire_len += len;
+    if (line_mode)
+        wire[wire_len++] = '\n';
+
+    size_t sent = 0;
+    if (conn->out_len == 0) {
+        ssize_t w = write(conn->fd, wire, wire_len);
+        if (w == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            swarm_close(conn);
+            return -1;
+        }
+        if (w > 0) sent = w;
+        if (sent == wire_len) return 0;
+    }
+    if (conn->out_cap - conn->out_len < wire_len - sent) {
+        if (sent > 0) // 일부만 나갔으면 스트림이 깨지지 않도록 나머지를 반드시 보내야 함
+            error_handling("swarm send buffer overflow");
+        return -1;
+    }
+    memcpy(conn->out + conn->out_len, wire + sent, wire_len - sent);
+    conn->out_len += wire_len - sent;
+    return 0;
+}
+
+// 미전송 버퍼를 보낼 수 있는 만큼 전송 (EPOLLOUT 이벤트 때)
+void swarm_flush(swarm_conn_t *conn) {
+    size_t off = 0;
+
+    while (off < conn->out_len) {
+        ssize_t w = write(conn->fd, conn->out + off, conn->out_len - off);
+        if (w == -1) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                swarm_close(conn);
+            break;
+        }
+        off += w;
+    }
+    conn->out_len -= off;
+    memmove(conn->out, conn->out + off, conn->out_len);
+}
+
+// 서버가 끊은 연결 정리 (버퍼는 측정이 끝난 뒤 한꺼번에 해제)
+void swarm_close(swarm_conn_t *conn) {
+    close(conn->fd);
+    conn->dead = 1;
+    conn->out_len = 0;
+    if (conn->ready)
+        ready_count--;
+    stats.disconnects++;
+}
+
+// 측정 결과 출력: 받은 수는 보낸 메시지마다 그때 방에 있던 다른 연결 수와 비교해 유실을 계산
+void swarm_report(double elapsed) {
+    const histogram_t *h = &stats.latency;
+    unsigned long long lost = stats.expected > stats.received ? stats.expected - stats.received : 0;
+
+    printf("Sent %llu messages (%.1f msgs/s), skipped %llu, disconnects %llu\n", stats.sent,
+           stats.sent / elapsed, stats.skipped, stats.disconnects);
+    printf("Delivered %llu of %llu expected, lost %llu (%.3f%%), other messages %llu\n", stats.received,
+           stats.expected, lost, stats.expected ? 100.0 * lost / stats.expected : 0.0, stats.foreign);
+    printf("Fan-out throughput: %.0f deliveries/s, %.2f MB/s received over %.2fs\n", stats.received / elapsed,
+           stats.bytes_in / elapsed / (1024 * 1024), elapsed);
+    printf("Latency (us): mean %llu, p50 %llu, p90 %llu, p99 %llu, p999 %llu, max %llu\n",
+           h->total ? h->sum / h->total : 0, (unsigned long long)hist_percentile(h, 0.5),
+           (unsigned long long)hist_percentile(h, 0.9), (unsigned long long)hist_percentile(h, 0.99),
+           (unsigned long long)hist_percentile(h, 0.999), h->max);
+}
+
+// 측정 결과를 JSON 으로 저장 (실행끼리 비교할 수 있도록 설정도 함께)
+void write_json_result(const char *path, double elapsed) {
+    const histogram_t *h = &stats.latency;
+    FILE *out = fopen(path, "w");
+
+    if (out == NULL) {
+        perror("fopen() error");
+        return;
+    }
+    fprintf(out, "{\n  \"connections\": %d,\n  \"senders\": %d,\n  \"rate\": %.1f,\n  \"duration\": %d,\n"
+                 "  \"msg_size\": %d,\n  \"framed\": %s,\n  \"elapsed\": %.3f,\n  \"sent\": %llu,\n"
+                 "  \"skipped\": %llu,\n  \"expected\": %llu,\n  \"received\": %llu,\n  \"disconnects\": %llu,\n"
+                 "  \"deliveries_per_sec\": %.1f,\n  \"bytes_in\": %llu,\n",
+            conn_count, swarm.senders, swarm.rate, swarm.duration, swarm.msg_size, line_mode ? "false" : "true",
+            elapsed, stats.sent, stats.skipped, stats.expected, stats.received, stats.disconnects,
+            stats.received / elapsed, stats.bytes_in);
+    fprintf(out, "  \"latency_us\": { \"count\": %llu, \"mean\": %llu, \"p50\": %llu, \"p90\": %llu, "
+                 "\"p99\": %llu, \"p999\": %llu, \"max\": %llu }\n}\n",
+            h->total, h->total ? h->sum / h->total : 0, (unsigned long long)hist_percentile(h, 0.5),
+            (unsigned long long)hist_percentile(h, 0.9), (unsigned long long)hist_percentile(h, 0.99),
+            (unsigned long long)hist_percentile(h, 0.999), h->max);
+    fclose(out);
+    printf("Result saved: %s\n", path);
+}
+
+// fd 수 한도 올리기 (soft 한도를 hard 한도까지)
+void raise_fd_limit(void) {
+    struct rlimit rl;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &rl) == -1)
+            perror("setrlimit() error");
+    }
+}
+
+uint64_t now_usec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// 값(µs)을 로그-선형 구간에 기록: 32 미만은 그대로, 그 이상은 최상위 비트 위치와 다음 5비트로 구간 결정
+void hist_record(histogram_t *hist, uint64_t value) {
+    uint64_t v = value < (1ULL << HIST_MAX_BITS) ? value : (1ULL << HIST_MAX_BITS) - 1;
+    int idx = (int)v;
+
+    if (v >= (1 << HIST_SUB_BITS)) {
+        int msb = 63 - __builtin_clzll(v);
+        int shift = msb - HIST_SUB_BITS;
+        idx = ((shift + 1) << HIST_SUB_BITS) + (int)((v >> shift) & ((1 << HIST_SUB_BITS) - 1));
+    }
+    hist->counts[idx]++;
+    hist->total++;
+    hist->sum += value;
+    if (value > hist->max)
+        hist->max = value;
+}
+
+// 누적 비율 q 에 해당하는 값: 그 구간이 나타내는 값의 상한 (최댓값을 넘지 않음)
+uint64_t hist_percentile(const histogram_t *hist, double q) {
+    unsigned long long rank = (unsigned long long)(q * hist->total + 0.5), seen = 0;
+
+    if (hist->total == 0) return 0;
+    if (rank == 0) rank = 1;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += hist->counts[i];
+        if (seen < rank) continue;
+        if (i < (1 << HIST_SUB_BITS)) return i;
+        int shift = (i >> HIST_SUB_BITS) - 1;
+        uint64_t lower = (uint64_t)((i & ((1 << HIST_SUB_BITS) - 1)) | (1 << HIST_SUB_BITS)) << shift;
+        uint64_t upper = lower + (1ULL << shift) - 1;
+        return upper < hist->max ? upper : hist->max;
+    }
+    return hist->max;
+}
+
+// 길이 접두 프레임 하나 전송: [본문 길이 4바이트 빅엔디언][본문]
+int send_frame(int sock, const char *msg, size_t len) {
+    char frame[FRAME_HDR + BUF_SIZE];
+    uint32_t n = htonl(len);
+
+    memcpy(frame, &n, FRAME_HDR);
+    memcpy(frame + FRAME_HDR, msg, len);
+    len += FRAME_HDR;
+    for (size_t sent = 0; sent < len; ) { // 블로킹 소켓이라도 시그널 등으로 일부만 보낼 수 있음
+        ssize_t w = write(sock, frame + sent, len - sent);
+        if (w == -1) return -1;
+        sent += w;
+    }
+    return 0;
+}
+
 void error_handling(char *message) {
     fputs(message, stderr);
     fputc('\n', stderr);
     exit(1);
-}
\ No newline at end of file
+}
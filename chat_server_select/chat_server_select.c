@@ -1,151 +1,1629 @@
+#define _GNU_SOURCE // accept4() 사용
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
-#include <sys/time.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
+#include <time.h>
 
 #define BUF_SIZE 1024
-#define PORT 8080
-#define MAX_CLIENTS 30 // 최대 클라이언트 수
+#define PORT 8080           // 줄 단위 프로토콜 (기존 클라이언트)
+#define FRAME_PORT 8081     // 길이 접두 프레임 프로토콜
+#define FRAME_HDR 4         // 프레임 머리: 본문 길이 (4바이트 빅엔디언)
+#define MAX_MSG (64 * 1024) // 메시지 본문 최대 길이 (줄 단위에서는 이보다 긴 줄을 나눠 받음)
+#define MAX_EVENTS 256      // epoll_wait 한 번에 처리할 최대 이벤트 수
+#define INITIAL_CLIENTS 64  // 클라이언트 목록의 처음 크기 (가득 차면 두 배씩 늘림)
+#define INITIAL_QUEUE 16    // 클라이언트별 송신 대기열의 처음 크기 (가득 차면 두 배씩 늘림)
+#define MAX_IOV 1024        // writev 한 번에 보낼 최대 메시지 수 (IOV_MAX)
+#define FLUSH_BYTES (64 * 1024) // 이벤트 처리 중에 모은 송신 대기열이 이 바이트를 넘으면 루프 끝을 기다리지 않고 전송
+#define HIGH_WATER (256 * 1024) // 송신 대기열이 이 바이트를 넘으면 새 메시지는 버림
+#define SLOW_CLIENT_SECS 10 // 대기열이 이 시간(초) 넘게 계속 넘쳐 있으면 연결을 끊음
+#define MAX_SHARDS 64       // 이벤트 루프 쓰레드 최대 수 (방의 shard_mask 비트 수)
+#define MAILBOX_SIZE 4096   // 쓰레드 쌍마다 둔 우편함 칸 수 (2의 거듭제곱, 가득 차면 보내는 클라이언트 읽기를 멈춤)
+#define ROOM_BUCKETS 256    // 방 이름 해시 테이블 버킷 수
+#define ROOM_NAME_MAX 32    // 방 이름 최대 길이 ('\0' 포함)
+#define DEFAULT_ROOM "lobby" // 접속하면 처음 들어가는 방
+#define DEFAULT_HISTORY_DIR "./chat_history" // 방 기록 세그먼트 파일을 두는 곳 (-H 로 바꾸고 -N 이면 기록 안 함)
+#define SEGMENT_SIZE (1024 * 1024) // 기록 세그먼트 파일 크기 (다 차면 새 세그먼트에 이어 씀)
+#define REC_HDR 20          // 기록 머리: [기록 길이 4][번호 8][보낸 클라이언트 8], 뒤는 msg_t 의 data 와 같은 모양
+#define HISTORY_KEEP 10000  // 방마다 남겨 둘 최근 메시지 수 (그보다 오래된 기록은 압축 쓰레드가 정리)
+#define HISTORY_REPLAY 20   // 방에 들어가면 다시 보내 주는 최근 메시지 수
+#define COMPACT_SECS 5      // 압축 쓰레드가 기록을 정리하는 간격 (초)
+
+// 방 메시지: 받는 클라이언트 모두가 (다른 쓰레드의 클라이언트도) 같은 버퍼를 가리키고, 마지막으로 보낸 쪽이 해제
+// data 는 [프레임 머리][본문]['\n'] 이므로 프레임 클라이언트는 머리부터, 줄 단위 클라이언트는 본문부터 보냄 (wire_view)
+typedef struct {
+    atomic_int refs; // 이 메시지를 대기열이나 우편함에 둔 수
+    uint64_t seq;    // 방 기록 번호 (기록하지 않았으면 0)
+    size_t len;      // 본문 길이
+    char data[];
+} msg_t;
+
+// 기록 세그먼트: 방 기록을 이어 쓰는 파일 하나를 통째로 매핑 (매핑 주소는 바뀌지 않음)
+// 기록은 [REC_HDR][프레임 머리][본문]['\n'] 이므로 따라잡는 클라이언트에게 매핑 안의 바이트를 그대로 보냄
+typedef struct segment {
+    char *path;
+    char *map;
+    size_t size;        // 매핑 크기
+    size_t used;        // 기록이 차지한 바이트 (이어 쓸 위치)
+    uint64_t first_seq; // 첫 기록 번호
+    uint32_t count;     // 기록 수
+    uint32_t *offs;     // 기록 위치 (i 번째 = first_seq + i 번 기록)
+    uint32_t offs_cap;
+    atomic_int refs;    // 기록 목록 하나 + 이 매핑을 가리키는 송신 대기열 항목 수 (0 이 되면 매핑 해제)
+} segment_t;
+
+// 방 기록: 방 이름마다 하나 (방이 없어져도 남아 같은 이름의 방이 이어 씀)
+// 쓰기와 목록 변경은 방마다 따로 잠그므로 바쁜 방이 다른 방의 기록을 늦추지 않음
+typedef struct history {
+    char name[ROOM_NAME_MAX];
+    pthread_mutex_t lock;
+    segment_t **segs;   // 번호 순서, 마지막 세그먼트에 이어 씀
+    int seg_count;
+    int seg_cap;
+    uint64_t next_seq;  // 다음 메시지 번호 (1 부터)
+    struct history *next; // 같은 해시 버킷의 다음 기록
+} history_t;
+
+// 한 쓰레드에 있는 방 멤버 목록 (그 쓰레드만 읽고 씀)
+typedef struct {
+    struct client **members;
+    int count;
+    int cap;
+} member_list_t;
+
+// 방: 멤버는 여러 쓰레드에 흩어져 있고 쓰레드마다 자기 멤버 목록을 따로 가짐
+// 보낸 쓰레드가 자기 멤버에게 직접 넣고, 멤버가 있는 다른 쓰레드에는 우편함으로 넘겨 그 쓰레드가 전달
+typedef struct room {
+    char name[ROOM_NAME_MAX];
+    atomic_int refs;          // 멤버 수 + 우편함에 있는 이 방 메시지 수 (0 이 되면 해제)
+    atomic_int members;       // 모든 쓰레드의 멤버 수 (/list 용)
+    atomic_ullong shard_mask; // 멤버가 있는 쓰레드 (비트 i = 쓰레드 i)
+    member_list_t local[MAX_SHARDS];
+    history_t *hist;          // 이 방의 기록 (기록을 끄면 NULL)
+    struct room *next;        // 같은 해시 버킷의 다음 방
+} room_t;
+
+// 송신 대기열 항목: 실시간 메시지 버퍼나 기록 세그먼트 매핑 안의 바이트를 가리킴 (보낸 뒤 참조 해제)
+typedef struct {
+    char *base;     // 이 클라이언트의 프로토콜로 보낼 바이트
+    size_t len;
+    msg_t *msg;     // 실시간 메시지 (기록에서 보내면 NULL)
+    segment_t *seg; // 기록 세그먼트 (실시간 메시지면 NULL)
+} out_t;
+
+// 연결된 클라이언트 (epoll 이벤트의 data.ptr 가 가리킴)
+typedef struct client {
+    int fd;
+    uint64_t id; // 자기가 보낸 메시지를 기록에서 다시 받지 않도록 구분 (재시작해도 겹치지 않게 시작 시각을 섞음)
+    int idx;  // 쓰레드의 clients 배열에서의 위치 (제거할 때 찾지 않고 바로 접근)
+    int dead; // 연결을 끊음 (같은 epoll_wait 결과에 남은 이벤트 무시, 루프 끝에서 해제)
+    struct client *next_dead;
+    int framed; // 길이 접두 프레임으로 주고받음 (FRAME_PORT 로 접속)
+
+    room_t *room;  // 들어가 있는 방 (없으면 NULL)
+    int room_idx;  // 방의 이 쓰레드 멤버 목록에서의 위치
+
+    // 기록 따라잡기: 방 기록을 replay_next 번부터 매핑에서 바로 보내는 동안은 실시간 메시지를 건너뜀 (모두 기록에 있으므로)
+    history_t *replay;    // 따라잡는 중인 기록 (없으면 NULL)
+    uint64_t replay_next; // 다음에 보낼 기록 번호
+    uint64_t live_from;   // 따라잡은 뒤 실시간으로 받을 첫 번호 (그 앞은 기록으로 이미 받음)
+
+    // 받은 데이터를 메시지 단위로 나누는 버퍼 (BUF_SIZE 에서 시작해 긴 메시지를 받는 동안만 늘어남)
+    char *in;
+    size_t in_len;
+    size_t in_cap;
+    int paused; // 다른 쓰레드 우편함이 가득 차 읽기를 멈춤 (자리가 나면 이어서 읽음)
+    struct client *next_paused;
+
+    // 송신 대기열: 보낼 항목의 원형 배열 (앞 항목은 out_off 바이트까지 보냄)
+    out_t *queue;
+    int q_head;
+    int q_count;
+    int q_cap;
+    size_t out_off;
+    size_t queued;       // 대기열에 남은 바이트
+    int want_out;        // EPOLLOUT 을 기다리는 중 (대기열이 비면 해제)
+    time_t over_since;   // 대기열이 HIGH_WATER 를 넘은 시각 (넘지 않았으면 0)
+    unsigned long dropped; // 넘쳐서 버린 메시지 수
+    int pending;         // 이번 이벤트 처리가 끝나면 대기열을 보낼 클라이언트 목록에 있음
+    struct client *next_pending;
+} client_t;
+
+// 서버 소켓: 포트마다 프로토콜이 정해짐 (epoll 이벤트의 data.ptr 가 가리킴)
+typedef struct {
+    int fd;
+    int port;
+    int framed;
+} listener_t;
+
+// 쓰레드 사이 우편함: 보내는 쓰레드 하나, 받는 쓰레드 하나인 잠금 없는 원형 큐
+typedef struct {
+    msg_t *msg;
+    room_t *room;
+} mail_t;
+
+typedef struct {
+    _Alignas(64) atomic_size_t head; // 받는 쪽이 다음에 꺼낼 위치
+    _Alignas(64) atomic_size_t tail; // 보내는 쪽이 다음에 넣을 위치 (head 와 다른 캐시 라인)
+    atomic_int want_wake;            // 가득 차 기다리는 보내는 쪽이 있음 (받는 쪽이 비운 뒤 깨움)
+    mail_t slots[MAILBOX_SIZE];
+} mailbox_t;
+
+// 이벤트 루프 쓰레드: 수락한 연결은 끊길 때까지 이 쓰레드가 처리
+typedef struct {
+    int id;
+    int epfd;
+    int notify_fd; // 다른 쓰레드가 우편함에 넣은 뒤 깨우는 eventfd
+    pthread_t tid;
+
+    // 이 쓰레드의 클라이언트 목록: 수 제한 없이 필요한 만큼 늘어남
+    client_t **clients;
+    int client_count;
+    int client_cap;
+    client_t *dead_clients; // 이번 이벤트 처리 중에 끊은 클라이언트 (처리 후 해제)
+    client_t *paused_clients; // 우편함에 자리가 나기를 기다리는 클라이언트
+    client_t *pending_clients; // 이번 이벤트 처리 중에 대기열에 메시지가 쌓인 클라이언트 (루프 끝에서 한 번에 전송)
+
+    mailbox_t *inbox[MAX_SHARDS]; // inbox[i]: 쓰레드 i 가 보낸 메시지 (자기 자신은 NULL)
+    unsigned long long wake_mask; // 우편함에 넣고 아직 깨우지 않은 쓰레드
+    unsigned long mail_dropped;   // 확인한 뒤 멤버가 생긴 쓰레드의 우편함이 가득 차 버린 메시지 수
+} shard_t;
+
+shard_t *shards = NULL;
+int shard_count = 0;
+listener_t listeners[2] = {{-1, PORT, 0}, {-1, FRAME_PORT, 1}};
+
+// 방 이름 해시 테이블 (방을 만들고 지울 때와 /list 에서만 잠금)
+pthread_mutex_t rooms_lock = PTHREAD_MUTEX_INITIALIZER;
+room_t *room_buckets[ROOM_BUCKETS];
+
+// 방 기록 해시 테이블 (기록은 지우지 않으므로 찾거나 만들 때만 잠금)
+char *history_dir = DEFAULT_HISTORY_DIR;
+pthread_mutex_t histories_lock = PTHREAD_MUTEX_INITIALIZER;
+history_t *history_buckets[ROOM_BUCKETS];
+
+uint64_t server_epoch;          // 서버 시작 시각 (클라이언트 id 의 위쪽 32비트)
+atomic_uint client_serial;      // 클라이언트 id 의 아래쪽 32비트
 
 // 함수 정의
 void error_handling(char *message);
-void send_message_to_all(int sender_sock, char *msg, int len, int *client_socks, int *max_sock_idx);
-void remove_client(int sock_fd, int *client_socks, int *max_sock_idx);
+void raise_fd_limit(void);
+void *shard_loop(void *arg);
+void accept_clients(shard_t *sh, listener_t *ls);
+int read_client(shard_t *sh, client_t *client);
+int process_input(shard_t *sh, client_t *client);
+ssize_t next_message(client_t *client, size_t off, char **payload, size_t *len);
+int room_writable(shard_t *sh, room_t *room);
+void resume_clients(shard_t *sh);
+int is_command(const char *msg, size_t len);
+void handle_command(shard_t *sh, client_t *client, char *msg, size_t len);
+void send_notice(shard_t *sh, client_t *client, const char *fmt, ...);
+void send_message_to_room(shard_t *sh, client_t *sender, char *msg, size_t len);
+void deliver_local(shard_t *sh, client_t *sender, room_t *room, msg_t *msg);
+int mailbox_push(mailbox_t *box, msg_t *msg, room_t *room);
+void drain_mailboxes(shard_t *sh);
+void wake_shards(shard_t *sh);
+room_t *room_get(const char *name);
+void room_put(room_t *room);
+void room_join(shard_t *sh, client_t *client, const char *name);
+void room_leave(shard_t *sh, client_t *client);
+void list_rooms(shard_t *sh, client_t *client);
+unsigned long hash_string(const char *str);
+int add_client(shard_t *sh, int sock, int framed);
+void remove_client(shard_t *sh, client_t *client);
+int enqueue_message(shard_t *sh, client_t *client, msg_t *msg);
+int queue_push(client_t *client, char *data, size_t len, msg_t *msg, segment_t *seg);
+void out_release(out_t *out);
+void mark_pending(shard_t *sh, client_t *client);
+int flush_client(shard_t *sh, client_t *client);
+void flush_pending(shard_t *sh);
+void set_want_out(shard_t *sh, client_t *client, int want);
+msg_t *msg_create(const char *data, size_t len);
+size_t wire_view(const client_t *client, char *data, size_t len, char **base);
+void msg_release(msg_t *msg);
+history_t *history_get(const char *name);
+void history_load(void);
+int history_grow(history_t *h);
+void history_append(history_t *h, uint64_t sender_id, msg_t *msg);
+int history_find(history_t *h, uint64_t seq);
+void replay_start(shard_t *sh, client_t *client, uint64_t from);
+int history_stream(client_t *client);
+void *compact_thread(void *arg);
+void history_compact(history_t *h);
+void segment_path(char *buf, size_t size, const char *name, uint64_t first_seq, const char *ext);
+segment_t *segment_map(const char *path, size_t size, int create);
+void segment_scan(segment_t *seg);
+int segment_index(segment_t *seg, uint32_t off);
+void segment_release(segment_t *seg);
 
 int main(int argc, char *argv[]) {
-    // 1. 소켓 및 주소 변수 정의
-    int serv_sock, clnt_sock;
-    struct sockaddr_in serv_addr, clnt_addr;
+    // 1. 소켓 변수 정의
+    struct sockaddr_in serv_addr;
+    int opt, i, j;
+    pthread_t compact_tid;
+
+    // 2. 옵션: 이벤트 루프 쓰레드 수 (기본: CPU 코어 수), 기록 디렉터리 (-N 이면 기록 안 함)
+    while ((opt = getopt(argc, argv, "t:H:N")) != -1) {
+        if (opt == 't') {
+            shard_count = atoi(optarg);
+        } else if (opt == 'H') {
+            history_dir = optarg;
+        } else if (opt == 'N') {
+            history_dir = NULL;
+        } else {
+            fprintf(stderr, "Usage: %s [-t threads] [-H history_dir | -N]\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (shard_count <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        shard_count = cores > 0 ? (int)cores : 1;
+    }
+    if (shard_count > MAX_SHARDS)
+        shard_count = MAX_SHARDS;
+
+    // 3. 수만 명이 접속할 수 있도록 열 수 있는 fd 수를 허용된 최대까지 올림
+    raise_fd_limit();
+
+    // 끊긴 연결에 쓸 때 프로세스가 종료되지 않도록 (writev 가 EPIPE 를 반환해 그 클라이언트만 제거)
+    signal(SIGPIPE, SIG_IGN);
+
+    // 4. 서버 소켓 생성 및 설정 (줄 단위 포트와 프레임 포트)
+    for (i = 0; i < 2; i++) {
+        listener_t *ls = &listeners[i];
+
+        // 4-1. 서버 소켓 생성 (여러 연결을 한 번에 받도록 논블로킹)
+        ls->fd = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (ls->fd == -1)
+            error_handling("socket() error");
+
+        int reuse = 1;
+        setsockopt(ls->fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        // 4-2. 주소 정보 초기화 및 설정
+        memset(&serv_addr, 0, sizeof(serv_addr));
+        serv_addr.sin_family = AF_INET;
+        serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        serv_addr.sin_port = htons(ls->port);
+
+        // 4-3. 소켓에 주소 할당 (Binding)
+        if (bind(ls->fd, (struct sockaddr*) &serv_addr, sizeof(serv_addr)) == -1)
+            error_handling("bind() error");
+
+        // 4-4. 연결 요청 대기 (Listening): 동시에 몰리는 접속을 위해 대기열을 커널 최대치로
+        if (listen(ls->fd, SOMAXCONN) == -1)
+            error_handling("listen() error");
+    }
+
+    // 5. 쓰레드마다 epoll, 깨우기용 eventfd, 다른 쓰레드에서 오는 우편함 준비
+    shards = calloc(shard_count, sizeof(shard_t));
+    if (shards == NULL)
+        error_handling("calloc() error");
+    for (i = 0; i < shard_count; i++) {
+        shard_t *sh = &shards[i];
+        sh->id = i;
+        sh->epfd = epoll_create1(0);
+        if (sh->epfd == -1)
+            error_handling("epoll_create1() error");
+        sh->notify_fd = eventfd(0, EFD_NONBLOCK);
+        if (sh->notify_fd == -1)
+            error_handling("eventfd() error");
+
+        for (j = 0; j < shard_count; j++) {
+            if (j == i) continue;
+            sh->inbox[j] = aligned_alloc(64, sizeof(mailbox_t));
+            if (sh->inbox[j] == NULL)
+                error_handling("aligned_alloc() error");
+            atomic_init(&sh->inbox[j]->head, 0);
+            atomic_init(&sh->inbox[j]->tail, 0);
+            atomic_init(&sh->inbox[j]->want_wake, 0);
+        }
+    }
+
+    // 5-1. 방 기록: 남아 있는 세그먼트를 다시 매핑하고 압축 쓰레드 실행
+    server_epoch = time(NULL);
+    if (history_dir) {
+        history_load();
+        if (pthread_create(&compact_tid, NULL, compact_thread, NULL) != 0)
+            error_handling("pthread_create() error");
+        pthread_detach(compact_tid);
+    }
+
+    printf("Chat Server running on port %d (lines) and %d (frames)... (%d threads)\n", PORT, FRAME_PORT,
+           shard_count);
+
+    // 6. 이벤트 루프 쓰레드 실행 (메인 쓰레드는 끝나기를 기다림)
+    for (i = 0; i < shard_count; i++) {
+        if (pthread_create(&shards[i].tid, NULL, shard_loop, &shards[i]) != 0)
+            error_handling("pthread_create() error");
+    }
+    for (i = 0; i < shard_count; i++)
+        pthread_join(shards[i].tid, NULL);
+
+    close(listeners[0].fd);
+    close(listeners[1].fd);
+    return 0;
+}
+
+// 7. fd 수 한도 올리기 (soft 한도를 hard 한도까지)
+void raise_fd_limit(void) {
+    struct rlimit rl;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &rl) == -1)
+            perror("setrlimit() error");
+    }
+}
+
+// 8. 이벤트 루프: 준비된 소켓만 돌려받으므로 깨어날 때마다 드는 비용은 이벤트 수에 비례
+// 쓰레드마다 따로 돌므로 바쁜 방의 전달이 다른 쓰레드에 있는 방들을 늦추지 않음
+void *shard_loop(void *arg) {
+    shard_t *sh = arg;
+    struct epoll_event ev, events[MAX_EVENTS];
+    int n, i;
+
+    // 공유 서버 소켓 (data.ptr == &listeners[i]) 과 eventfd (data.ptr == sh) 등록
+    // EPOLLEXCLUSIVE: 새 연결 하나에 모든 쓰레드가 깨어나지 않고 한 쓰레드만 수락
+    for (i = 0; i < 2; i++) {
+        ev.events = EPOLLIN | EPOLLET | EPOLLEXCLUSIVE;
+        ev.data.ptr = &listeners[i];
+        if (epoll_ctl(sh->epfd, EPOLL_CTL_ADD, listeners[i].fd, &ev) == -1)
+            error_handling("epoll_ctl() error");
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = sh;
+    if (epoll_ctl(sh->epfd, EPOLL_CTL_ADD, sh->notify_fd, &ev) == -1)
+        error_handling("epoll_ctl() error");
+
+    while (1) {
+        n = epoll_wait(sh->epfd, events, MAX_EVENTS, -1);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            error_handling("epoll_wait() error");
+        }
+
+        for (i = 0; i < n; i++) {
+            client_t *client = events[i].data.ptr;
+
+            if ((void *)client == &listeners[0] || (void *)client == &listeners[1]) {
+                // A. 새로운 연결 요청 (서버 소켓)
+                accept_clients(sh, (listener_t *)client);
+            } else if ((void *)client == sh) { // D. 다른 쓰레드가 우편함에 메시지를 넣음
+                drain_mailboxes(sh);
+            } else if (client->dead) {
+                continue;
+            } else if ((events[i].events & EPOLLOUT) && flush_client(sh, client) == -1) {
+                // C. 송신 버퍼에 자리가 나 밀린 메시지를 보냈지만 연결이 끊겨 있음
+                printf("Client disconnected: %d\n", client->fd);
+                remove_client(sh, client);
+            } else if ((events[i].events & ~EPOLLOUT) && read_client(sh, client) == -1) {
+                // B. 클라이언트 데이터 수신 또는 연결 종료
+                printf("Client disconnected: %d\n", client->fd);
+                remove_client(sh, client);
+            }
+        }
+        wake_shards(sh);
+
+        // 이번 이벤트 처리 중에 쌓인 메시지를 클라이언트마다 writev 한 번으로 전송
+        flush_pending(sh);
+
+        // 이번 이벤트 처리 중에 끊은 클라이언트 해제 (같은 배치에 남은 이벤트가 없으므로 안전)
+        while (sh->dead_clients) {
+            client_t *client = sh->dead_clients;
+            sh->dead_clients = client->next_dead;
+            free(client);
+        }
+    }
+    return NULL;
+}
+
+// 9. 대기 중인 연결을 모두 수락 (엣지 트리거이므로 EAGAIN 이 나올 때까지)
+// 수락한 쓰레드가 그 연결을 맡으므로 연결이 쓰레드들에 고루 나뉨
+void accept_clients(shard_t *sh, listener_t *ls) {
+    struct sockaddr_in clnt_addr;
     socklen_t clnt_addr_size;
-    
-    // 2. select 관련 변수 정의
-    fd_set reads, temps; // reads: 감시 대상 집합, temps: select 후 결과 집합
-    int max_fd;           // 감시 대상 중 가장 큰 소켓 번호
-    char buf[BUF_SIZE];
-    int str_len, i;
-
-    // 3. 연결된 클라이언트 소켓 목록 및 관리
-    int client_socks[MAX_CLIENTS]; // 연결된 클라이언트 소켓 번호를 저장
-    int max_sock_idx = 0;         // client_socks 배열의 유효한 크기 (다음 삽입 위치)
-    
-    // 배열 초기화
-    for (i = 0; i < MAX_CLIENTS; i++)
-        client_socks[i] = 0;
-
-    // 4. 서버 소켓 생성 및 설정 (생략된 bind, listen 로직 추가)
-    
-    // 4-1. 서버 소켓 생성
-    serv_sock = socket(PF_INET, SOCK_STREAM, 0);
-    if (serv_sock == -1)
-        error_handling("socket() error");
-
-    // 4-2. 주소 정보 초기화 및 설정
-    memset(&serv_addr, 0, sizeof(serv_addr));
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    serv_addr.sin_port = htons(PORT);
-
-    // 4-3. 소켓에 주소 할당 (Binding)
-    if (bind(serv_sock, (struct sockaddr*) &serv_addr, sizeof(serv_addr)) == -1)
-        error_handling("bind() error");
-
-    // 4-4. 연결 요청 대기 (Listening)
-    if (listen(serv_sock, 5) == -1)
-        error_handling("listen() error");
-    
-    // 5. select 감시 준비
-    FD_ZERO(&reads);             // reads 집합 초기화
-    FD_SET(serv_sock, &reads);   // 서버 소켓을 감시 목록에 추가
-    max_fd = serv_sock;
-
-    printf("Chat Server running on port %d...\n", PORT);
-
-    // 6. 메인 루프: I/O 이벤트 감시
+
     while (1) {
-        temps = reads; // 원본 집합을 복사
-        
-        // select 호출: 이벤트를 기다림 (timeout = NULL, 무한 대기)
-        if (select(max_fd + 1, &temps, 0, 0, NULL) == -1)
-            error_handling("select() error");
-
-        // 7. 이벤트 발생 확인 (max_fd까지 루프)
-        for (i = 0; i < max_fd + 1; i++) {
-            if (FD_ISSET(i, &temps)) { // i번 소켓에 이벤트가 발생했다면
-                if (i == serv_sock) { // A. 새로운 연결 요청 (서버 소켓)
-                    clnt_addr_size = sizeof(clnt_addr);
-                    clnt_sock = accept(serv_sock, (struct sockaddr*)&clnt_addr, &clnt_addr_size);
-                    
-                    if (clnt_sock == -1) {
-                        perror("accept() error");
-                        continue;
-                    }
-
-                    // 새 클라이언트 등록
-                    FD_SET(clnt_sock, &reads);
-                    if (max_fd < clnt_sock) max_fd = clnt_sock; // max_fd 업데이트
-
-                    // 클라이언트 소켓 목록에 추가
-                    if (max_sock_idx < MAX_CLIENTS) {
-                        client_socks[max_sock_idx++] = clnt_sock;
-                        printf("New client connected: %d\n", clnt_sock);
-                    } else {
-                        printf("Client connection refused: Max limit reached.\n");
-                        close(clnt_sock);
-                        FD_CLR(clnt_sock, &reads);
-                    }
-                }
-                else { // B. 연결된 클라이언트로부터 데이터 수신 (클라이언트 소켓)
-                    str_len = read(i, buf, BUF_SIZE);
-                    
-                    if (str_len == 0) { // 클라이언트 연결 종료
-                        // 감시 목록에서 제거
-                        FD_CLR(i, &reads);
-                        close(i);
-                        
-                        // client_socks 배열에서 해당 소켓 제거
-                        remove_client(i, client_socks, &max_sock_idx);
-                        
-                        printf("Client disconnected: %d\n", i);
-                    }
-                    else { // 데이터 수신
-                        // 수신된 메시지를 모든 클라이언트에게 브로드캐스트
-                        send_message_to_all(i, buf, str_len, client_socks, &max_sock_idx);
-                    }
-                }
+        clnt_addr_size = sizeof(clnt_addr);
+        int clnt_sock = accept4(ls->fd, (struct sockaddr*)&clnt_addr, &clnt_addr_size, SOCK_NONBLOCK);
+        if (clnt_sock == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                perror("accept() error"); // fd 한도 등: 다음 연결 이벤트 때 다시 시도
+            return;
+        }
+
+        printf("New client connected: %d\n", clnt_sock);
+        if (add_client(sh, clnt_sock, ls->framed) == -1) {
+            printf("Client connection refused: %d\n", clnt_sock);
+            close(clnt_sock);
+        }
+    }
+}
+
+// 10. 클라이언트가 보낸 데이터를 모두 읽어 메시지 단위로 처리 (엣지 트리거이므로 EAGAIN 이 나올 때까지)
+// 반환값: 연결이 끊겼거나 오류면 -1
+int read_client(shard_t *sh, client_t *client) {
+    while (1) {
+        // 버퍼에 남은 메시지부터 처리: 멈추면 나머지는 소켓 버퍼에 남겨 TCP 가 보내는 쪽을 늦추도록
+        if (process_input(sh, client) == -1)
+            return 0;
+
+        // 버퍼가 가득 찼으면 받는 중인 긴 메시지가 들어가도록 늘림 (최대 MAX_MSG + 머리)
+        if (client->in_len == client->in_cap) {
+            size_t cap = client->in_cap * 2;
+            if (cap > MAX_MSG + FRAME_HDR)
+                cap = MAX_MSG + FRAME_HDR;
+            char *p = realloc(client->in, cap);
+            if (p == NULL) {
+                perror("realloc() error");
+                return -1;
+            }
+            client->in = p;
+            client->in_cap = cap;
+        }
+
+        ssize_t str_len = read(client->fd, client->in + client->in_len, client->in_cap - client->in_len);
+        if (str_len == 0) // 클라이언트 연결 종료
+            return -1;
+        if (str_len == -1) {
+            if (errno == EINTR) continue;
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        client->in_len += str_len;
+    }
+}
+
+// 버퍼의 완성된 메시지를 차례로 처리하고 남은 조각은 버퍼 앞으로 당김
+// 방 멤버가 있는 다른 쓰레드의 우편함이 가득 찼으면 버리지 않고 이 클라이언트 읽기를 멈춤
+// 반환값: 멈췄거나 연결을 끊었으면 -1
+int process_input(shard_t *sh, client_t *client) {
+    size_t off = 0;
+    ssize_t used;
+    char *payload;
+    size_t len;
+    int ret = 0;
+
+    while ((used = next_message(client, off, &payload, &len)) > 0) {
+        if (is_command(payload, len)) {
+            handle_command(sh, client, payload, len);
+        } else if (client->room == NULL) {
+            send_notice(sh, client, "join a room first: /join <room>");
+        } else if (!room_writable(sh, client->room)) {
+            if (!client->paused) {
+                client->paused = 1;
+                client->next_paused = sh->paused_clients;
+                sh->paused_clients = client;
             }
+            ret = -1;
+            break;
+        } else {
+            send_message_to_room(sh, client, payload, len);
         }
+        if (client->dead) return -1;
+        off += used;
     }
-    close(serv_sock);
+    if (used == -1) { // 프레임 길이가 MAX_MSG 를 넘음: 이후 경계를 알 수 없으므로 연결을 끊음
+        printf("Client sent oversized frame: %d\n", client->fd);
+        remove_client(sh, client);
+        return -1;
+    }
+
+    client->in_len -= off;
+    memmove(client->in, client->in + off, client->in_len);
+    if (client->in_len == 0 && client->in_cap > BUF_SIZE) { // 긴 메시지를 받느라 늘린 버퍼를 되돌림
+        char *p = realloc(client->in, BUF_SIZE);
+        if (p != NULL) {
+            client->in = p;
+            client->in_cap = BUF_SIZE;
+        }
+    }
+
+    // 읽을 때마다 받을 쓰레드를 깨움 (멈출 때 기다리는 우편함의 쓰레드도 깨어 있어야 하므로)
+    wake_shards(sh);
+    return ret;
+}
+
+// 버퍼의 off 위치에서 완성된 메시지 하나를 찾아 본문 위치와 길이를 알려 줌
+// 프레임: [길이 4바이트 빅엔디언][본문]
+// 줄 단위: 본문'\n' (끝의 '\r' 제외, 줄바꿈 없이 MAX_MSG 를 넘으면 거기서 나눔)
+// 반환값: 메시지가 차지한 바이트 수, 아직 다 오지 않았으면 0, 프레임 길이가 MAX_MSG 를 넘으면 -1
+ssize_t next_message(client_t *client, size_t off, char **payload, size_t *len) {
+    char *start = client->in + off;
+    size_t avail = client->in_len - off;
+
+    if (client->framed) {
+        uint32_t n;
+        if (avail < FRAME_HDR) return 0;
+        memcpy(&n, start, FRAME_HDR);
+        n = ntohl(n);
+        if (n > MAX_MSG) return -1;
+        if (avail < FRAME_HDR + n) return 0;
+        *payload = start + FRAME_HDR;
+        *len = n;
+        return FRAME_HDR + n;
+    }
+
+    char *nl = memchr(start, '\n', avail);
+    if (nl == NULL) {
+        if (avail < MAX_MSG) return 0;
+        *payload = start;
+        *len = MAX_MSG;
+        return MAX_MSG;
+    }
+    *payload = start;
+    *len = nl - start;
+    if (*len > 0 && start[*len - 1] == '\r')
+        (*len)--;
+    return nl + 1 - start;
+}
+
+// 서버가 처리하는 명령인지 확인 (/join 방이름, /since 번호, /leave, /list)
+int is_command(const char *msg, size_t len) {
+    if (len == 0 || msg[0] != '/')
+        return 0;
+    return (len >= 5 && memcmp(msg, "/join", 5) == 0 && (len == 5 || msg[5] == ' ')) ||
+           (len >= 6 && memcmp(msg, "/since", 6) == 0 && (len == 6 || msg[6] == ' ')) ||
+           (len == 6 && memcmp(msg, "/leave", 6) == 0) ||
+           (len == 5 && memcmp(msg, "/list", 5) == 0);
+}
+
+// 11. 명령 처리 (msg 는 줄바꿈이나 프레임 머리를 뺀 본문)
+void handle_command(shard_t *sh, client_t *client, char *msg, size_t len) {
+    char name[ROOM_NAME_MAX];
+
+    if (msg[1] == 'j') {
+        // 11-1. /join 방이름: 지금 방에서 나와 그 방에 들어감 (없으면 만듦)
+        char *p = msg + 5, *end = msg + len;
+        while (p < end && *p == ' ') p++;
+        while (end > p && end[-1] == ' ') end--;
+        if (end == p || end - p >= ROOM_NAME_MAX || memchr(p, ' ', end - p)) {
+            send_notice(sh, client, "usage: /join <room> (1-%d characters, no spaces)", ROOM_NAME_MAX - 1);
+            return;
+        }
+        memcpy(name, p, end - p);
+        name[end - p] = '\0';
+        room_join(sh, client, name);
+    } else if (msg[1] == 's') {
+        // 11-2. /since 번호: 들어가 있는 방의 기록에서 그 번호 다음부터 다시 받음 (0 이면 남아 있는 기록 전부)
+        char num[24];
+        char *end;
+        size_t n = len - 6 < sizeof(num) - 1 ? len - 6 : sizeof(num) - 1;
+        memcpy(num, msg + 6, n);
+        num[n] = '\0';
+        unsigned long long seq = strtoull(num, &end, 10);
+        if (end == num || strspn(end, " ") != strlen(end)) {
+            send_notice(sh, client, "usage: /since <seq>");
+        } else if (client->room == NULL) {
+            send_notice(sh, client, "join a room first: /join <room>");
+        } else if (client->room->hist == NULL) {
+            send_notice(sh, client, "history is disabled");
+        } else {
+            replay_start(sh, client, seq + 1);
+        }
+    } else if (msg[2] == 'e') {
+        // 11-3. /leave: 방에서 나옴 (다시 들어갈 때까지 메시지를 보내지도 받지도 않음)
+        if (client->room == NULL) {
+            send_notice(sh, client, "not in a room");
+            return;
+        }
+        snprintf(name, sizeof(name), "%s", client->room->name);
+        room_leave(sh, client);
+        send_notice(sh, client, "left %s", name);
+    } else {
+        // 11-4. /list: 방 목록과 멤버 수
+        list_rooms(sh, client);
+    }
+}
+
+// 서버 안내 메시지를 이 클라이언트에게만 전송 (보내다 연결이 끊기면 제거)
+void send_notice(shard_t *sh, client_t *client, const char *fmt, ...) {
+    char buf[BUF_SIZE];
+    va_list ap;
+    int len;
+
+    len = snprintf(buf, sizeof(buf), "[server] ");
+    va_start(ap, fmt);
+    len += vsnprintf(buf + len, sizeof(buf) - len, fmt, ap);
+    va_end(ap);
+    if (len > (int)sizeof(buf) - 1)
+        len = sizeof(buf) - 1;
+
+    msg_t *msg = msg_create(buf, len);
+    if (msg == NULL) return;
+    if (enqueue_message(sh, client, msg) == -1) {
+        printf("Client disconnected: %d\n", client->fd);
+        remove_client(sh, client);
+    }
+    msg_release(msg);
+}
+
+// 12. 방으로 메시지 전송 (보낸 클라이언트 제외)
+// 메시지는 한 번만 복사해 이 쓰레드의 멤버 대기열에 직접 넣고,
+// 멤버가 있는 다른 쓰레드에는 우편함으로 같은 버퍼를 넘겨 그 쓰레드가 자기 멤버에게 넣음
+void send_message_to_room(shard_t *sh, client_t *sender, char *msg, size_t len) {
+    room_t *room = sender->room;
+    int i;
+
+    msg_t *m = msg_create(msg, len); // 돌리는 동안 해제되지 않도록 참조 하나를 잡아 둠
+    if (m == NULL) return;
+
+    // 나눠 주기 전에 기록에 남겨 번호를 붙임 (기록을 따라잡는 클라이언트가 빠뜨리거나 두 번 받지 않도록)
+    if (room->hist)
+        history_append(room->hist, sender->id, m);
+
+    unsigned long long mask = atomic_load_explicit(&room->shard_mask, memory_order_acquire);
+    for (i = 0; i < shard_count; i++) {
+        if (i == sh->id || !(mask & (1ULL << i))) continue;
+
+        // 우편함에 있는 동안 메시지와 방이 해제되지 않도록 참조를 하나씩 더함
+        atomic_fetch_add_explicit(&m->refs, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&room->refs, 1, memory_order_relaxed);
+        if (mailbox_push(shards[i].inbox[sh->id], m, room) == -1) {
+            atomic_fetch_sub_explicit(&m->refs, 1, memory_order_relaxed);
+            room_put(room);
+            sh->mail_dropped++;
+            continue;
+        }
+        sh->wake_mask |= 1ULL << i;
+    }
+
+    deliver_local(sh, sender, room, m);
+    msg_release(m);
+}
+
+// 이 쓰레드에 있는 방 멤버의 대기열에 메시지 추가 (sender 제외)
+// 뒤에서부터 돌아 제거로 마지막 항목이 당겨와도 건너뛰는 항목이 없음
+void deliver_local(shard_t *sh, client_t *sender, room_t *room, msg_t *msg) {
+    member_list_t *list = &room->local[sh->id];
+    int i;
+
+    for (i = list->count - 1; i >= 0; i--) {
+        client_t *target = list->members[i];
+        if (target == sender) continue;
+        if (msg->seq && (target->replay || msg->seq < target->live_from))
+            continue; // 기록을 따라잡는 중이거나 이미 기록으로 받음
+
+        if (enqueue_message(sh, target, msg) == -1) {
+            printf("Client disconnected: %d\n", target->fd);
+            remove_client(sh, target);
+        }
+    }
+}
+
+// 13. 우편함에 넣기 (보내는 쓰레드만 호출): 칸을 채운 뒤 tail 을 올려 받는 쪽에 공개
+// 반환값: 가득 찼으면 -1
+int mailbox_push(mailbox_t *box, msg_t *msg, room_t *room) {
+    size_t tail = atomic_load_explicit(&box->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&box->head, memory_order_acquire);
+
+    if (tail - head == MAILBOX_SIZE)
+        return -1;
+    box->slots[tail & (MAILBOX_SIZE - 1)].msg = msg;
+    box->slots[tail & (MAILBOX_SIZE - 1)].room = room;
+    atomic_store_explicit(&box->tail, tail + 1, memory_order_release);
     return 0;
 }
 
-// 8. 브로드캐스트 함수 (모든 클라이언트에게 메시지 전송)
-void send_message_to_all(int sender_sock, char *msg, int len, int *client_socks, int *max_sock_idx) {
+// 방 멤버가 있는 다른 쓰레드의 우편함에 모두 자리가 있는지 확인
+// 가득 찬 우편함에는 깨워 달라고 표시한 뒤 다시 확인 (그 사이에 받는 쪽이 비운 경우를 놓치지 않도록)
+int room_writable(shard_t *sh, room_t *room) {
+    unsigned long long mask = atomic_load_explicit(&room->shard_mask, memory_order_acquire);
     int i;
-    for (i = 0; i < *max_sock_idx; i++) {
-        int target_sock = client_socks[i];
-        if (target_sock > 0 && target_sock != sender_sock) {
-            write(target_sock, msg, len);
+
+    for (i = 0; i < shard_count; i++) {
+        if (i == sh->id || !(mask & (1ULL << i))) continue;
+
+        mailbox_t *box = shards[i].inbox[sh->id];
+        size_t tail = atomic_load_explicit(&box->tail, memory_order_relaxed);
+        if (tail - atomic_load_explicit(&box->head, memory_order_acquire) < MAILBOX_SIZE) continue;
+
+        atomic_store(&box->want_wake, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (tail - atomic_load_explicit(&box->head, memory_order_acquire) == MAILBOX_SIZE)
+            return 0;
+    }
+    return 1;
+}
+
+// 우편함의 메시지를 모두 꺼내 이 쓰레드의 방 멤버에게 전달 (받는 쓰레드만 호출)
+// eventfd 를 먼저 비우므로 그 뒤에 들어온 메시지는 다음 깨우기 때 처리됨
+// 이 쓰레드의 멈춘 클라이언트를 깨우는 신호도 같은 eventfd 로 옴
+void drain_mailboxes(shard_t *sh) {
+    uint64_t count, one = 1;
+    int i;
+
+    if (read(sh->notify_fd, &count, sizeof(count)) == -1 && errno != EAGAIN)
+        perror("read() error");
+
+    for (i = 0; i < shard_count; i++) {
+        mailbox_t *box = sh->inbox[i];
+        if (box == NULL) continue;
+
+        size_t head = atomic_load_explicit(&box->head, memory_order_relaxed);
+        size_t tail = atomic_load_explicit(&box->tail, memory_order_acquire);
+        if (head == tail) continue;
+        while (head != tail) {
+            mail_t mail = box->slots[head & (MAILBOX_SIZE - 1)];
+            atomic_store_explicit(&box->head, ++head, memory_order_release); // 칸을 보내는 쪽에 돌려줌
+
+            deliver_local(sh, NULL, mail.room, mail.msg);
+            msg_release(mail.msg);
+            room_put(mail.room);
         }
+
+        // 가득 차 읽기를 멈춘 보내는 쪽이 있으면 깨움
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_exchange(&box->want_wake, 0) && write(shards[i].notify_fd, &one, sizeof(one)) == -1 &&
+            errno != EAGAIN)
+            perror("write() error");
     }
+    resume_clients(sh);
 }
 
-// 9. 클라이언트 배열에서 소켓 제거 및 재정렬 함수
-void remove_client(int sock_fd, int *client_socks, int *max_sock_idx) {
+// 우편함에 자리가 나기를 기다리던 클라이언트를 이어서 읽음 (아직 가득 차 있으면 다시 멈춤)
+void resume_clients(shard_t *sh) {
+    client_t *list = sh->paused_clients;
+
+    sh->paused_clients = NULL;
+    while (list) {
+        client_t *client = list;
+        list = client->next_paused;
+        client->paused = 0;
+        if (client->dead) continue; // 이번 처리 중에 끊김 (해제는 루프 끝에서)
+
+        if (read_client(sh, client) == -1) {
+            printf("Client disconnected: %d\n", client->fd);
+            remove_client(sh, client);
+        }
+    }
+}
+
+// 우편함에 넣은 쓰레드를 한 번씩 깨움 (메시지마다 깨우지 않고 모아서)
+void wake_shards(shard_t *sh) {
+    uint64_t one = 1;
     int i;
-    for (i = 0; i < *max_sock_idx; i++) {
-        if (client_socks[i] == sock_fd) {
-            // 해당 소켓을 배열에서 제거: 배열의 마지막 요소를 그 위치로 이동
-            (*max_sock_idx)--;
-            client_socks[i] = client_socks[*max_sock_idx];
-            client_socks[*max_sock_idx] = 0; // 배열의 마지막 요소 초기화
+
+    for (i = 0; sh->wake_mask; i++) {
+        if (!(sh->wake_mask & (1ULL << i))) continue;
+        sh->wake_mask &= ~(1ULL << i);
+        if (write(shards[i].notify_fd, &one, sizeof(one)) == -1 && errno != EAGAIN)
+            perror("write() error");
+    }
+    if (sh->mail_dropped) {
+        printf("Mailbox full (%lu messages dropped)\n", sh->mail_dropped);
+        sh->mail_dropped = 0;
+    }
+}
+
+// 14. 방 찾기 (없으면 만듦): 참조를 하나 더해 반환하고, 다 쓰면 room_put
+// 참조가 0 이 된 방은 해제되는 중이므로 되살리지 않고 새로 만듦
+room_t *room_get(const char *name) {
+    unsigned long b = hash_string(name) % ROOM_BUCKETS;
+    room_t *room;
+
+    pthread_mutex_lock(&rooms_lock);
+    for (room = room_buckets[b]; room; room = room->next) {
+        if (strcmp(room->name, name) != 0) continue;
+        int refs = atomic_load(&room->refs);
+        while (refs > 0 && !atomic_compare_exchange_weak(&room->refs, &refs, refs + 1))
+            ;
+        if (refs > 0) break;
+    }
+    if (room == NULL && (room = calloc(1, sizeof(room_t))) != NULL) {
+        snprintf(room->name, sizeof(room->name), "%s", name);
+        atomic_init(&room->refs, 1);
+        room->hist = history_dir ? history_get(name) : NULL;
+        room->next = room_buckets[b];
+        room_buckets[b] = room;
+    }
+    pthread_mutex_unlock(&rooms_lock);
+    return room;
+}
+
+// 참조 해제: 마지막 참조면 해시 테이블에서 빼고 해제
+void room_put(room_t *room) {
+    int i;
+
+    if (atomic_fetch_sub_explicit(&room->refs, 1, memory_order_acq_rel) != 1)
+        return;
+
+    pthread_mutex_lock(&rooms_lock);
+    room_t **pp = &room_buckets[hash_string(room->name) % ROOM_BUCKETS];
+    while (*pp != room)
+        pp = &(*pp)->next;
+    *pp = room->next;
+    pthread_mutex_unlock(&rooms_lock);
+
+    for (i = 0; i < MAX_SHARDS; i++)
+        free(room->local[i].members);
+    free(room);
+}
+
+// 방에 들어가기 (이미 다른 방에 있으면 먼저 나옴)
+void room_join(shard_t *sh, client_t *client, const char *name) {
+    if (client->room && strcmp(client->room->name, name) == 0) {
+        send_notice(sh, client, "already in %s", name);
+        return;
+    }
+
+    room_t *room = room_get(name);
+    if (room == NULL) {
+        send_notice(sh, client, "cannot join %s", name);
+        return;
+    }
+    member_list_t *list = &room->local[sh->id];
+    if (list->count == list->cap) {
+        int cap = list->cap ? list->cap * 2 : INITIAL_CLIENTS;
+        client_t **p = realloc(list->members, cap * sizeof(client_t *));
+        if (p == NULL) {
+            room_put(room);
+            send_notice(sh, client, "cannot join %s", name);
+            return;
+        }
+        list->members = p;
+        list->cap = cap;
+    }
+
+    if (client->room)
+        room_leave(sh, client);
+    client->room = room; // room_get 으로 얻은 참조는 멤버십이 가짐
+    client->room_idx = list->count;
+    list->members[list->count++] = client;
+    if (list->count == 1) // 이 쓰레드의 첫 멤버: 다른 쓰레드가 우편함으로 보내기 시작하도록
+        atomic_fetch_or_explicit(&room->shard_mask, 1ULL << sh->id, memory_order_release);
+    int members = atomic_fetch_add(&room->members, 1) + 1;
+    send_notice(sh, client, "joined %s (%d members)", name, members);
+
+    // 멤버가 된 뒤에 기록을 따라잡아야 그 사이에 온 메시지를 빠뜨리지 않음
+    if (room->hist && !client->dead)
+        replay_start(sh, client, 0);
+}
+
+// 방에서 나오기: 이 쓰레드의 멤버 목록에서 마지막 항목을 그 자리로 옮겨 O(1) 로 제거
+void room_leave(shard_t *sh, client_t *client) {
+    room_t *room = client->room;
+    member_list_t *list = &room->local[sh->id];
+
+    client_t *last = list->members[--list->count];
+    list->members[client->room_idx] = last;
+    last->room_idx = client->room_idx;
+    if (list->count == 0) // 이 쓰레드에 남은 멤버가 없으면 더 이상 우편함으로 보내지 않도록
+        atomic_fetch_and_explicit(&room->shard_mask, ~(1ULL << sh->id), memory_order_release);
+    atomic_fetch_sub(&room->members, 1);
+
+    client->room = NULL;
+    client->replay = NULL;
+    client->live_from = 0;
+    room_put(room);
+}
+
+// 방 목록과 멤버 수를 이 클라이언트에게 전송 (한 줄에 들어가는 만큼)
+void list_rooms(shard_t *sh, client_t *client) {
+    char buf[BUF_SIZE - 64];
+    size_t len = 0;
+    int rooms = 0, b;
+
+    buf[0] = '\0';
+    pthread_mutex_lock(&rooms_lock);
+    for (b = 0; b < ROOM_BUCKETS; b++) {
+        for (room_t *room = room_buckets[b]; room; room = room->next) {
+            int members = atomic_load(&room->members);
+            if (members == 0) continue;
+            rooms++;
+            if (len + ROOM_NAME_MAX + 16 < sizeof(buf))
+                len += snprintf(buf + len, sizeof(buf) - len, " %s(%d)", room->name, members);
+        }
+    }
+    pthread_mutex_unlock(&rooms_lock);
+    send_notice(sh, client, "%d rooms:%s", rooms, buf);
+}
+
+unsigned long hash_string(const char *str) {
+    unsigned long hash = 5381;
+    int c;
+
+    while ((c = *str++))
+        hash = ((hash << 5) + hash) + c; // djb2
+    return hash;
+}
+
+// 대기열에 메시지 추가: 바로 보내지 않고 이번 이벤트 처리가 끝날 때 모아서 전송 (flush_pending)
+// 몰려온 작은 메시지들이 받는 클라이언트마다 writev 한 번으로 나가므로 시스템 콜이 메시지 수에 비례하지 않음
+// 대기열이 HIGH_WATER 를 넘은 클라이언트에게는 메시지를 버리고, SLOW_CLIENT_SECS 넘게 계속 넘쳐 있으면 -1 (연결 끊기)
+int enqueue_message(shard_t *sh, client_t *client, msg_t *msg) {
+    if (client->queued >= HIGH_WATER) {
+        time_t now = time(NULL);
+        if (client->over_since == 0)
+            client->over_since = now;
+        else if (now - client->over_since >= SLOW_CLIENT_SECS) {
+            printf("Client too slow (%lu messages dropped): %d\n", client->dropped, client->fd);
+            return -1;
+        }
+        client->dropped++;
+        return 0;
+    }
+
+    if (queue_push(client, msg->data, msg->len, msg, NULL) == -1)
+        return -1;
+
+    if (client->want_out) return 0; // 이미 EPOLLOUT 을 기다리는 중: 그때 함께 보냄
+    if (client->queued >= FLUSH_BYTES) // 한 번에 많이 쌓이면 루프 끝을 기다리지 않음 (HIGH_WATER 에 닿기 전에)
+        return flush_client(sh, client);
+    mark_pending(sh, client);
+    return 0;
+}
+
+// 송신 대기열 끝에 항목 추가 (원형 배열이 가득 차면 두 배로 늘림)
+// data 는 [프레임 머리][본문]['\n'] 모양이고, msg 나 seg 중 하나의 참조를 하나 더함
+int queue_push(client_t *client, char *data, size_t len, msg_t *msg, segment_t *seg) {
+    if (client->q_count == client->q_cap) {
+        int cap = client->q_cap ? client->q_cap * 2 : INITIAL_QUEUE;
+        out_t *q = malloc(cap * sizeof(out_t));
+        if (q == NULL) return -1;
+        for (int i = 0; i < client->q_count; i++) // 원형 배열을 펼쳐 새 배열 앞쪽으로
+            q[i] = client->queue[(client->q_head + i) % client->q_cap];
+        free(client->queue);
+        client->queue = q;
+        client->q_head = 0;
+        client->q_cap = cap;
+    }
+
+    out_t *out = &client->queue[(client->q_head + client->q_count) % client->q_cap];
+    out->len = wire_view(client, data, len, &out->base);
+    out->msg = msg;
+    out->seg = seg;
+    if (msg)
+        atomic_fetch_add_explicit(&msg->refs, 1, memory_order_relaxed);
+    else
+        atomic_fetch_add_explicit(&seg->refs, 1, memory_order_relaxed);
+    client->q_count++;
+    client->queued += out->len;
+    return 0;
+}
+
+// 대기열 항목이 가리키는 메시지나 세그먼트의 참조 해제
+void out_release(out_t *out) {
+    if (out->msg)
+        msg_release(out->msg);
+    else
+        segment_release(out->seg);
+}
+
+// 이번 이벤트 처리가 끝나면 대기열을 보내도록 표시
+void mark_pending(shard_t *sh, client_t *client) {
+    if (client->pending) return;
+    client->pending = 1;
+    client->next_pending = sh->pending_clients;
+    sh->pending_clients = client;
+}
+
+// 대기열을 writev 로 보낼 수 있는 만큼 전송 (송신 버퍼가 차면 EPOLLOUT 을 기다림)
+// 반환값: 연결 오류면 -1
+int flush_client(shard_t *sh, client_t *client) {
+    struct iovec iov[MAX_IOV];
+
+    while (1) {
+        // 대기열을 다 보냈으면 따라잡는 중인 기록을 이어서 채움
+        if (client->q_count == 0 && (client->replay == NULL || history_stream(client) == 0))
             break;
+
+        int n = client->q_count < MAX_IOV ? client->q_count : MAX_IOV;
+        for (int i = 0; i < n; i++) {
+            out_t *out = &client->queue[(client->q_head + i) % client->q_cap];
+            size_t off = i == 0 ? client->out_off : 0;
+            iov[i].iov_base = out->base + off;
+            iov[i].iov_len = out->len - off;
+        }
+
+        ssize_t sent = writev(client->fd, iov, n);
+        if (sent == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                set_want_out(sh, client, 1);
+                return 0;
+            }
+            return -1;
+        }
+
+        // 다 보낸 항목은 대기열에서 빼고 참조 해제
+        client->queued -= sent;
+        sent += client->out_off;
+        while (client->q_count > 0) {
+            out_t *out = &client->queue[client->q_head];
+            if ((size_t)sent < out->len) break;
+            sent -= out->len;
+            client->q_head = (client->q_head + 1) % client->q_cap;
+            client->q_count--;
+            out_release(out);
+        }
+        client->out_off = sent;
+    }
+
+    if (client->queued < HIGH_WATER)
+        client->over_since = 0;
+    set_want_out(sh, client, 0);
+    return 0;
+}
+
+// 이번 이벤트 처리 중에 메시지가 쌓인 클라이언트의 대기열을 전송
+void flush_pending(shard_t *sh) {
+    while (sh->pending_clients) {
+        client_t *client = sh->pending_clients;
+        sh->pending_clients = client->next_pending;
+        client->pending = 0;
+        if (client->dead || client->want_out) continue; // 끊겼거나 EPOLLOUT 때 보냄
+
+        if (flush_client(sh, client) == -1) {
+            printf("Client disconnected: %d\n", client->fd);
+            remove_client(sh, client);
+        }
+    }
+}
+
+// 대기열이 남아 있을 때만 EPOLLOUT 을 감시 (빈 대기열에 쓰기 가능 이벤트가 계속 오지 않도록)
+void set_want_out(shard_t *sh, client_t *client, int want) {
+    struct epoll_event ev;
+
+    if (client->want_out == want) return;
+    client->want_out = want;
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET | (want ? EPOLLOUT : 0);
+    ev.data.ptr = client;
+    epoll_ctl(sh->epfd, EPOLL_CTL_MOD, client->fd, &ev);
+}
+
+// 참조 하나를 가진 메시지 생성 (만든 쪽이 다 나눠 준 뒤 msg_release)
+// 두 프로토콜이 같은 버퍼를 쓰도록 프레임 머리와 줄바꿈을 함께 붙여 둠 (기록에도 이 모양 그대로 남김)
+msg_t *msg_create(const char *data, size_t len) {
+    uint32_t n = htonl(len);
+    msg_t *msg = malloc(sizeof(msg_t) + FRAME_HDR + len + 1);
+    if (msg == NULL) {
+        perror("malloc() error");
+        return NULL;
+    }
+    atomic_init(&msg->refs, 1);
+    msg->seq = 0;
+    msg->len = len;
+    memcpy(msg->data, &n, FRAME_HDR);
+    memcpy(msg->data + FRAME_HDR, data, len);
+    msg->data[FRAME_HDR + len] = '\n';
+    return msg;
+}
+
+// [프레임 머리][본문 len 바이트]['\n'] 중 이 클라이언트의 프로토콜로 보낼 부분의 시작과 길이
+size_t wire_view(const client_t *client, char *data, size_t len, char **base) {
+    if (client->framed) {
+        *base = data;
+        return FRAME_HDR + len;
+    }
+    *base = data + FRAME_HDR;
+    return len + 1;
+}
+
+// 마지막 참조면 해제 (다른 쓰레드가 놓은 참조일 수 있으므로 원자적으로)
+void msg_release(msg_t *msg) {
+    if (atomic_fetch_sub_explicit(&msg->refs, 1, memory_order_acq_rel) == 1)
+        free(msg);
+}
+
+// 15. 클라이언트 목록에 추가하고 epoll 에 등록 (목록이 가득 차면 두 배로 늘림), 처음 방에 넣음
+int add_client(shard_t *sh, int sock, int framed) {
+    struct epoll_event ev;
+
+    if (sh->client_count == sh->client_cap) {
+        int cap = sh->client_cap ? sh->client_cap * 2 : INITIAL_CLIENTS;
+        client_t **p = realloc(sh->clients, cap * sizeof(client_t *));
+        if (p == NULL) return -1;
+        sh->clients = p;
+        sh->client_cap = cap;
+    }
+
+    client_t *client = calloc(1, sizeof(client_t));
+    if (client == NULL) return -1;
+    client->in = malloc(BUF_SIZE);
+    if (client->in == NULL) {
+        free(client);
+        return -1;
+    }
+    client->in_cap = BUF_SIZE;
+    client->fd = sock;
+    client->id = server_epoch << 32 | atomic_fetch_add(&client_serial, 1);
+    client->idx = sh->client_count;
+    client->framed = framed;
+
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = client;
+    if (epoll_ctl(sh->epfd, EPOLL_CTL_ADD, sock, &ev) == -1) {
+        perror("epoll_ctl() error");
+        free(client->in);
+        free(client);
+        return -1;
+    }
+    sh->clients[sh->client_count++] = client;
+
+    // 방이 없던 때처럼 접속하자마자 모두와 대화할 수 있도록 기본 방에 넣음
+    room_join(sh, client, DEFAULT_ROOM);
+    return 0;
+}
+
+// 16. 클라이언트 목록에서 제거: 마지막 항목을 그 자리로 옮겨 O(1) 로 제거
+// 같은 epoll_wait 결과에 이 클라이언트의 이벤트가 남아 있을 수 있으므로 해제는 루프 끝에서
+void remove_client(shard_t *sh, client_t *client) {
+    epoll_ctl(sh->epfd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+
+    client_t *last = sh->clients[--sh->client_count];
+    sh->clients[client->idx] = last;
+    last->idx = client->idx;
+    sh->clients[sh->client_count] = NULL;
+
+    if (client->room)
+        room_leave(sh, client);
+    if (client->paused) { // 멈춘 목록에서 빼기 (resume_clients 가 이미 꺼냈으면 목록에 없음)
+        client_t **pp = &sh->paused_clients;
+        while (*pp && *pp != client)
+            pp = &(*pp)->next_paused;
+        if (*pp)
+            *pp = client->next_paused;
+    }
+
+    // 보내지 못한 항목의 참조 해제
+    while (client->q_count > 0) {
+        out_release(&client->queue[client->q_head]);
+        client->q_head = (client->q_head + 1) % client->q_cap;
+        client->q_count--;
+    }
+    free(client->queue);
+    client->queue = NULL;
+    free(client->in);
+    client->in = NULL;
+
+    client->dead = 1;
+    client->next_dead = sh->dead_clients;
+    sh->dead_clients = client;
+}
+
+// 17. 방 기록 찾기 (없으면 만듦): 기록은 지우지 않으므로 참조 수 없이 그대로 씀
+history_t *history_get(const char *name) {
+    unsigned long b = hash_string(name) % ROOM_BUCKETS;
+    history_t *h;
+
+    pthread_mutex_lock(&histories_lock);
+    for (h = history_buckets[b]; h; h = h->next)
+        if (strcmp(h->name, name) == 0) break;
+    if (h == NULL && (h = calloc(1, sizeof(history_t))) != NULL) {
+        snprintf(h->name, sizeof(h->name), "%s", name);
+        pthread_mutex_init(&h->lock, NULL);
+        h->next_seq = 1;
+        h->next = history_buckets[b];
+        history_buckets[b] = h;
+    }
+    pthread_mutex_unlock(&histories_lock);
+    return h;
+}
+
+// 남아 있는 세그먼트 파일을 다시 매핑해 방마다 기록 목록과 위치 색인을 만듦
+// 끝까지 쓰지 못한 기록은 버리고, 압축이 중간에 멈춰 겹치는 세그먼트는 오래된 쪽을 지움
+void history_load(void) {
+    char path[PATH_MAX];
+    struct dirent *ent;
+    int rooms = 0, segs = 0;
+
+    if (mkdir(history_dir, 0755) == -1 && errno != EEXIST)
+        error_handling("mkdir() error");
+    DIR *dir = opendir(history_dir);
+    if (dir == NULL)
+        error_handling("opendir() error");
+
+    // 1. 파일 이름 "<방 이름 16진수>.<첫 번호>.seg" 를 읽어 기록마다 번호 순서로 넣음
+    while ((ent = readdir(dir)) != NULL) {
+        char hex[2 * ROOM_NAME_MAX], ext[8], name[ROOM_NAME_MAX];
+        unsigned long long first;
+        size_t n;
+
+        if (sscanf(ent->d_name, "%62[0-9a-f].%llu%7s", hex, &first, ext) != 3) continue;
+        snprintf(path, sizeof(path), "%s/%s", history_dir, ent->d_name);
+        if (strcmp(ext, ".tmp") == 0) { // 압축하다 멈춘 파일
+            unlink(path);
+            continue;
+        }
+        n = strlen(hex) / 2;
+        if (strcmp(ext, ".seg") != 0 || strlen(hex) % 2 != 0 || n == 0) continue;
+        for (size_t i = 0; i < n; i++) {
+            unsigned int c;
+            sscanf(hex + 2 * i, "%2x", &c);
+            name[i] = c;
+        }
+        name[n] = '\0';
+
+        segment_t *seg = segment_map(path, 0, 0);
+        if (seg == NULL) {
+            unlink(path); // 비어 있거나 열 수 없는 세그먼트
+            continue;
+        }
+        seg->first_seq = first;
+        segment_scan(seg);
+
+        history_t *h = history_get(name);
+        if (h == NULL || (h->seg_count == h->seg_cap && history_grow(h) == -1)) {
+            segment_release(seg);
+            continue;
+        }
+        int i = h->seg_count++;
+        while (i > 0 && h->segs[i - 1]->first_seq > seg->first_seq) {
+            h->segs[i] = h->segs[i - 1];
+            i--;
+        }
+        h->segs[i] = seg;
+    }
+    closedir(dir);
+
+    // 2. 다음 세그먼트와 겹치거나 빈 세그먼트를 정리하고 다음 번호를 정함 (마지막 세그먼트에 이어 씀)
+    for (int b = 0; b < ROOM_BUCKETS; b++) {
+        for (history_t *h = history_buckets[b]; h; h = h->next) {
+            int j = 0;
+            for (int i = 0; i < h->seg_count; i++) {
+                segment_t *seg = h->segs[i];
+                if (i < h->seg_count - 1 &&
+                    (seg->count == 0 || seg->first_seq + seg->count > h->segs[i + 1]->first_seq)) {
+                    unlink(seg->path);
+                    segment_release(seg);
+                    continue;
+                }
+                h->segs[j++] = seg;
+            }
+            h->seg_count = j;
+            if (j > 0)
+                h->next_seq = h->segs[j - 1]->first_seq + h->segs[j - 1]->count;
+            rooms++;
+            segs += j;
+        }
+    }
+    printf("History: %d rooms, %d segments in %s\n", rooms, segs, history_dir);
+}
+
+// 기록 목록 배열을 두 배로 늘림
+int history_grow(history_t *h) {
+    int cap = h->seg_cap ? h->seg_cap * 2 : 8;
+    segment_t **p = realloc(h->segs, cap * sizeof(segment_t *));
+    if (p == NULL) return -1;
+    h->segs = p;
+    h->seg_cap = cap;
+    return 0;
+}
+
+// 메시지를 기록 끝에 이어 쓰고 번호를 붙임 (마지막 세그먼트에 자리가 없으면 새 세그먼트를 만듦)
+// 기록 길이를 맨 나중에 써서, 쓰다 멈춘 기록은 다시 읽을 때 끝으로 보임
+void history_append(history_t *h, uint64_t sender_id, msg_t *msg) {
+    uint32_t rec_len = REC_HDR + FRAME_HDR + msg->len + 1;
+
+    pthread_mutex_lock(&h->lock);
+    segment_t *seg = h->seg_count ? h->segs[h->seg_count - 1] : NULL;
+    if (seg == NULL || seg->size - seg->used < rec_len) {
+        char path[PATH_MAX];
+        if (h->seg_count == h->seg_cap && history_grow(h) == -1) {
+            pthread_mutex_unlock(&h->lock);
+            return;
+        }
+        segment_path(path, sizeof(path), h->name, h->next_seq, ".seg");
+        seg = segment_map(path, rec_len > SEGMENT_SIZE ? rec_len : SEGMENT_SIZE, 1);
+        if (seg == NULL) { // 기록하지 못한 메시지는 번호 없이 실시간으로만 전달
+            pthread_mutex_unlock(&h->lock);
+            return;
+        }
+        seg->first_seq = h->next_seq;
+        h->segs[h->seg_count++] = seg;
+    }
+    if (segment_index(seg, seg->used) == -1) {
+        pthread_mutex_unlock(&h->lock);
+        return;
+    }
+
+    char *rec = seg->map + seg->used;
+    uint64_t seq = h->next_seq++;
+    memcpy(rec + 4, &seq, 8);
+    memcpy(rec + 12, &sender_id, 8);
+    memcpy(rec + REC_HDR, msg->data, FRAME_HDR + msg->len + 1);
+    memcpy(rec, &rec_len, 4);
+    seg->used += rec_len;
+    msg->seq = seq;
+    pthread_mutex_unlock(&h->lock);
+}
+
+// seq 번 기록이 든 세그먼트의 위치 (없으면 -1): 세그먼트는 번호 순서이므로 이진 탐색
+int history_find(history_t *h, uint64_t seq) {
+    int lo = 0, hi = h->seg_count - 1;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        segment_t *seg = h->segs[mid];
+        if (seq < seg->first_seq)
+            hi = mid - 1;
+        else if (seq >= seg->first_seq + seg->count)
+            lo = mid + 1;
+        else
+            return mid;
+    }
+    return -1;
+}
+
+// 18. 기록 따라잡기 시작: from 번부터 (0 이면 최근 HISTORY_REPLAY 개) 송신 대기열이 빌 때마다 이어서 보냄
+void replay_start(shard_t *sh, client_t *client, uint64_t from) {
+    history_t *h = client->room->hist;
+
+    if (from == 0) {
+        pthread_mutex_lock(&h->lock);
+        from = h->next_seq > HISTORY_REPLAY ? h->next_seq - HISTORY_REPLAY : 1;
+        pthread_mutex_unlock(&h->lock);
+    }
+    client->replay = h;
+    client->replay_next = from;
+    mark_pending(sh, client);
+}
+
+// 따라잡는 중인 기록을 매핑 안의 바이트 그대로 송신 대기열에 넣음 (메시지마다 새로 할당하지 않음)
+// 대기열이 HIGH_WATER 절반을 넘으면 멈추고, 다 보내면 실시간 메시지로 넘어감
+// 반환값: 대기열에 넣은 항목 수
+int history_stream(client_t *client) {
+    history_t *h = client->replay;
+    uint64_t last = 0;
+    int pushed = 0;
+
+    pthread_mutex_lock(&h->lock);
+    while (client->replay_next < h->next_seq && client->queued < HIGH_WATER / 2) {
+        // 1. 압축으로 지워진 앞부분이나 빠진 세그먼트는 건너뜀
+        if (h->seg_count == 0 || client->replay_next < h->segs[0]->first_seq)
+            client->replay_next = h->seg_count ? h->segs[0]->first_seq : h->next_seq;
+        int i = history_find(h, client->replay_next);
+        if (i == -1) {
+            int j = 0;
+            while (j < h->seg_count && h->segs[j]->first_seq <= client->replay_next) j++;
+            client->replay_next = j < h->seg_count ? h->segs[j]->first_seq : h->next_seq;
+            continue;
+        }
+
+        // 2. 이 세그먼트의 기록을 차례로 넣음 (자기가 보낸 메시지는 빼고)
+        segment_t *seg = h->segs[i];
+        uint32_t k = client->replay_next - seg->first_seq;
+        for (; k < seg->count && client->queued < HIGH_WATER / 2; k++) {
+            char *rec = seg->map + seg->offs[k];
+            uint64_t sender;
+            uint32_t n;
+            memcpy(&sender, rec + 12, 8);
+            memcpy(&n, rec + REC_HDR, FRAME_HDR);
+            if (sender != client->id) {
+                if (queue_push(client, rec + REC_HDR, ntohl(n), NULL, seg) == -1) break;
+                pushed++;
+            }
+            client->replay_next++;
+        }
+        if (k < seg->count && client->queued < HIGH_WATER / 2) break; // 대기열을 늘리지 못함
+    }
+
+    // 3. 다 따라잡았으면 이후 번호부터는 실시간으로 받음
+    if (client->replay_next >= h->next_seq) {
+        client->replay = NULL;
+        client->live_from = h->next_seq;
+        last = h->next_seq - 1;
+    }
+    pthread_mutex_unlock(&h->lock);
+
+    // 4. 마지막 번호를 알려 다시 접속할 때 /since 로 이어 받을 수 있게 함
+    if (client->replay == NULL && last > 0) {
+        char buf[64];
+        int len = snprintf(buf, sizeof(buf), "[server] end of history (#%llu)", (unsigned long long)last);
+        msg_t *msg = msg_create(buf, len);
+        if (msg) {
+            if (queue_push(client, msg->data, msg->len, msg, NULL) == 0)
+                pushed++;
+            msg_release(msg);
         }
     }
+    return pushed;
+}
+
+// 19. 압축 쓰레드: 주기적으로 방 기록마다 오래된 세그먼트를 정리
+void *compact_thread(void *arg) {
+    (void)arg;
+
+    while (1) {
+        sleep(COMPACT_SECS);
+        for (int b = 0; b < ROOM_BUCKETS; b++) {
+            pthread_mutex_lock(&histories_lock);
+            history_t *h = history_buckets[b]; // 기록은 지우지 않으므로 목록은 잠금 없이 따라가도 됨
+            pthread_mutex_unlock(&histories_lock);
+            for (; h; h = h->next)
+                history_compact(h);
+        }
+    }
+    return NULL;
+}
+
+// 최근 HISTORY_KEEP 개보다 오래된 기록 정리
+// 다 지난 세그먼트는 지우고, 맨 앞 세그먼트의 절반 넘게 지났으면 남은 뒷부분만 새 파일로 복사해 바꿔 끼움
+// 다 쓴 세그먼트는 바뀌지 않으므로 복사는 잠그지 않고 하고, 보내는 중인 대기열은 참조로 옛 매핑을 유지
+void history_compact(history_t *h) {
+    char tmp[PATH_MAX], path[PATH_MAX];
+    segment_t *old = NULL;
+
+    // 1. 쓰는 중인 세그먼트를 디스크로 내보내고 다 지난 세그먼트 정리
+    pthread_mutex_lock(&h->lock);
+    if (h->seg_count == 0) {
+        pthread_mutex_unlock(&h->lock);
+        return;
+    }
+    segment_t *active = h->segs[h->seg_count - 1];
+    msync(active->map, active->used, MS_ASYNC);
+
+    uint64_t cutoff = h->next_seq > HISTORY_KEEP ? h->next_seq - HISTORY_KEEP : 0;
+    while (h->seg_count > 1 && h->segs[0]->first_seq + h->segs[0]->count <= cutoff) {
+        segment_t *seg = h->segs[0];
+        memmove(h->segs, h->segs + 1, --h->seg_count * sizeof(segment_t *));
+        unlink(seg->path);
+        segment_release(seg);
+    }
+    if (h->seg_count > 1 && cutoff > h->segs[0]->first_seq &&
+        cutoff - h->segs[0]->first_seq >= h->segs[0]->count / 2) {
+        old = h->segs[0];
+        atomic_fetch_add_explicit(&old->refs, 1, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&h->lock);
+    if (old == NULL) return;
+
+    // 2. 남길 기록만 새 파일에 복사 (파일 이름을 바꾸는 순간까지 멈춰도 옛 세그먼트가 그대로 남음)
+    uint32_t k = cutoff - old->first_seq;
+    size_t from = old->offs[k];
+    size_t len = old->used - from;
+    segment_path(tmp, sizeof(tmp), h->name, cutoff, ".tmp");
+    segment_t *seg = segment_map(tmp, len, 1);
+    if (seg == NULL) {
+        segment_release(old);
+        return;
+    }
+    memcpy(seg->map, old->map + from, len);
+    seg->used = len;
+    seg->first_seq = cutoff;
+    for (; k < old->count; k++) {
+        if (segment_index(seg, old->offs[k] - from) == -1) break;
+    }
+    segment_path(path, sizeof(path), h->name, cutoff, ".seg");
+    if (k < old->count || msync(seg->map, len, MS_SYNC) == -1 || rename(tmp, path) == -1) {
+        unlink(tmp);
+        segment_release(seg);
+        segment_release(old);
+        return;
+    }
+    free(seg->path);
+    seg->path = strdup(path);
+
+    // 3. 바꿔 끼우고 옛 파일 삭제
+    pthread_mutex_lock(&h->lock);
+    h->segs[0] = seg;
+    unlink(old->path);
+    segment_release(old); // 기록 목록의 참조
+    pthread_mutex_unlock(&h->lock);
+    segment_release(old);
+    printf("History compacted: %s from #%llu\n", h->name, (unsigned long long)cutoff);
+}
+
+// 세그먼트 파일 경로: "<기록 디렉터리>/<방 이름 16진수>.<첫 번호 20자리><ext>" (방 이름에 어떤 글자가 와도 안전하도록)
+void segment_path(char *buf, size_t size, const char *name, uint64_t first_seq, const char *ext) {
+    char hex[2 * ROOM_NAME_MAX];
+    size_t n = 0;
+
+    for (; *name && n + 2 < sizeof(hex); name++, n += 2)
+        sprintf(hex + n, "%02x", (unsigned char)*name);
+    hex[n] = '\0';
+    snprintf(buf, size, "%s/%s.%020llu%s", history_dir, hex, (unsigned long long)first_seq, ext);
+}
+
+// 세그먼트 파일을 통째로 매핑 (create 면 size 바이트로 새로 만들고, 아니면 파일 크기만큼)
+// 새 파일은 디스크 블록을 미리 잡아 둠: 빈 구멍이 있는 파일에 매핑으로 쓰다 디스크가 차면 SIGBUS 로 서버 전체가 죽음
+// 매핑은 파일을 닫아도 남으므로 fd 는 바로 닫음
+segment_t *segment_map(const char *path, size_t size, int create) {
+    struct stat st;
+    int err;
+
+    int fd = open(path, create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0644);
+    if (fd == -1) {
+        perror("open() error");
+        return NULL;
+    }
+    if (create && (err = posix_fallocate(fd, 0, size)) != 0) {
+        fprintf(stderr, "posix_fallocate() error: %s\n", strerror(err)); // 호출한 쪽은 기록 없이 실시간으로만 전달
+        close(fd);
+        unlink(path);
+        return NULL;
+    }
+    if (!create && fstat(fd, &st) == -1) {
+        perror("fstat() error");
+        close(fd);
+        return NULL;
+    }
+    if (!create)
+        size = st.st_size;
+    if (size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    char *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap() error");
+        return NULL;
+    }
+    segment_t *seg = calloc(1, sizeof(segment_t));
+    if (seg == NULL || (seg->path = strdup(path)) == NULL) {
+        free(seg);
+        munmap(map, size);
+        return NULL;
+    }
+    seg->map = map;
+    seg->size = size;
+    atomic_init(&seg->refs, 1);
+    return seg;
+}
+
+// 다시 매핑한 세그먼트의 기록을 처음부터 확인하며 위치 색인을 만듦
+// 길이가 0 이거나 맞지 않는 기록, 번호가 이어지지 않는 기록에서 멈추고 그 자리부터 이어 씀
+void segment_scan(segment_t *seg) {
+    size_t off = 0;
+
+    while (seg->size - off >= REC_HDR + FRAME_HDR + 1) {
+        uint32_t rec_len, n;
+        uint64_t seq;
+        memcpy(&rec_len, seg->map + off, 4);
+        memcpy(&seq, seg->map + off + 4, 8);
+        memcpy(&n, seg->map + off + REC_HDR, FRAME_HDR);
+        n = ntohl(n);
+        if (rec_len > seg->size - off || n > MAX_MSG || rec_len != REC_HDR + FRAME_HDR + n + 1 ||
+            seq != seg->first_seq + seg->count)
+            break;
+        if (segment_index(seg, off) == -1) break;
+        off += rec_len;
+    }
+    seg->used = off;
+}
+
+// 기록 위치 색인 끝에 추가 (가득 차면 두 배로 늘림)
+int segment_index(segment_t *seg, uint32_t off) {
+    if (seg->count == seg->offs_cap) {
+        uint32_t cap = seg->offs_cap ? seg->offs_cap * 2 : 256;
+        uint32_t *p = realloc(seg->offs, cap * sizeof(uint32_t));
+        if (p == NULL) return -1;
+        seg->offs = p;
+        seg->offs_cap = cap;
+    }
+    seg->offs[seg->count++] = off;
+    return 0;
+}
+
+// 마지막 참조면 매핑 해제 (기록 목록에서 빠진 뒤에도 보내는 중인 대기열이 있으면 그때까지 남음)
+void segment_release(segment_t *seg) {
+    if (atomic_fetch_sub_explicit(&seg->refs, 1, memory_order_acq_rel) != 1) return;
+    munmap(seg->map, seg->size);
+    free(seg->offs);
+    free(seg->path);
+    free(seg);
 }
 
 // 오류 처리 함수
@@ -153,4 +1631,4 @@ void error_handling(char *message) {
     fputs(message, stderr);
     fputc('\n', stderr);
     exit(1);
-}
\ No newline at end of file
+}
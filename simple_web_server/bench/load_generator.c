@@ -0,0 +1,1049 @@
+// load_generator.c
+// 컴파일: gcc -O2 -Wall -pthread load_generator.c -o load_generator
+// 실행:   ./load_generator [-c 연결수] [-t 쓰레드수] [-d 초] [-p 포트] [--close] [-r POST비율]
+//         [-w 작업파일] [--suite] [-o 결과.json] [--compare 이전결과.json]
+//
+// simple_web_server 부하 측정 도구: 여러 연결을 동시에 열어 GET/POST(CGI) 요청을 섞어 보내고
+// 처리량(req/s)과 지연 시간 분포를 출력하며, JSON 으로 저장해 실행 결과끼리 비교할 수 있음
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+
+#define DEFAULT_PORT 8080
+#define DEFAULT_CONNECTIONS 100
+#define DEFAULT_DURATION 10      // 측정 시간 (초)
+#define DEFAULT_POST_RATIO 20    // 기본 작업의 POST 비율 (%)
+#define DEFAULT_BODY_SIZE 64     // 기본 작업의 POST 본문 크기 (바이트)
+#define DEFAULT_TIMEOUT 10       // 응답이 이 시간(초) 안에 끝나지 않으면 오류로 보고 다시 연결
+#define MAX_EVENTS 256
+#define MAX_SPECS 64             // 작업 파일의 최대 요청 종류 수
+#define READ_BUF_SIZE 16384
+#define HEAD_MAX 8192            // 응답 헤더 최대 크기
+#define TICK_USEC 100000         // 재연결/시간 초과 검사 주기
+#define HIST_SUB_BITS 5          // 2의 거듭제곱 구간마다 32개 하위 구간 (상대 오차 약 3%)
+#define HIST_MAX_BITS 40
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+
+// --- 도구 설정 (명령행 옵션으로 변경 가능) ---
+typedef struct {
+    char host[64];
+    int port;
+    int connections;
+    int threads;         // 0이면 CPU 코어 수
+    int duration;
+    int keep_alive;      // 0이면 요청마다 연결을 새로 맺음 (Connection: close)
+    int post_ratio;
+    char get_path[256];
+    char post_path[256];
+    int body_size;
+    int timeout;
+    const char *workload; // 작업 파일 (없으면 get_path/post_path 를 post_ratio 로 섞음)
+    const char *output;   // 결과 JSON 파일
+    const char *compare;  // 비교할 이전 결과 JSON 파일
+    const char *name;     // 결과에 붙일 실행 이름
+    int suite;            // 정해진 시나리오들을 차례로 실행
+} bench_config_t;
+
+bench_config_t config = { "127.0.0.1", DEFAULT_PORT, DEFAULT_CONNECTIONS, 0, DEFAULT_DURATION, 1,
+                          DEFAULT_POST_RATIO, "/index.html", "/cgi-bin/test_cgi?name=bench",
+                          DEFAULT_BODY_SIZE, DEFAULT_TIMEOUT, NULL, NULL, NULL, "custom", 0 };
+
+// --- 요청 종류 (작업 파일의 한 줄) ---
+// 보낼 요청 바이트는 실행마다 연결 방식(keep-alive/close)에 맞춰 미리 만들어 둠
+typedef struct {
+    char method[8];
+    char path[256];
+    char *body;
+    int weight;        // 선택 비중
+    char *raw;         // 직렬화된 요청
+    size_t raw_len;
+} request_spec_t;
+
+// --- 시나리오 (--suite 는 여러 개를 차례로 실행) ---
+typedef struct {
+    const char *name;
+    int keep_alive;
+    int post_ratio;    // -1 이면 작업 파일/옵션 그대로
+} scenario_t;
+
+// --- 지연 시간 히스토그램 (µs, 서버의 /server-stats 와 같은 로그-선형 구간) ---
+// 쓰레드마다 따로 기록하고 측정이 끝난 뒤에 합치므로 원자적 연산이 필요 없음
+typedef struct {
+    unsigned long long counts[HIST_BUCKETS];
+    unsigned long long total;
+    unsigned long long sum;
+    unsigned long long max;
+} histogram_t;
+
+// --- 측정 결과 (쓰레드별로 모은 뒤 합침) ---
+typedef struct {
+    histogram_t latency[MAX_SPECS]; // 요청 종류별
+    unsigned long long requests;    // 완료된 응답 수
+    unsigned long long errors;      // 연결 실패, 도중 끊김, 형식 오류
+    unsigned long long timeouts;
+    unsigned long long connects;
+    unsigned long long bytes_in;
+    unsigned long long bytes_out;
+    unsigned long long status[6];   // [상태 코드 / 100] (1xx 는 세지 않음)
+} bench_stats_t;
+
+// --- 응답 해석 상태 ---
+typedef enum {
+    RESP_HEAD,        // 헤더 끝("\r\n\r\n")을 찾는 중
+    RESP_BODY,        // Content-Length 만큼 본문
+    RESP_BODY_EOF,    // 길이 정보 없음: 연결 종료까지 본문
+    RESP_CHUNK_SIZE,  // chunk 크기 줄
+    RESP_CHUNK_DATA,  // chunk 내용 + 뒤의 CRLF
+    RESP_TRAILER      // 마지막 chunk 뒤의 트레일러 (빈 줄로 끝)
+} resp_state_t;
+
+typedef enum {
+    CLIENT_IDLE,       // 연결 없음 (다음 검사 주기에 연결)
+    CLIENT_CONNECTING,
+    CLIENT_WRITING,
+    CLIENT_READING
+} client_state_t;
+
+// --- 부하 연결 하나 ---
+typedef struct {
+    int fd;
+    client_state_t state;
+    int spec;              // 현재 요청의 종류
+    size_t req_off;        // 요청 중 보낸 바이트
+    uint64_t start;        // 지연 시간 측정 시작 (close 모드는 connect 시작부터)
+    uint64_t connect_start;
+
+    resp_state_t resp;
+    char head[HEAD_MAX];
+    size_t head_len;
+    char line[64];         // chunk 크기 줄 / 트레일러 줄
+    size_t line_len;
+    size_t body_left;
+    int status;
+    int resp_close;        // 서버가 Connection: close 로 응답함
+} client_t;
+
+typedef struct {
+    int id;
+    pthread_t tid;
+    int epfd;
+    client_t *clients;
+    int count;
+    unsigned long long rng; // 요청 종류 선택용 xorshift 상태
+    bench_stats_t *stats;
+} bench_thread_t;
+
+// 실행 중 공유 상태 (측정 시작 전에 정해지고 쓰레드들은 읽기만 함)
+request_spec_t specs[MAX_SPECS];
+int spec_count = 0;
+int total_weight = 0;
+struct sockaddr_in target;
+uint64_t deadline;
+int current_keep_alive;
+
+// --- 함수 원형 선언 ---
+void error_handling(char *message);
+void parse_options(int argc, char *argv[]);
+void print_usage(const char *prog);
+void load_workload(const char *path);
+void add_spec(const char *method, const char *path, const char *body, int weight);
+void build_requests(int keep_alive, int post_ratio);
+void raise_fd_limit(int needed);
+void run_scenario(const scenario_t *sc, bench_stats_t *total, double *elapsed);
+void *bench_thread(void *arg);
+void client_connect(bench_thread_t *t, client_t *c);
+void client_event(bench_thread_t *t, client_t *c, uint32_t events);
+void client_start_request(bench_thread_t *t, client_t *c);
+int client_write(bench_thread_t *t, client_t *c);
+int client_read(bench_thread_t *t, client_t *c);
+void client_complete(bench_thread_t *t, client_t *c);
+void client_fail(bench_thread_t *t, client_t *c);
+void client_close(client_t *c);
+int response_feed(client_t *c, const char *data, size_t len);
+int response_parse_head(client_t *c, size_t head_len);
+uint64_t now_usec(void);
+void hist_record(histogram_t *hist, uint64_t value);
+void hist_merge(histogram_t *dst, const histogram_t *src);
+uint64_t hist_percentile(const histogram_t *hist, double q);
+void stats_merge(bench_stats_t *dst, const bench_stats_t *src);
+void print_report(const char *name, const bench_stats_t *stats, double elapsed);
+void write_json_run(FILE *out, const char *name, int keep_alive, const bench_stats_t *stats, double elapsed);
+void write_json_latency(FILE *out, const histogram_t *hist);
+void write_json_string(FILE *out, const char *s);
+void compare_results(const char *path, const char *name, const bench_stats_t *stats, double elapsed);
+
+// --- main 함수 ---
+int main(int argc, char *argv[]) {
+    // 0. 명령행 옵션 처리 및 시그널 설정
+    parse_options(argc, argv);
+    signal(SIGPIPE, SIG_IGN); // 서버가 먼저 끊은 소켓에 write 해도 종료되지 않도록
+
+    // 1. 대상 주소와 작업 준비
+    memset(&target, 0, sizeof(target));
+    target.sin_family = AF_INET;
+    target.sin_port = htons(config.port);
+    if (inet_pton(AF_INET, config.host, &target.sin_addr) != 1)
+        error_handling("잘못된 대상 주소 (--host 는 IPv4 주소)");
+    if (config.workload)
+        load_workload(config.workload);
+    raise_fd_limit(config.connections + 64);
+
+    // 2. 시나리오 실행: --suite 는 keep-alive/close, 정적/CGI 조합을 차례로 측정
+    static const scenario_t suite[] = {
+        { "keepalive-get",   1, 0 },
+        { "close-get",       0, 0 },
+        { "keepalive-mixed", 1, DEFAULT_POST_RATIO },
+        { "keepalive-cgi",   1, 100 },
+    };
+    scenario_t single = { config.name, config.keep_alive, -1 };
+    const scenario_t *runs = config.suite ? suite : &single;
+    int run_count = config.suite ? (int)(sizeof(suite) / sizeof(suite[0])) : 1;
+
+    FILE *out = NULL;
+    if (config.output) {
+        out = fopen(config.output, "w");
+        if (out == NULL) {
+            perror("결과 파일 열기 오류");
+            exit(1);
+        }
+        char date[64];
+        time_t now = time(NULL);
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+        fprintf(out, "{\n  \"timestamp\": \"%s\",\n  \"target\": \"%s:%d\",\n  \"connections\": %d,\n"
+                     "  \"threads\": %d,\n  \"duration\": %d,\n  \"runs\": [",
+                date, config.host, config.port, config.connections, config.threads, config.duration);
+    }
+
+    for (int i = 0; i < run_count; i++) {
+        bench_stats_t *total = calloc(1, sizeof(bench_stats_t));
+        double elapsed;
+        if (total == NULL)
+            error_handling("결과 메모리 할당 오류");
+
+        run_scenario(&runs[i], total, &elapsed);
+        print_report(runs[i].name, total, elapsed);
+        if (config.compare)
+            compare_results(config.compare, runs[i].name, total, elapsed);
+        if (out) {
+            fprintf(out, "%s\n", i ? "," : "");
+            write_json_run(out, runs[i].name, runs[i].keep_alive, total, elapsed);
+        }
+        free(total);
+    }
+
+    if (out) {
+        fprintf(out, "\n  ]\n}\n");
+        fclose(out);
+        printf("\n결과 저장: %s\n", config.output);
+    }
+    return 0;
+}
+
+void print_usage(const char *prog) {
+    fprintf(stderr,
+            "사용법: %s [옵션]\n"
+            "      --host ADDR             대상 서버 IPv4 주소 (기본 127.0.0.1)\n"
+            "  -p, --port N                대상 포트 (기본 %d)\n"
+            "  -c, --connections N         동시 연결 수 (기본 %d)\n"
+            "  -t, --threads N             부하 쓰레드 수 (기본: CPU 코어 수)\n"
+            "  -d, --duration SEC          측정 시간 (기본 %d)\n"
+            "      --close                 요청마다 연결을 새로 맺음 (기본 keep-alive)\n"
+            "  -r, --post-ratio PCT        POST(CGI) 요청 비율 (기본 %d)\n"
+            "      --get PATH              GET 요청 경로 (기본 /index.html)\n"
+            "      --post PATH             POST 요청 경로 (기본 /cgi-bin/test_cgi?name=bench)\n"
+            "      --body-size N           POST 본문 크기 (기본 %d)\n"
+            "  -w, --workload FILE         작업 파일: 줄마다 \"[비중] 메소드 경로 [본문]\" (-r, --get, --post 대신)\n"
+            "      --timeout SEC           응답 제한 시간 (기본 %d)\n"
+            "      --suite                 keepalive-get, close-get, keepalive-mixed, keepalive-cgi 를 차례로 측정 (-w 와 함께 못 씀)\n"
+            "      --name NAME             결과에 붙일 실행 이름 (기본 custom)\n"
+            "  -o, --output FILE           결과를 JSON 으로 저장\n"
+            "      --compare FILE          이전 JSON 결과와 같은 이름의 실행끼리 비교\n",
+            prog, DEFAULT_PORT, DEFAULT_CONNECTIONS, DEFAULT_DURATION, DEFAULT_POST_RATIO,
+            DEFAULT_BODY_SIZE, DEFAULT_TIMEOUT);
+}
+
+void parse_options(int argc, char *argv[]) {
+    enum { OPT_HOST = 256, OPT_CLOSE, OPT_GET, OPT_POST, OPT_BODY_SIZE, OPT_TIMEOUT, OPT_SUITE, OPT_NAME,
+           OPT_COMPARE };
+    static const struct option long_options[] = {
+        { "host",        required_argument, NULL, OPT_HOST },
+        { "port",        required_argument, NULL, 'p' },
+        { "connections", required_argument, NULL, 'c' },
+        { "threads",     required_argument, NULL, 't' },
+        { "duration",    required_argument, NULL, 'd' },
+        { "close",       no_argument,       NULL, OPT_CLOSE },
+        { "post-ratio",  required_argument, NULL, 'r' },
+        { "get",         required_argument, NULL, OPT_GET },
+        { "post",        required_argument, NULL, OPT_POST },
+        { "body-size",   required_argument, NULL, OPT_BODY_SIZE },
+        { "workload",    required_argument, NULL, 'w' },
+        { "timeout",     required_argument, NULL, OPT_TIMEOUT },
+        { "suite",       no_argument,       NULL, OPT_SUITE },
+        { "name",        required_argument, NULL, OPT_NAME },
+        { "output",      required_argument, NULL, 'o' },
+        { "compare",     required_argument, NULL, OPT_COMPARE },
+        { "help",        no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int c;
+
+    while ((c = getopt_long(argc, argv, "p:c:t:d:r:w:o:h", long_options, NULL)) != -1) {
+        switch (c) {
+        case OPT_HOST:
+            snprintf(config.host, sizeof(config.host), "%s", optarg);
+            break;
+        case 'p':
+            config.port = atoi(optarg);
+            break;
+        case 'c':
+            config.connections = atoi(optarg);
+            break;
+        case 't':
+            config.threads = atoi(optarg);
+            break;
+        case 'd':
+            config.duration = atoi(optarg);
+            break;
+        case OPT_CLOSE:
+            config.keep_alive = 0;
+            break;
+        case 'r':
+            config.post_ratio = atoi(optarg);
+            break;
+        case OPT_GET:
+            snprintf(config.get_path, sizeof(config.get_path), "%s", optarg);
+            break;
+        case OPT_POST:
+            snprintf(config.post_path, sizeof(config.post_path), "%s", optarg);
+            break;
+        case OPT_BODY_SIZE:
+            config.body_size = atoi(optarg);
+            break;
+        case 'w':
+            config.workload = optarg;
+            break;
+        case OPT_TIMEOUT:
+            config.timeout = atoi(optarg);
+            break;
+        case OPT_SUITE:
+            config.suite = 1;
+            break;
+        case OPT_NAME:
+            config.name = optarg;
+            break;
+        case 'o':
+            config.output = optarg;
+            break;
+        case OPT_COMPARE:
+            config.compare = optarg;
+            break;
+        default:
+            print_usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    if (config.connections < 1) config.connections = 1;
+    if (config.duration < 1) config.duration = 1;
+    if (config.timeout < 1) config.timeout = 1;
+    if (config.body_size < 0) config.body_size = 0;
+    if (config.post_ratio < 0) config.post_ratio = 0;
+    if (config.post_ratio > 100) config.post_ratio = 100;
+
+    // --suite 의 실행 이름은 요청 구성을 뜻하고 --compare 는 이름으로 맞춰 보므로 작업 파일과 섞지 않음
+    // (작업 파일은 post_ratio 를 따르지 않아 keepalive-mixed, keepalive-cgi 가 이름과 다른 요청을 측정하게 됨)
+    if (config.suite && config.workload)
+        error_handling("--suite 와 -w 는 함께 쓸 수 없음 (작업 파일은 --name 으로 이름을 붙여 따로 측정)");
+
+    // 쓰레드 수가 지정되지 않으면 CPU 코어 수 (연결 수보다 많을 필요는 없음)
+    if (config.threads <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        config.threads = cores > 0 ? (int)cores : 1;
+    }
+    if (config.threads > config.connections)
+        config.threads = config.connections;
+}
+
+// 작업 파일 읽기: 줄마다 "[비중] 메소드 경로 [본문]" ('#' 으로 시작하는 줄과 빈 줄은 무시)
+// 예: "3 GET /index.html", "1 POST /cgi-bin/test_cgi?x=1 name=value"
+void load_workload(const char *path) {
+    FILE *fp = fopen(path, "r");
+    char line[1024];
+
+    if (fp == NULL) {
+        perror("작업 파일 열기 오류");
+        exit(1);
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        char *save;
+        char *tok = strtok_r(line, " \t\r\n", &save);
+        int weight = 1;
+
+        if (tok == NULL || tok[0] == '#') continue;
+        if (tok[0] >= '0' && tok[0] <= '9') {
+            weight = atoi(tok);
+            tok = strtok_r(NULL, " \t\r\n", &save);
+        }
+        char *uri = strtok_r(NULL, " \t\r\n", &save);
+        char *body = strtok_r(NULL, "\r\n", &save);
+        if (tok == NULL || uri == NULL || weight <= 0) {
+            fprintf(stderr, "작업 파일 형식 오류: %s\n", line);
+            continue;
+        }
+        add_spec(tok, uri, body, weight);
+    }
+    fclose(fp);
+    if (spec_count == 0)
+        error_handling("작업 파일에 요청이 없음");
+}
+
+void add_spec(const char *method, const char *path, const char *body, int weight) {
+    if (spec_count == MAX_SPECS)
+        error_handling("요청 종류가 너무 많음 (최대 64)");
+    request_spec_t *spec = &specs[spec_count++];
+    snprintf(spec->method, sizeof(spec->method), "%s", method);
+    snprintf(spec->path, sizeof(spec->path), "%s", path);
+    spec->body = body ? strdup(body) : NULL;
+    spec->weight = weight;
+    spec->raw = NULL;
+}
+
+// 실행마다 요청 바이트를 미리 직렬화 (보낼 때는 복사 없이 write 만)
+// post_ratio >= 0 이고 작업 파일이 없으면 기본 GET/POST 두 종류를 그 비율로 섞음
+void build_requests(int keep_alive, int post_ratio) {
+    if (!config.workload) {
+        for (int i = 0; i < spec_count; i++) {
+            free(specs[i].body);
+            free(specs[i].raw);
+        }
+        memset(specs, 0, sizeof(specs));
+        spec_count = 0;
+        int ratio = post_ratio >= 0 ? post_ratio : config.post_ratio;
+        char *body = malloc(config.body_size + 1);
+        if (body == NULL)
+            error_handling("본문 메모리 할당 오류");
+        memcpy(body, "data=", config.body_size < 5 ? config.body_size : 5);
+        for (int i = 5; i < config.body_size; i++)
+            body[i] = 'a' + i % 26;
+        body[config.body_size] = '\0';
+
+        if (ratio < 100)
+            add_spec("GET", config.get_path, NULL, 100 - ratio);
+        if (ratio > 0)
+            add_spec("POST", config.post_path, body, ratio);
+        free(body);
+    }
+
+    total_weight = 0;
+    for (int i = 0; i < spec_count; i++) {
+        request_spec_t *spec = &specs[i];
+        size_t body_len = spec->body ? strlen(spec->body) : 0;
+        size_t cap = strlen(spec->path) + body_len + 512;
+
+        free(spec->raw);
+        spec->raw = malloc(cap);
+        if (spec->raw == NULL)
+            error_handling("요청 메모리 할당 오류");
+        if (strcmp(spec->method, "POST") == 0 || body_len > 0) {
+            spec->raw_len = snprintf(spec->raw, cap,
+                                     "%s %s HTTP/1.1\r\nHost: %s:%d\r\n"
+                                     "Content-Type: application/x-www-form-urlencoded\r\n"
+                                     "Content-Length: %zu\r\nConnection: %s\r\n\r\n%s",
+                                     spec->method, spec->path, config.host, config.port, body_len,
+                                     keep_alive ? "keep-alive" : "close", spec->body ? spec->body : "");
+        } else {
+            spec->raw_len = snprintf(spec->raw, cap, "%s %s HTTP/1.1\r\nHost: %s:%d\r\nConnection: %s\r\n\r\n",
+                                     spec->method, spec->path, config.host, config.port,
+                                     keep_alive ? "keep-alive" : "close");
+        }
+        total_weight += spec->weight;
+    }
+}
+
+// 연결 수만큼 fd 를 쓸 수 있도록 소프트 한도를 올림 (하드 한도까지)
+void raise_fd_limit(int needed) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == -1 || rl.rlim_cur >= (rlim_t)needed)
+        return;
+    rl.rlim_cur = rl.rlim_max == RLIM_INFINITY || rl.rlim_max >= (rlim_t)needed ? (rlim_t)needed : rl.rlim_max;
+    if (setrlimit(RLIMIT_NOFILE, &rl) == -1 || rl.rlim_cur < (rlim_t)needed)
+        fprintf(stderr, "경고: 열 수 있는 fd 가 %lu 개로 제한됨 (ulimit -n 확인)\n", (unsigned long)rl.rlim_cur);
+}
+
+// 시나리오 하나 실행: 쓰레드마다 연결을 나눠 맡아 측정 시간 동안 요청을 반복
+void run_scenario(const scenario_t *sc, bench_stats_t *total, double *elapsed) {
+    // 1. 요청 준비
+    build_requests(sc->keep_alive, sc->post_ratio);
+    current_keep_alive = sc->keep_alive;
+
+    printf("\n[%s] %s:%d, 연결 %d개, 쓰레드 %d개, %d초, %s\n", sc->name, config.host, config.port,
+           config.connections, config.threads, config.duration,
+           sc->keep_alive ? "keep-alive" : "요청마다 연결");
+    for (int i = 0; i < spec_count; i++)
+        printf("  %3d%%  %s %s\n", specs[i].weight * 100 / total_weight, specs[i].method, specs[i].path);
+
+    // 2. 쓰레드 생성: 연결을 고르게 나눔
+    bench_thread_t *threads = calloc(config.threads, sizeof(bench_thread_t));
+    if (threads == NULL)
+        error_handling("쓰레드 메모리 할당 오류");
+
+    uint64_t start = now_usec();
+    deadline = start + (uint64_t)config.duration * 1000000;
+    for (int i = 0; i < config.threads; i++) {
+        bench_thread_t *t = &threads[i];
+        t->id = i;
+        t->count = config.connections / config.threads + (i < config.connections % config.threads);
+        t->clients = calloc(t->count, sizeof(client_t));
+        t->stats = calloc(1, sizeof(bench_stats_t));
+        t->rng = 0x9e3779b97f4a7c15ULL * (i + 1);
+        t->epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (t->clients == NULL || t->stats == NULL || t->epfd == -1)
+            error_handling("쓰레드 준비 오류");
+        if (pthread_create(&t->tid, NULL, bench_thread, t) != 0)
+            error_handling("pthread_create() 오류");
+    }
+
+    // 3. 종료를 기다려 결과 합치기
+    for (int i = 0; i < config.threads; i++) {
+        pthread_join(threads[i].tid, NULL);
+        stats_merge(total, threads[i].stats);
+        close(threads[i].epfd);
+        free(threads[i].clients);
+        free(threads[i].stats);
+    }
+    *elapsed = (now_usec() - start) / 1e6;
+    if (*elapsed > config.duration) *elapsed = config.duration; // 마감 뒤 정리 시간은 빼고 계산
+    free(threads);
+}
+
+// 부하 쓰레드: 맡은 연결들을 epoll 로 돌리며 응답이 끝나는 대로 다음 요청을 보냄
+void *bench_thread(void *arg) {
+    bench_thread_t *t = arg;
+    struct epoll_event events[MAX_EVENTS];
+    uint64_t next_tick = 0;
+
+    for (int i = 0; i < t->count; i++) {
+        t->clients[i].fd = -1;
+        client_connect(t, &t->clients[i]);
+    }
+
+    while (1) {
+        int n = epoll_wait(t->epfd, events, MAX_EVENTS, TICK_USEC / 1000);
+        if (n == -1 && errno != EINTR) {
+            perror("epoll_wait() 오류");
+            break;
+        }
+        for (int i = 0; i < n; i++)
+            client_event(t, events[i].data.ptr, events[i].events);
+
+        // 측정 시간이 끝나면 진행 중인 요청은 세지 않고 종료
+        uint64_t now = now_usec();
+        if (now >= deadline)
+            break;
+
+        // 주기적으로: 끊긴 연결 다시 맺기, 응답이 너무 늦는 연결 끊기
+        if (now >= next_tick) {
+            next_tick = now + TICK_USEC;
+            for (int i = 0; i < t->count; i++) {
+                client_t *c = &t->clients[i];
+                if (c->state == CLIENT_IDLE) {
+                    client_connect(t, c);
+                } else if (now - c->start > (uint64_t)config.timeout * 1000000) {
+                    t->stats->timeouts++;
+                    client_close(c);
+                    client_connect(t, c);
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < t->count; i++)
+        client_close(&t->clients[i]);
+    return NULL;
+}
+
+// 논블로킹 연결 시작 (완료는 EPOLLOUT 으로 알림, 실패하면 다음 검사 주기에 재시도)
+void client_connect(bench_thread_t *t, client_t *c) {
+    c->state = CLIENT_IDLE;
+    c->connect_start = c->start = now_usec();
+
+    c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (c->fd == -1) {
+        t->stats->errors++;
+        return;
+    }
+    int one = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+    ev.data.ptr = c;
+    if (epoll_ctl(t->epfd, EPOLL_CTL_ADD, c->fd, &ev) == -1 ||
+        (connect(c->fd, (struct sockaddr *)&target, sizeof(target)) == -1 && errno != EINPROGRESS)) {
+        t->stats->errors++;
+        client_close(c);
+        return;
+    }
+    t->stats->connects++;
+    c->state = CLIENT_CONNECTING;
+}
+
+void client_event(bench_thread_t *t, client_t *c, uint32_t events) {
+    // 1. 연결 완료 확인
+    if (c->state == CLIENT_CONNECTING) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1 || err != 0) {
+            client_fail(t, c);
+            return;
+        }
+        if (!(events & EPOLLOUT)) return;
+        client_start_request(t, c);
+        return;
+    }
+
+    // 2. 요청 전송 이어서 하기 / 응답 읽기
+    if (c->state == CLIENT_WRITING && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+        if (client_write(t, c) == -1)
+            client_fail(t, c);
+    } else if (c->state == CLIENT_READING && (events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+        if (client_read(t, c) == -1)
+            client_fail(t, c);
+    }
+}
+
+// 다음 요청 선택 후 전송 시작 (keep-alive 모드는 지금부터, close 모드는 connect 부터 측정)
+void client_start_request(bench_thread_t *t, client_t *c) {
+    t->rng ^= t->rng << 13;
+    t->rng ^= t->rng >> 7;
+    t->rng ^= t->rng << 17;
+
+    int pick = (int)(t->rng % total_weight);
+    c->spec = 0;
+    while (pick >= specs[c->spec].weight) {
+        pick -= specs[c->spec].weight;
+        c->spec++;
+    }
+    c->start = current_keep_alive ? now_usec() : c->connect_start;
+    c->req_off = 0;
+    c->resp = RESP_HEAD;
+    c->head_len = 0;
+    c->resp_close = 0;
+    c->state = CLIENT_WRITING;
+    if (client_write(t, c) == -1)
+        client_fail(t, c);
+}
+
+// 요청 전송 (소켓 버퍼가 가득 차면 다음 EPOLLOUT 에서 이어서). 반환값 -1: 오류
+int client_write(bench_thread_t *t, client_t *c) {
+    request_spec_t *spec = &specs[c->spec];
+
+    while (c->req_off < spec->raw_len) {
+        ssize_t n = write(c->fd, spec->raw + c->req_off, spec->raw_len - c->req_off);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -1;
+        }
+        c->req_off += n;
+        t->stats->bytes_out += n;
+    }
+    c->state = CLIENT_READING;
+    return 0;
+}
+
+// 응답 읽기: 엣지 트리거이므로 EAGAIN 까지 읽으며 해석. 반환값 -1: 오류
+int client_read(bench_thread_t *t, client_t *c) {
+    char buf[READ_BUF_SIZE];
+
+    while (c->state == CLIENT_READING) {
+        ssize_t n = read(c->fd, buf, sizeof(buf));
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -1;
+        }
+        if (n == 0) {
+            // 길이 정보 없는 본문은 연결 종료가 끝. 그 외에는 응답 도중 끊김
+            if (c->resp != RESP_BODY_EOF) return -1;
+            c->resp_close = 1;
+            client_complete(t, c);
+            return 0;
+        }
+        t->stats->bytes_in += n;
+
+        int r = response_feed(c, buf, n);
+        if (r == -1) return -1;
+        if (r == 1)
+            client_complete(t, c);
+    }
+    return 0;
+}
+
+// 응답 완료: 기록 후 같은 연결로 다음 요청, 또는 연결을 새로 맺음
+void client_complete(bench_thread_t *t, client_t *c) {
+    uint64_t now = now_usec();
+
+    if (now < deadline) {
+        t->stats->requests++;
+        if (c->status >= 100 && c->status < 600)
+            t->stats->status[c->status / 100]++;
+        hist_record(&t->stats->latency[c->spec], now - c->start);
+    }
+
+    if (!current_keep_alive || c->resp_close) {
+        client_close(c);
+        client_connect(t, c);
+    } else {
+        client_start_request(t, c);
+    }
+}
+
+void client_fail(bench_thread_t *t, client_t *c) {
+    if (now_usec() < deadline)
+        t->stats->errors++;
+    client_close(c);
+}
+
+void client_close(client_t *c) {
+    if (c->fd != -1)
+        close(c->fd); // epoll 등록도 함께 해제됨
+    c->fd = -1;
+    c->state = CLIENT_IDLE;
+}
+
+// 응답 바이트 해석 (읽기 경계가 어디든 이어서 처리)
+// 반환값: 1 응답 완료, 0 더 필요, -1 형식 오류 (요청은 한 번에 하나뿐이므로 완료 뒤에 남는 바이트는 없음)
+int response_feed(client_t *c, const char *data, size_t len) {
+    size_t pos = 0;
+
+    while (pos < len) {
+        switch (c->resp) {
+        case RESP_HEAD: {
+            // 1. 헤더를 모아 빈 줄 찾기 (앞서 받은 부분과 이어진 경우를 위해 3바이트 앞부터 탐색)
+            size_t n = len - pos;
+            size_t old = c->head_len;
+            if (n > sizeof(c->head) - 1 - old) n = sizeof(c->head) - 1 - old;
+            if (n == 0) return -1; // 헤더가 너무 큼
+            memcpy(c->head + old, data + pos, n);
+            c->head_len += n;
+            c->head[c->head_len] = '\0';
+
+            char *end = strstr(c->head + (old > 3 ? old - 3 : 0), "\r\n\r\n");
+            if (end == NULL) {
+                pos += n;
+                break;
+            }
+            size_t head_len = end + 4 - c->head;
+            pos += head_len - old;
+            c->head_len = 0;
+            if (response_parse_head(c, head_len) == -1) return -1;
+            if (c->resp == RESP_BODY && c->body_left == 0) {
+                return 1;
+            }
+            break;
+        }
+        case RESP_BODY:
+        case RESP_CHUNK_DATA: {
+            // 2. 본문은 세기만 하고 버림 (chunk 는 뒤의 CRLF 포함)
+            size_t n = len - pos < c->body_left ? len - pos : c->body_left;
+            pos += n;
+            c->body_left -= n;
+            if (c->body_left == 0) {
+                if (c->resp == RESP_BODY) {
+                    return 1;
+                }
+                c->resp = RESP_CHUNK_SIZE;
+            }
+            break;
+        }
+        case RESP_BODY_EOF:
+            pos = len;
+            break;
+        case RESP_CHUNK_SIZE:
+        case RESP_TRAILER: {
+            // 3. 한 줄씩: chunk 크기 (0이면 트레일러로), 트레일러는 빈 줄에서 응답 끝
+            char ch = data[pos++];
+            if (ch != '\n') {
+                if (c->line_len == sizeof(c->line) - 1) return -1;
+                c->line[c->line_len++] = ch;
+                break;
+            }
+            c->line[c->line_len] = '\0';
+            if (c->line_len > 0 && c->line[c->line_len - 1] == '\r')
+                c->line[--c->line_len] = '\0';
+            size_t line_len = c->line_len;
+            c->line_len = 0;
+
+            if (c->resp == RESP_TRAILER) {
+                if (line_len == 0) {
+                    return 1;
+                }
+                break;
+            }
+            char *endp;
+            unsigned long size = strtoul(c->line, &endp, 16);
+            if (endp == c->line) return -1;
+            if (size == 0) {
+                c->resp = RESP_TRAILER;
+            } else {
+                c->resp = RESP_CHUNK_DATA;
+                c->body_left = size + 2;
+            }
+            break;
+        }
+        }
+    }
+    return 0;
+}
+
+// 상태 줄과 본문 길이 관련 헤더 해석 (1xx 중간 응답은 건너뛰고 다음 헤더를 기다림)
+int response_parse_head(client_t *c, size_t head_len) {
+    char *save;
+    int chunked = 0, has_length = 0;
+
+    c->head[head_len] = '\0';
+    if (strncmp(c->head, "HTTP/1.", 7) != 0 || head_len < 12)
+        return -1;
+    c->status = atoi(c->head + 9);
+    if (c->status >= 100 && c->status < 200) {
+        c->resp = RESP_HEAD;
+        return 0;
+    }
+
+    c->body_left = 0;
+    strtok_r(c->head, "\r\n", &save); // 상태 줄
+    for (char *line = strtok_r(NULL, "\r\n", &save); line; line = strtok_r(NULL, "\r\n", &save)) {
+        char *colon = strchr(line, ':');
+        if (colon == NULL) continue;
+        *colon = '\0';
+        char *value = colon + 1;
+        while (*value == ' ' || *value == '\t') value++;
+
+        if (strcasecmp(line, "Content-Length") == 0) {
+            c->body_left = strtoull(value, NULL, 10);
+            has_length = 1;
+        } else if (strcasecmp(line, "Transfer-Encoding") == 0 && strcasestr(value, "chunked")) {
+            chunked = 1;
+        } else if (strcasecmp(line, "Connection") == 0 && strcasestr(value, "close")) {
+            c->resp_close = 1;
+        }
+    }
+
+    // 304, 204 와 HEAD 요청의 응답은 Content-Length 가 있어도 본문 없음
+    c->line_len = 0;
+    if (c->status == 304 || c->status == 204 || strcmp(specs[c->spec].method, "HEAD") == 0) {
+        c->resp = RESP_BODY;
+        c->body_left = 0;
+    } else if (chunked) {
+        c->resp = RESP_CHUNK_SIZE;
+    } else if (has_length) {
+        c->resp = RESP_BODY;
+    } else {
+        c->resp = RESP_BODY_EOF;
+    }
+    return 0;
+}
+
+uint64_t now_usec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// 값(µs)을 로그-선형 구간에 기록: 32 미만은 그대로, 그 이상은 최상위 비트 위치와 다음 5비트로 구간 결정
+void hist_record(histogram_t *hist, uint64_t value) {
+    uint64_t v = value < (1ULL << HIST_MAX_BITS) ? value : (1ULL << HIST_MAX_BITS) - 1;
+    int idx = (int)v;
+
+    if (v >= (1 << HIST_SUB_BITS)) {
+        int msb = 63 - __builtin_clzll(v);
+        int shift = msb - HIST_SUB_BITS;
+        idx = ((shift + 1) << HIST_SUB_BITS) + (int)((v >> shift) & ((1 << HIST_SUB_BITS) - 1));
+    }
+    hist->counts[idx]++;
+    hist->total++;
+    hist->sum += value;
+    if (value > hist->max)
+        hist->max = value;
+}
+
+void hist_merge(histogram_t *dst, const histogram_t *src) {
+    for (int i = 0; i < HIST_BUCKETS; i++)
+        dst->counts[i] += src->counts[i];
+    dst->total += src->total;
+    dst->sum += src->sum;
+    if (src->max > dst->max)
+        dst->max = src->max;
+}
+
+// 누적 비율 q 에 해당하는 값: 그 구간이 나타내는 값의 상한 (최댓값을 넘지 않음)
+uint64_t hist_percentile(const histogram_t *hist, double q) {
+    unsigned long long rank = (unsigned long long)(q * hist->total + 0.5), seen = 0;
+
+    if (hist->total == 0) return 0;
+    if (rank == 0) rank = 1;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += hist->counts[i];
+        if (seen < rank) continue;
+        if (i < (1 << HIST_SUB_BITS)) return i;
+        int shift = (i >> HIST_SUB_BITS) - 1;
+        uint64_t lower = (uint64_t)((i & ((1 << HIST_SUB_BITS) - 1)) | (1 << HIST_SUB_BITS)) << shift;
+        uint64_t upper = lower + (1ULL << shift) - 1;
+        return upper < hist->max ? upper : hist->max;
+    }
+    return hist->max;
+}
+
+void stats_merge(bench_stats_t *dst, const bench_stats_t *src) {
+    for (int i = 0; i < spec_count; i++)
+        hist_merge(&dst->latency[i], &src->latency[i]);
+    dst->requests += src->requests;
+    dst->errors += src->errors;
+    dst->timeouts += src->timeouts;
+    dst->connects += src->connects;
+    dst->bytes_in += src->bytes_in;
+    dst->bytes_out += src->bytes_out;
+    for (int i = 0; i < 6; i++)
+        dst->status[i] += src->status[i];
+}
+
+void print_report(const char *name, const bench_stats_t *stats, double elapsed) {
+    histogram_t all = { 0 };
+
+    printf("[%s] 요청 %llu개, %.2f초, %.1f req/s, 수신 %.2f MB/s\n", name, stats->requests, elapsed,
+           stats->requests / elapsed, stats->bytes_in / elapsed / (1024 * 1024));
+    printf("  상태 코드: 2xx %llu, 3xx %llu, 4xx %llu, 5xx %llu / 오류 %llu, 시간 초과 %llu, 연결 %llu회\n",
+           stats->status[2], stats->status[3], stats->status[4], stats->status[5], stats->errors,
+           stats->timeouts, stats->connects);
+    printf("  지연 시간 (us)                     count      mean       p50       p90       p99      p999       max\n");
+    for (int i = 0; i <= spec_count; i++) {
+        const histogram_t *h = &all;
+        if (i < spec_count) {
+            h = &stats->latency[i];
+            hist_merge(&all, h);
+            printf("  %-6s %-25.25s", specs[i].method, specs[i].path);
+        } else {
+            printf("  %-32s", "all");
+        }
+        printf(" %9llu %9llu %9llu %9llu %9llu %9llu %9llu\n", h->total,
+               h->total ? h->sum / h->total : 0, (unsigned long long)hist_percentile(h, 0.5),
+               (unsigned long long)hist_percentile(h, 0.9), (unsigned long long)hist_percentile(h, 0.99),
+               (unsigned long long)hist_percentile(h, 0.999), h->max);
+    }
+}
+
+// 실행 하나를 JSON 객체로 기록 ("runs" 배열의 원소)
+void write_json_run(FILE *out, const char *name, int keep_alive, const bench_stats_t *stats, double elapsed) {
+    histogram_t all = { 0 };
+
+    for (int i = 0; i < spec_count; i++)
+        hist_merge(&all, &stats->latency[i]);
+
+    fprintf(out, "    {\n      \"name\": ");
+    write_json_string(out, name);
+    fprintf(out, ",\n      \"keep_alive\": %s,\n      \"elapsed\": %.3f,\n      \"requests\": %llu,\n"
+                 "      \"rps\": %.1f,\n      \"errors\": %llu,\n      \"timeouts\": %llu,\n"
+                 "      \"connects\": %llu,\n      \"bytes_in\": %llu,\n      \"bytes_out\": %llu,\n"
+                 "      \"status\": { \"2xx\": %llu, \"3xx\": %llu, \"4xx\": %llu, \"5xx\": %llu },\n"
+                 "      \"latency_us\": ",
+            keep_alive ? "true" : "false", elapsed, stats->requests, stats->requests / elapsed, stats->errors,
+            stats->timeouts, stats->connects, stats->bytes_in, stats->bytes_out, stats->status[2],
+            stats->status[3], stats->status[4], stats->status[5]);
+    write_json_latency(out, &all);
+    fprintf(out, ",\n      \"workload\": [");
+    for (int i = 0; i < spec_count; i++) {
+        fprintf(out, "%s\n        { \"method\": ", i ? "," : "");
+        write_json_string(out, specs[i].method);
+        fprintf(out, ", \"path\": ");
+        write_json_string(out, specs[i].path);
+        fprintf(out, ", \"weight\": %d, \"latency_us\": ", specs[i].weight);
+        write_json_latency(out, &stats->latency[i]);
+        fprintf(out, " }");
+    }
+    fprintf(out, "\n      ]\n    }");
+}
+
+void write_json_latency(FILE *out, const histogram_t *hist) {
+    fprintf(out, "{ \"count\": %llu, \"mean\": %llu, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, "
+                 "\"p999\": %llu, \"max\": %llu }",
+            hist->total, hist->total ? hist->sum / hist->total : 0, (unsigned long long)hist_percentile(hist, 0.5),
+            (unsigned long long)hist_percentile(hist, 0.9), (unsigned long long)hist_percentile(hist, 0.99),
+            (unsigned long long)hist_percentile(hist, 0.999), hist->max);
+}
+
+void write_json_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fputc('\\', out);
+        if ((unsigned char)*s < 0x20)
+            fprintf(out, "\\u%04x", *s);
+        else
+            fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+// 이전 결과 파일에서 같은 이름의 실행을 찾아 처리량과 p50/p99 변화를 출력
+// (이 도구가 쓴 형식만 읽음: 실행마다 "name" 다음에 "rps", 그 다음 전체 "latency_us" 가 옴)
+void compare_results(const char *path, const char *name, const bench_stats_t *stats, double elapsed) {
+    FILE *fp = fopen(path, "r");
+    char *text = NULL;
+    size_t cap = 0;
+    histogram_t all = { 0 };
+
+    if (fp == NULL) {
+        perror("비교 파일 열기 오류");
+        return;
+    }
+    ssize_t len = getdelim(&text, &cap, '\0', fp);
+    fclose(fp);
+    if (len <= 0) {
+        free(text);
+        return;
+    }
+
+    char key[300];
+    snprintf(key, sizeof(key), "\"name\": \"%s\"", name);
+    char *run = strstr(text, key);
+    char *rps = run ? strstr(run, "\"rps\": ") : NULL;
+    char *lat = run ? strstr(run, "\"latency_us\": ") : NULL;
+    char *p50 = lat ? strstr(lat, "\"p50\": ") : NULL;
+    char *p99 = lat ? strstr(lat, "\"p99\": ") : NULL;
+    if (rps == NULL || p50 == NULL || p99 == NULL) {
+        printf("  비교: %s 에 '%s' 실행 결과 없음\n", path, name);
+        free(text);
+        return;
+    }
+
+    for (int i = 0; i < spec_count; i++)
+        hist_merge(&all, &stats->latency[i]);
+    double old_rps = atof(rps + 7), new_rps = stats->requests / elapsed;
+    double old_p50 = atof(p50 + 7), new_p50 = hist_percentile(&all, 0.5);
+    double old_p99 = atof(p99 + 7), new_p99 = hist_percentile(&all, 0.99);
+    printf("  비교 (%s): req/s %.1f -> %.1f (%+.1f%%), p50 %.0f -> %.0f us, p99 %.0f -> %.0f us (%+.1f%%)\n",
+           path, old_rps, new_rps, old_rps > 0 ? (new_rps - old_rps) * 100 / old_rps : 0.0, old_p50, new_p50,
+           old_p99, new_p99, old_p99 > 0 ? (new_p99 - old_p99) * 100 / old_p99 : 0.0);
+    free(text);
+}
+
+void error_handling(char *message) {
+    fputs(message, stderr);
+    fputc('\n', stderr);
+    exit(1);
+}
@@ -0,0 +1,134 @@
+// pipeline_test.c
+// 컴파일: gcc -O2 -Wall pipeline_test.c -o pipeline_test
+// 실행:   ./pipeline_test [-p 포트]    (simple_web_server 를 먼저 실행, 실패가 있으면 종료 코드 1)
+//
+// keep-alive 연결의 요청 경계 검사: 한 연결에 요청 여러 개를 이어 보내고 돌아온 응답 수와 상태를 확인
+// 본문 길이가 모호한 요청 (Transfer-Encoding, 겹치는 Content-Length) 은 오류 하나만 받고 연결이 닫혀야 하며,
+// 본문 안에 숨긴 요청이 따로 처리되면 (응답이 두 개 오면) 실패
+// (-m blocking 서버는 요청마다 연결을 닫으므로 이어 보낸 GET 두 개 중 하나만 응답함)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#define SERVER_IP "127.0.0.1"
+#define DEFAULT_PORT 8080
+#define READ_TIMEOUT_MS 3000 // 연결이 이 시간 안에 닫히지 않으면 실패
+#define RESP_MAX 65536
+
+// 검사 하나: 한 번에 보낼 요청 바이트와 기대하는 응답 수, 첫 응답 상태
+typedef struct {
+    const char *name;
+    const char *request;
+    int responses;
+    const char *status;
+} pipeline_case_t;
+
+// 본문에 숨긴 요청 (본문 경계를 잘못 잡으면 이 요청의 응답이 따로 옴)
+#define SMUGGLED "GET /server-stats HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n"
+
+pipeline_case_t cases[] = {
+    { "GET 두 개 이어 보내기",
+      "GET /index.html HTTP/1.1\r\nHost: x\r\n\r\n"
+      "GET /index.html HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n",
+      2, "200" },
+    { "chunked POST 본문에 숨긴 요청",
+      "POST /cgi-bin/test_cgi HTTP/1.1\r\nHost: x\r\nTransfer-Encoding: chunked\r\n\r\n"
+      "3a\r\n" SMUGGLED "\r\n0\r\n\r\n",
+      1, "501" },
+    { "CGI 로 보내는 chunked 업로드 (빈 표준 입력으로 실행하지 않음)",
+      "POST /cgi-bin/test_cgi HTTP/1.1\r\nHost: x\r\nExpect: 100-continue\r\nTransfer-Encoding: chunked\r\n\r\n"
+      "b\r\nname=upload\r\n0\r\n\r\n",
+      1, "501" },
+    { "Transfer-Encoding 과 Content-Length 함께",
+      "POST /cgi-bin/test_cgi HTTP/1.1\r\nHost: x\r\nContent-Length: 4\r\nTransfer-Encoding: chunked\r\n\r\n"
+      "0\r\n\r\n" SMUGGLED,
+      1, "400" },
+    { "Content-Length 두 번",
+      "POST /cgi-bin/test_cgi HTTP/1.1\r\nHost: x\r\nContent-Length: 0\r\nContent-Length: 0\r\n\r\n" SMUGGLED,
+      1, "400" },
+    { "쉼표로 이어 붙인 Content-Length",
+      "POST /cgi-bin/test_cgi HTTP/1.1\r\nHost: x\r\nContent-Length: 0, 0\r\n\r\n" SMUGGLED,
+      1, "400" },
+    { "Transfer-Encoding: identity 는 본문 없음으로 처리",
+      "GET /index.html HTTP/1.1\r\nHost: x\r\nTransfer-Encoding: identity\r\nConnection: close\r\n\r\n",
+      1, "200" },
+};
+
+int run_case(int port, const pipeline_case_t *tc);
+void error_handling(char *message);
+
+int main(int argc, char *argv[]) {
+    int port = DEFAULT_PORT;
+    int opt, failed = 0;
+    int count = sizeof(cases) / sizeof(cases[0]);
+
+    while ((opt = getopt(argc, argv, "p:")) != -1) {
+        if (opt != 'p') {
+            fprintf(stderr, "사용법: %s [-p 포트]\n", argv[0]);
+            exit(1);
+        }
+        port = atoi(optarg);
+    }
+
+    for (int i = 0; i < count; i++)
+        failed += run_case(port, &cases[i]) == -1;
+    printf("%d개 중 %d개 통과\n", count, count - failed);
+    return failed ? 1 : 0;
+}
+
+// 요청을 한 번에 보내고 서버가 연결을 닫을 때까지 받은 응답을 셈 (상태 줄 "HTTP/1.x " 개수)
+// 반환값: 통과 0, 실패 -1
+int run_case(int port, const pipeline_case_t *tc) {
+    struct sockaddr_in serv_addr;
+    static char resp[RESP_MAX + 1];
+    size_t len = 0;
+    int closed = 0;
+
+    int sock = socket(PF_INET, SOCK_STREAM, 0);
+    if (sock == -1)
+        error_handling("socket() error");
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_addr.s_addr = inet_addr(SERVER_IP);
+    serv_addr.sin_port = htons(port);
+    if (connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) == -1)
+        error_handling("connect() error");
+    if (write(sock, tc->request, strlen(tc->request)) != (ssize_t)strlen(tc->request))
+        error_handling("write() error");
+
+    // 1. 연결이 닫히거나 제한 시간까지 수신
+    struct pollfd pfd = { sock, POLLIN, 0 };
+    while (len < RESP_MAX && poll(&pfd, 1, READ_TIMEOUT_MS) > 0) {
+        ssize_t n = read(sock, resp + len, RESP_MAX - len);
+        if (n <= 0) {
+            closed = 1;
+            break;
+        }
+        len += n;
+    }
+    close(sock);
+    resp[len] = '\0';
+
+    // 2. 응답 수와 첫 상태 확인 (상태 줄은 맨 앞이나 앞 응답 본문 바로 뒤에 옴)
+    int responses = 0;
+    for (char *p = resp; (p = strstr(p, "HTTP/1.")) != NULL; p++) {
+        if ((p == resp || p[-1] == '\n' || p[-1] == '>') && p[8] == ' ')
+            responses++;
+    }
+    int status_ok = len >= 12 && strncmp(resp + 9, tc->status, 3) == 0;
+    int ok = closed && responses == tc->responses && status_ok;
+
+    printf("[%s] %s: 응답 %d개 (기대 %d), 첫 상태 %.3s (기대 %s)%s\n", ok ? "통과" : "실패", tc->name, responses,
+           tc->responses, len >= 12 ? resp + 9 : "-", tc->status, closed ? "" : ", 연결이 닫히지 않음");
+    return ok ? 0 : -1;
+}
+
+void error_handling(char *message) {
+    fputs(message, stderr);
+    fputc('\n', stderr);
+    exit(1);
+}
@@ -1,20 +1,241 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// --- FastCGI 형식 레코드 (웹 서버의 상주 워커 풀과 주고받는 프레임) ---
+#define FCGI_VERSION_1 1
+#define FCGI_BEGIN_REQUEST 1
+#define FCGI_END_REQUEST 3
+#define FCGI_PARAMS 4
+#define FCGI_STDIN 5
+#define FCGI_STDOUT 6
+#define FCGI_MAX_CONTENT 65535
+
+#define BODY_PREVIEW 1024 // 응답에 보여줄 본문 앞부분 크기
+
+void render_page(FILE *out, const char *query_string, const char *body, size_t body_total);
+void html_escape(FILE *out, const char *data, size_t len);
+int run_worker(void);
+int read_full(int fd, void *data, size_t len);
+int write_full(int fd, const void *data, size_t len);
+int write_record(int type, int id, const void *data, size_t len);
+char *get_param(const unsigned char *params, size_t len, const char *name);
 
 int main() {
+    // 서버가 상주 워커로 실행한 경우: fd 0 의 소켓으로 요청을 반복 처리
+    if (getenv("FCGI_WORKER"))
+        return run_worker();
+
     char *query_string = getenv("QUERY_STRING");
+    char *content_length = getenv("CONTENT_LENGTH");
+    size_t body_left = content_length ? strtoul(content_length, NULL, 10) : 0;
+    char preview[BODY_PREVIEW];
+    size_t preview_len = 0, body_total = 0;
+
+    // POST 본문은 표준 입력으로 CONTENT_LENGTH 만큼 들어옴: 앞부분만 보관하고 나머지는 세기만 함
+    while (body_left > 0) {
+        char buf[8192];
+        ssize_t n = read(STDIN_FILENO, buf, body_left < sizeof(buf) ? body_left : sizeof(buf));
+        if (n <= 0) break;
+        if (preview_len < sizeof(preview)) {
+            size_t keep = sizeof(preview) - preview_len < (size_t)n ? sizeof(preview) - preview_len : (size_t)n;
+            memcpy(preview + preview_len, buf, keep);
+            preview_len += keep;
+        }
+        body_total += n;
+        body_left -= n;
+    }
 
     printf("Content-type: text/html\r\n\r\n"); // CGI 헤더 (중요)
-    printf("<html><head><title>CGI Test Result</title></head><body>");
-    printf("<h1>CGI POST Request Received</h1>");
-    
-    if (query_string) {
-        printf("<p>Query String (POST Data): <strong>%s</strong></p>", query_string);
+    render_page(stdout, query_string, preview, body_total);
+
+    return 0;
+}
+
+// 응답 본문 생성 (일회성 CGI와 상주 워커가 공유)
+void render_page(FILE *out, const char *query_string, const char *body, size_t body_total) {
+    size_t shown = body_total < BODY_PREVIEW ? body_total : BODY_PREVIEW;
+
+    fprintf(out, "<html><head><title>CGI Test Result</title></head><body>");
+    fprintf(out, "<h1>CGI POST Request Received</h1>");
+
+    if (query_string && *query_string) {
+        fprintf(out, "<p>Query String: <strong>%s</strong></p>", query_string);
     } else {
-        printf("<p>No Query String Received.</p>");
+        fprintf(out, "<p>No Query String Received.</p>");
     }
-    
-    printf("</body></html>");
-    
+
+    fprintf(out, "<p>POST Data (%zu bytes): <strong>", body_total);
+    html_escape(out, body, shown);
+    fprintf(out, "%s</strong></p>", shown < body_total ? "..." : "");
+
+    fprintf(out, "</body></html>");
+}
+
+void html_escape(FILE *out, const char *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        switch (data[i]) {
+        case '<': fputs("&lt;", out); break;
+        case '>': fputs("&gt;", out); break;
+        case '&': fputs("&amp;", out); break;
+        default: fputc(data[i], out);
+        }
+    }
+}
+
+// 상주 워커 루프: BEGIN_REQUEST -> PARAMS... -> STDIN... 를 받아 STDOUT + END_REQUEST 로 응답
+// 서버가 소켓을 닫으면 (EOF) 종료
+int run_worker(void) {
+    unsigned char header[8];
+    unsigned char content[FCGI_MAX_CONTENT + 256];
+    unsigned char *params = NULL;
+    size_t params_len = 0;
+    char preview[BODY_PREVIEW];
+    size_t preview_len = 0, body_total = 0;
+
+    while (read_full(STDIN_FILENO, header, sizeof(header)) == 0) {
+        int type = header[1];
+        int id = (header[2] << 8) | header[3];
+        size_t len = (header[4] << 8) | header[5];
+
+        if (read_full(STDIN_FILENO, content, len + header[6]) == -1)
+            break;
+
+        if (type == FCGI_BEGIN_REQUEST) {
+            params_len = 0;
+            preview_len = 0;
+            body_total = 0;
+        } else if (type == FCGI_STDIN && len > 0) {
+            // 본문 조각: 앞부분만 보관하고 나머지는 세기만 함
+            if (preview_len < sizeof(preview)) {
+                size_t keep = sizeof(preview) - preview_len < len ? sizeof(preview) - preview_len : len;
+                memcpy(preview + preview_len, content, keep);
+                preview_len += keep;
+            }
+            body_total += len;
+        } else if (type == FCGI_PARAMS && len > 0) {
+            params = realloc(params, params_len + len);
+            memcpy(params + params_len, content, len);
+            params_len += len;
+        } else if (type == FCGI_STDIN && len == 0) {
+            // 빈 STDIN 레코드 = 요청 수신 완료
+            char *body = NULL;
+            size_t body_len = 0;
+            char *query_string = get_param(params, params_len, "QUERY_STRING");
+
+            FILE *out = open_memstream(&body, &body_len);
+            fprintf(out, "Content-type: text/html\r\n\r\n");
+            render_page(out, query_string, preview, body_total);
+            fclose(out);
+
+            unsigned char end[8] = { 0 }; // appStatus = 0, protocolStatus = REQUEST_COMPLETE
+            write_record(FCGI_STDOUT, id, body, body_len);
+            write_record(FCGI_STDOUT, id, NULL, 0);
+            write_record(FCGI_END_REQUEST, id, end, sizeof(end));
+
+            free(body);
+            free(query_string);
+        }
+    }
+
+    free(params);
+    return 0;
+}
+
+// 이름-값 쌍 목록에서 값 찾기 (없으면 NULL, 반환값은 free 필요)
+char *get_param(const unsigned char *params, size_t len, const char *name) {
+    const unsigned char *p = params, *end = params + len;
+
+    while (p < end) {
+        size_t lens[2];
+        for (int i = 0; i < 2; i++) {
+            if (*p & 0x80) {
+                lens[i] = ((size_t)(p[0] & 0x7f) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+                p += 4;
+            } else {
+                lens[i] = *p++;
+            }
+        }
+        if (lens[0] == strlen(name) && memcmp(p, name, lens[0]) == 0)
+            return strndup((const char *)p + lens[0], lens[1]);
+        p += lens[0] + lens[1];
+    }
+    return NULL;
+}
+
+int write_record(int type, int id, const void *data, size_t len) {
+    const char *p = data;
+    do {
+        size_t n = len < FCGI_MAX_CONTENT ? len : FCGI_MAX_CONTENT;
+        unsigned char header[8] = { FCGI_VERSION_1, type, id >> 8, id & 0xff, n >> 8, n & 0xff, 0, 0 };
+        if (write_full(STDIN_FILENO, header, sizeof(header)) == -1 || write_full(STDIN_FILENO, p, n) == -1)
+            return -1;
+        p += n;
+        len -= n;
+    } while (len > 0);
+    return 0;
+}
+
+int read_full(int fd, void *data, size_t len) {
+    char *p = data;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int write_full(int fd, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// --- 웹 서버 플러그인 (--plugin) ---
+// 빌드: mkdir -p ../plugins && gcc -O2 -Wall -shared -fPIC -DSWS_PLUGIN test_cgi.c -o ../plugins/test_cgi.so
+// 실행: ./server/server --plugin /plugin/test_cgi=test_cgi.so (simple_web_server 디렉토리에서)
+// 서버 워커 쓰레드 안에서 바로 호출되므로 fork/exec 없이 같은 페이지를 만듦 (정의는 서버와 같아야 함)
+#ifdef SWS_PLUGIN
+#define PLUGIN_ABI_VERSION 1
+
+typedef struct plugin_request {
+    const char *method;
+    const char *path;
+    const char *path_info;
+    const char *query_string;
+    const char *body;         // '\0' 으로 끝나지 않음
+    size_t body_len;
+    const char *(*header)(const struct plugin_request *req, const char *name);
+} plugin_request_t;
+
+typedef struct plugin_response {
+    void (*status)(struct plugin_response *res, int code, const char *reason);
+    void (*header)(struct plugin_response *res, const char *name, const char *value);
+    void (*write)(struct plugin_response *res, const void *data, size_t len);
+} plugin_response_t;
+
+int plugin_abi_version = PLUGIN_ABI_VERSION;
+
+int handle(const plugin_request_t *req, plugin_response_t *res) {
+    char *page = NULL;
+    size_t page_len = 0;
+
+    FILE *out = open_memstream(&page, &page_len);
+    if (out == NULL) return -1;
+    render_page(out, req->query_string, req->body, req->body_len);
+    fclose(out);
+
+    res->header(res, "Content-Type", "text/html");
+    res->write(res, page, page_len);
+    free(page);
     return 0;
-}
\ No newline at end of file
+}
+#endif
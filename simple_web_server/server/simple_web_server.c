@@ -1,33 +1,840 @@
+// simple_web_server.c
+// 컴파일: gcc -O2 -Wall -pthread simple_web_server.c -o server -lz -ldl
+// 실행:   ./server [-m epoll|uring|blocking] [-t 쓰레드수] [-p 포트] [-c 캐시MB] [--fcgi /cgi-bin/스크립트 ...]
+//         [--max-body MB] [-P 워커프로세스수] [--backlog N] [--access-log 파일|-|off] [--access-log-max MB]
+//         [--header-timeout 초] [--body-timeout 초] [--keepalive-timeout 초] [--cgi-timeout 초]
+//         [--simd auto|avx2|sse2|scalar] [--cgi-cache /cgi-bin/스크립트=초 ...] [--cgi-cache-mb MB]
+//         [--max-conns N] [--max-cgi N] [--retry-after 초] [--plugin /접두어=파일.so ...] [--plugin-dir 디렉토리]
+
+#define _GNU_SOURCE // accept4(), pipe2(), memmem(), memfd_create() 사용
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <stdarg.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <dlfcn.h>
+#include <linux/io_uring.h> // liburing 없이 시스템 콜로 직접 사용
+#include <zlib.h>
 #include <fcntl.h> // 파일 처리를 위해 추가
+#ifdef __x86_64__
+#include <immintrin.h> // 헤더 파서의 SSE2/AVX2 구분자 탐색
+#endif
 
 #define PORT 8080
+#define DEFAULT_BACKLOG SOMAXCONN       // listen() 대기열 길이 기본값 (커널이 somaxconn 으로 제한)
+#define RESPAWN_DELAY 1                 // 시작 직후 죽은 워커 프로세스는 이 시간(초) 후 재시작
 #define BUF_SIZE 1024
+#define MAX_EVENTS 256                  // epoll_wait 한 번에 처리할 최대 이벤트 수
+#define MAX_REQUEST_SIZE (BUF_SIZE * 64) // 헤더 최대 크기이자 수신 버퍼에 쌓아 둘 최대 바이트 수
+#define DEFAULT_MAX_BODY_MB 64          // 요청 본문 최대 크기 기본값 (MB)
+#define MAX_PENDING_OUTPUT (BUF_SIZE * 256) // 이 이상 응답이 밀리면 파이프라인 처리를 잠시 멈춤
+#define MAX_HEADERS 32                  // 요청당 최대 헤더 수
+#define ARENA_BLOCK_SIZE BUF_SIZE       // 요청별 할당 영역의 첫 블록 크기 (모자라면 두 배씩 키움)
+#define MAX_RANGES 16                   // Range 요청당 최대 구간 수 (넘으면 Range 무시하고 전체 전송)
+#define MAX_IOV 64                      // writev 한 번에 모을 최대 메모리 조각 수
+#define INLINE_FILE_MAX (BUF_SIZE * 16) // 이 크기 이하의 파일은 헤더와 함께 writev 한 번으로 전송
+#define SENDFILE_CHUNK (1024 * 1024)    // sendfile 한 번에 보낼 최대 바이트 (다른 연결 굶주림 방지)
+#define DEFAULT_CACHE_MB 64             // 정적 파일 캐시 기본 용량 (MB)
+#define CACHE_MAX_FILE (1024 * 1024)    // 이보다 큰 파일은 캐시하지 않고 sendfile로 전송
+#define CACHE_BUCKETS 1024              // 캐시 해시 테이블 버킷 수
+#define MAX_FCGI_POOLS 16               // 상주 CGI 워커 풀을 쓸 수 있는 스크립트 수
+#define FCGI_IDLE_SECS 10               // 최소 개수를 넘는 유휴 워커는 이 시간 후 종료
+#define CGI_MAX_HEADER (BUF_SIZE * 8)   // CGI 출력 헤더 최대 크기
+#define URING_ENTRIES 256               // io_uring 제출 큐 크기 (완료 큐는 4배)
+#define URING_BUFS 256                  // multishot recv 가 쓰는 제공 버퍼 수 (2의 거듭제곱)
+#define URING_BUF_SIZE (BUF_SIZE * 4)   // 제공 버퍼 하나의 크기
+#define URING_FILE_CHUNK (BUF_SIZE * 64) // io_uring 모드에서 파일을 한 번에 읽어 보낼 크기
+#define HIST_SUB_BITS 5                 // 2의 거듭제곱 구간마다 32개 하위 구간 (상대 오차 약 3%)
+#define HIST_MAX_BITS 40                // 이보다 큰 값(µs, 약 12일)은 마지막 구간에 넣음
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+#define STATUS_CODES 500                // 통계로 셀 상태 코드 범위 (100 ~ 599)
+#define LOG_RING_SIZE 4096              // 쓰레드별 접근 로그 링 버퍼의 레코드 수 (2의 거듭제곱)
+#define LOG_REQUEST_MAX 192             // 접근 로그에 남길 요청 줄 최대 길이 (넘으면 잘림)
+#define LOG_FLUSH_MSEC 50               // 로그 기록 쓰레드가 링 버퍼를 비우는 주기 (밀려 있으면 쉬지 않음)
+#define LOG_BLOCK_SIZE (BUF_SIZE * 64)  // 로그 줄을 모을 블록 크기 (writev 의 iovec 하나)
+#define LOG_BLOCKS 16                   // writev 한 번에 모을 최대 블록 수
+#define LOG_KEEP 5                      // 회전 시 보관할 이전 로그 파일 수 (경로.1 ~ 경로.5)
+#define DEFAULT_LOG_MAX_MB 100          // 접근 로그 파일 회전 크기 기본값 (MB)
+#define TIMER_TICK_MS 100               // 타이머 휠 한 칸의 시간 (타임아웃 정밀도)
+#define TIMER_SLOTS 512                 // 타이머 휠 칸 수 (2의 거듭제곱, 한 바퀴 = 51.2초)
+#define DEFAULT_HEADER_TIMEOUT 10       // 요청 헤더를 다 받을 때까지의 제한 시간 기본값 (초)
+#define DEFAULT_BODY_TIMEOUT 30         // 본문 수신/응답 전송이 멈춰 있을 수 있는 시간 기본값 (초)
+#define DEFAULT_KEEPALIVE_TIMEOUT 15    // 요청 사이 유휴 연결 유지 시간 기본값 (초)
+#define DEFAULT_CGI_TIMEOUT 60          // CGI 실행 제한 시간 기본값 (초)
+#define DEFAULT_CGI_CACHE_MB 16         // CGI 응답 캐시 용량 기본값 (MB)
+#define MAX_CGI_CACHE_RULES 16          // 응답을 캐시할 수 있는 스크립트 수
+#define DEFAULT_RETRY_AFTER 1           // 과부하로 거절한 503 응답의 Retry-After 기본값 (초)
+#define MAX_PLUGINS 16                  // 플러그인에 연결할 수 있는 URL 접두어 수
+#define DEFAULT_PLUGIN_DIR "./plugins"  // 플러그인 공유 객체를 찾을 디렉토리 기본값
+
+// --- FastCGI 형식 레코드 (상주 CGI 워커와 주고받는 프레임) ---
+#define FCGI_VERSION_1 1
+#define FCGI_BEGIN_REQUEST 1
+#define FCGI_END_REQUEST 3
+#define FCGI_PARAMS 4
+#define FCGI_STDIN 5
+#define FCGI_STDOUT 6
+#define FCGI_STDERR 7
+#define FCGI_MAX_CONTENT 65535
+
+// --- 서버 동작 모드 ---
+typedef enum {
+    MODE_BLOCKING, // 기존 방식: 한 번에 한 클라이언트씩 순차 처리 (비교용)
+    MODE_EPOLL,    // epoll 기반 리액터 + 워커 쓰레드 풀
+    MODE_URING     // io_uring 기반 (커널이 지원하지 않으면 epoll 로 대체)
+} server_mode_t;
+
+// --- 서버 설정 (명령행 옵션으로 변경 가능) ---
+typedef struct {
+    int port;
+    server_mode_t mode;
+    int num_threads; // epoll/io_uring 모드의 워커 쓰레드 수 (0이면 CPU 코어 수)
+    size_t cache_size; // 정적 파일 캐시 용량 (바이트, 0이면 사용 안 함)
+    int fcgi_min;          // 스크립트별 상주 워커 최소 개수
+    int fcgi_max;          // 스크립트별 상주 워커 최대 개수
+    int fcgi_max_requests; // 워커 하나가 처리할 최대 요청 수 (넘으면 새 워커로 교체)
+    size_t max_body;       // 요청 본문 최대 크기 (넘으면 413)
+    int num_procs;         // 마스터/워커 모드의 워커 프로세스 수 (0이면 단일 프로세스)
+    int backlog;           // listen() 대기열 길이
+    const char *access_log; // 접근 로그 파일 ("-" 이면 표준 출력, NULL 이면 끔)
+    size_t access_log_max;  // 이 크기를 넘으면 로그 파일 회전 (0이면 회전 안 함)
+    int header_timeout;     // 타임아웃 (초, 0이면 끔)
+    int body_timeout;
+    int keepalive_timeout;
+    int cgi_timeout;
+    const char *simd;       // 헤더 파서의 구분자 탐색 구현 (auto, avx2, sse2, scalar)
+    size_t cgi_cache_size;  // CGI 응답 캐시 용량 (바이트, 0이면 사용 안 함)
+    int max_conns;          // 동시 연결 수 한도 (넘으면 첫 요청에 503 후 종료, 0이면 제한 없음)
+    int max_cgi;            // 동시에 실행 중인 CGI 수 한도 (넘으면 503, 0이면 제한 없음)
+    int retry_after;        // 503 응답의 Retry-After (초)
+    const char *plugin_dir; // --plugin 의 파일을 찾을 디렉토리
+} server_config_t;
+
+server_config_t config = { PORT, MODE_EPOLL, 0, (size_t)DEFAULT_CACHE_MB * 1024 * 1024, 1, 8, 1000,
+                           (size_t)DEFAULT_MAX_BODY_MB * 1024 * 1024, 0, DEFAULT_BACKLOG, "-",
+                           (size_t)DEFAULT_LOG_MAX_MB * 1024 * 1024, DEFAULT_HEADER_TIMEOUT,
+                           DEFAULT_BODY_TIMEOUT, DEFAULT_KEEPALIVE_TIMEOUT, DEFAULT_CGI_TIMEOUT, "auto",
+                           (size_t)DEFAULT_CGI_CACHE_MB * 1024 * 1024, 0, 0, DEFAULT_RETRY_AFTER,
+                           DEFAULT_PLUGIN_DIR };
+
+// 부하 제한용 현재 사용량 (모든 쓰레드 공유)
+atomic_int conn_count;   // 열려 있는 클라이언트 연결
+atomic_int cgi_running;  // 실행 중인 CGI (일회성 + 상주 워커)
+
+// 마스터 프로세스가 받은 종료 시그널 (워커들을 정리하고 종료)
+volatile sig_atomic_t master_stop = 0;
+
+// --- 상주 CGI 워커 ---
+// 스크립트를 한 번 실행해 두고 UNIX 소켓(워커의 fd 0)으로 FastCGI 형식 레코드를 주고받아
+// 요청마다 fork/exec 하지 않고 재사용
+typedef struct fcgi_worker {
+    pid_t pid;
+    int fd;              // 워커와 연결된 소켓 (서버 쪽)
+    int requests;        // 지금까지 처리한 요청 수
+    time_t idle_since;   // 유휴 목록에 들어간 시각
+    struct fcgi_worker *next;
+} fcgi_worker_t;
+
+typedef struct {
+    char uri[256];       // 예: /cgi-bin/test_cgi
+    char path[256];      // 예: ./cgi-bin/test_cgi
+    pthread_mutex_t lock;
+    fcgi_worker_t *idle;      // 유휴 워커 목록 (최근 반납 순)
+    int total;                // 살아 있는 워커 수 (유휴 + 사용 중)
+} fcgi_pool_t;
+
+fcgi_pool_t fcgi_pools[MAX_FCGI_POOLS];
+int fcgi_pool_count = 0;
+
+// --- CGI 응답 캐시 대상 (--cgi-cache) ---
+// 출력이 요청(QUERY_STRING, 본문)에만 달려 있는 스크립트를 지정해 같은 요청은 TTL 동안 재실행하지 않음
+typedef struct {
+    char path[256];      // 예: ./cgi-bin/test_cgi
+    int ttl;             // 보관 시간 (초)
+} cgi_cache_rule_t;
+
+cgi_cache_rule_t cgi_cache_rules[MAX_CGI_CACHE_RULES];
+int cgi_cache_rule_count = 0;
+
+// --- 플러그인 ABI ---
+// 공유 객체가 내보내는 handle() 을 워커 쓰레드 안에서 바로 호출 (fork/exec, 파이프 없음)
+// 플러그인 쪽에도 같은 정의를 두므로 구조체를 바꾸면 PLUGIN_ABI_VERSION 을 올림 (플러그인은 plugin_abi_version 으로 내보냄)
+#define PLUGIN_ABI_VERSION 1
+
+typedef struct plugin_request {
+    const char *method;
+    const char *path;         // 쿼리를 뺀 경로 (예: /app/test/a)
+    const char *path_info;    // 접두어 뒤 부분 (예: /a, 없으면 "")
+    const char *query_string; // "?" 뒤 (없으면 "")
+    const char *body;         // 요청 본문 전체 ('\0' 으로 끝나지 않음)
+    size_t body_len;
+    const char *(*header)(const struct plugin_request *req, const char *name); // 없으면 NULL
+} plugin_request_t;
+
+typedef struct plugin_response {
+    void (*status)(struct plugin_response *res, int code, const char *reason); // 기본 200 OK
+    void (*header)(struct plugin_response *res, const char *name, const char *value);
+    void (*write)(struct plugin_response *res, const void *data, size_t len);
+} plugin_response_t;
+
+// 진입점: 0 이면 쓴 응답을 전송, -1 이면 버리고 500
+// 선택: int plugin_init(void) (로드 직후, -1 이면 로드 취소), void plugin_fini(void) (닫기 직전)
+typedef int (*plugin_handler_t)(const plugin_request_t *req, plugin_response_t *res);
+
+// --- 플러그인 (--plugin) ---
+// 파일이 바뀌면 새 버전을 로드해 교체하고, 이전 버전은 실행 중인 요청이 모두 끝나면 닫음
+typedef struct plugin_module {
+    void *dl;
+    int memfd;           // 로드한 복사본 (열어 두어야 다른 버전과 경로가 겹치지 않음)
+    plugin_handler_t handle;
+    void (*fini)(void);
+    atomic_int refs;     // 현재 버전으로 걸려 있는 1 + 실행 중인 요청 수 (0 이 되면 닫음)
+    int version;
+} plugin_module_t;
+
+typedef struct {
+    char prefix[256];    // 예: /app/test
+    size_t prefix_len;
+    char file[256];      // 플러그인 디렉토리 안의 파일 이름 (예: test_cgi.so)
+    pthread_mutex_t lock;
+    plugin_module_t *current; // 로드하지 못했으면 NULL (503)
+    int loads;           // 지금까지 로드한 횟수 (버전 번호)
+} plugin_t;
+
+plugin_t plugins[MAX_PLUGINS];
+int plugin_count = 0;
+int plugin_inotify_fd = -1;
+
+// 출력을 다 읽었지만 아직 종료되지 않은 CGI 자식 (나중에 회수)
+pthread_mutex_t reap_lock = PTHREAD_MUTEX_INITIALIZER;
+pid_t *reap_pids = NULL;
+int reap_count = 0;
+int reap_cap = 0;
+
+// --- 가변 길이 버퍼 ---
+typedef struct {
+    char *data;
+    size_t len; // 저장된 데이터 길이
+    size_t cap; // 할당된 크기
+    size_t off; // 이미 소비(전송)된 위치
+} buffer_t;
+
+// --- 요청별 bump 할당 영역 ---
+// 요청을 처리하는 동안의 임시 문자열(파일 경로, QUERY_STRING, FastCGI 파라미터)은 연결의 블록에서
+// 포인터만 밀어 할당하고, 다음 요청을 파싱할 때 한꺼번에 비움 (개별 free 없음, 길이 제한 없음)
+typedef struct arena_block {
+    struct arena_block *next;
+    size_t cap;
+    size_t used;
+    char data[];
+} arena_block_t;
+
+typedef struct {
+    arena_block_t *head; // 할당 중인 블록 (가장 최근에 만든 가장 큰 블록)
+} arena_t;
+
+// --- 정적 파일 캐시 항목 ---
+// 헤더와 본문을 미리 직렬화한 응답 전체를 보관하여 적중 시 writev 한 번으로 전송
+// 전송 중인 연결이 참조를 쥐고 있으므로 무효화되어도 마지막 참조가 풀릴 때 해제
+typedef struct cache_entry {
+    char *key;          // 파일 경로
+    char *data;         // 직렬화된 응답: 헤더("\r\n"으로 끝남) + "\r\n" + 본문
+    size_t len;         // 응답 전체 길이
+    size_t head_len;    // 마지막 빈 줄 앞까지의 헤더 길이 (Connection 헤더 삽입 위치)
+    char etag[64];
+    time_t mtime;       // Last-Modified (If-Range 날짜 비교용)
+    int gzip;           // Accept-Encoding: gzip 요청용 변형 (압축해도 줄지 않으면 원본을 그대로 보관)
+    int wd;             // inotify 감시 디렉토리
+    char *name;         // 디렉토리 안의 파일 이름 (무효화 이벤트와 비교)
+    atomic_int refs;       // 캐시 자신 + 전송 중인 응답 조각 수
+    atomic_int referenced; // CLOCK 참조 비트 (적중 시 1)
+    unsigned long hash;    // 키의 해시 (버킷 위치)
+    // CGI 응답 캐시 전용: 키에 요청 본문이 들어가므로 길이로 비교
+    size_t key_len;
+    uint64_t expires;      // 만료 시각 (ms)
+    int pending;           // 첫 요청의 CGI 가 실행 중 (내용이 없으므로 용량에 세지 않고 제거하지도 않음)
+    uint64_t wake_mask;    // 결과를 기다리는 연결이 있는 워커 (워커 번호 % 64 비트)
+    const char *failed;    // 실행 실패: 기다리던 연결에 보낼 상태 (NULL 이면 data 가 응답)
+    struct cache_entry *hash_next;
+    struct cache_entry *clock_prev; // CLOCK 원형 리스트
+    struct cache_entry *clock_next;
+} cache_entry_t;
+
+typedef struct {
+    pthread_rwlock_t lock;  // 조회는 읽기 잠금, 삽입/교체/무효화는 쓰기 잠금
+    cache_entry_t *buckets[CACHE_BUCKETS];
+    cache_entry_t *hand;    // CLOCK 바늘
+    size_t bytes;           // 현재 사용량
+    int inotify_fd;
+} file_cache_t;
+
+file_cache_t file_cache = { .lock = PTHREAD_RWLOCK_INITIALIZER, .inotify_fd = -1 };
+
+// CGI 응답 캐시: 정적 파일 캐시와 같은 항목 형식과 CLOCK 제거를 쓰고, 무효화는 TTL 로만 함
+file_cache_t cgi_cache = { .lock = PTHREAD_RWLOCK_INITIALIZER, .inotify_fd = -1 };
+
+// --- 캐시에 넣을 응답 변형 ---
+typedef enum {
+    VARIANT_RAW,       // 원본 파일 그대로
+    VARIANT_GZIP,      // 원본을 zlib 으로 한 번 압축해 보관
+    VARIANT_GZIP_FILE  // 미리 압축해 둔 .gz 파일 그대로
+} variant_t;
+
+// --- Range 요청의 바이트 구간 ---
+typedef struct {
+    off_t start;
+    off_t len;
+} byte_range_t;
+
+// --- 응답 출력 조각 ---
+// 응답은 메모리 조각과 파일 조각의 연결 리스트로 쌓이며, 메모리 조각은 writev로 모아서,
+// 파일 조각은 sendfile로 커널 안에서 바로 소켓으로 복사하여 전송
+typedef enum {
+    SEG_MEM,  // 메모리 데이터 (헤더, 작은 파일, CGI 출력 등)
+    SEG_REF,  // 캐시 항목의 일부 구간 (복사 없이 참조만 보유)
+    SEG_FILE  // 파일 구간 (fd는 조각이 소유하고 전송 완료 시 닫음)
+} seg_type_t;
+
+typedef struct out_seg {
+    seg_type_t type;
+    struct out_seg *next;
+    buffer_t mem;   // SEG_MEM: mem.off 부터 전송
+    cache_entry_t *ref;   // SEG_REF
+    const char *ref_data;
+    size_t ref_len;
+    int file_fd;    // SEG_FILE
+    off_t file_off;
+    size_t file_left;
+} out_seg_t;
+
+// --- HTTP 요청 (모든 문자열은 수신 버퍼 내부를 가리키는 뷰: 길이를 함께 두고 '\0'으로도 끝남) ---
+typedef struct {
+    char *name;
+    size_t name_len;
+    char *value;      // 앞뒤 공백 제거됨
+    size_t value_len;
+} http_header_t;
+
+typedef struct {
+    char *method;
+    size_t method_len;
+    char *uri;
+    size_t uri_len;
+    char *version;
+    int http11;            // 버전이 HTTP/1.1 (요청 버퍼가 재사용된 뒤에도 쓸 수 있도록 따로 보관)
+    http_header_t headers[MAX_HEADERS];
+    int header_count;
+    size_t content_length; // 본문은 버퍼에 모으지 않고 도착하는 대로 흘려보냄 (conn_consume_body)
+    int keep_alive;        // 응답 후 연결 유지 여부
+} http_request_t;
+
+// --- 증분 파서 ---
+// 구분자 탐색 구현: 옵션 처리 때 CPU 에 맞게 고름 (scan_delims_select)
+size_t (*scan_delims)(const char *p, size_t len, char c) = NULL;
+const char *scan_delims_name = NULL;
+
+typedef enum {
+    PARSE_INCOMPLETE, // 데이터가 더 필요함
+    PARSE_OK,         // 요청 헤더 완성 (본문은 이후 스트리밍)
+    PARSE_ERROR,      // 잘못된 요청 (400)
+    PARSE_TOO_LARGE,  // 요청이 너무 큼 (413)
+    PARSE_UNSUPPORTED // 지원하지 않는 본문 전송 방식 (501)
+} parse_result_t;
+
+// --- epoll 이벤트 출처 구분 (data.ptr 가 가리키는 구조체의 첫 멤버) ---
+typedef enum {
+    EV_CONN,   // 클라이언트 연결
+    EV_CGI,    // CGI 출력 (파이프 또는 상주 워커 소켓)
+    EV_CGI_IN, // CGI 표준 입력 파이프 (쓰기 가능 대기)
+    EV_NOTIFY  // 다른 쓰레드가 깨움 (워커의 eventfd)
+} ev_type_t;
+
+// --- 타임아웃 타이머 ---
+// 연결마다 노드 하나를 내장하고 워커별 해시 타이머 휠(만료 tick % 칸 수)의 이중 연결 리스트에 매달아
+// 추가/삭제는 O(1), 만료 처리는 지금 tick 의 칸에 있는 노드만 봄 (한 바퀴보다 먼 노드는 다음 바퀴로)
+typedef enum {
+    TIMEOUT_HEADER,    // 요청 헤더 수신 (첫 바이트 또는 연결 수락부터)
+    TIMEOUT_BODY,      // 본문 수신 / 응답 전송이 진척 없이 멈춤
+    TIMEOUT_KEEPALIVE, // 요청 사이 유휴
+    TIMEOUT_CGI,       // CGI 실행 시간
+    TIMEOUT_KINDS
+} timeout_kind_t;
+
+typedef struct timer_node {
+    struct timer_node *prev, *next; // 휠에 걸려 있지 않으면 NULL
+    uint64_t expire;                // 만료 시각 (ms, CLOCK_MONOTONIC)
+} timer_node_t;
+
+typedef struct {
+    timer_node_t slots[TIMER_SLOTS]; // 칸마다 원형 리스트의 머리 노드
+    uint64_t tick;                   // 다음에 처리할 tick (= 시각 / TIMER_TICK_MS)
+    uint64_t now;                    // 이벤트를 받은 시각 (ms, 이벤트 처리 중에는 이 값을 씀)
+    size_t count;                    // 걸려 있는 타이머 수 (0이면 이벤트 루프가 무기한 대기)
+} timer_wheel_t;
+
+// --- 진행 중인 CGI 실행 ---
+// CGI 출력을 이벤트 루프에서 읽는 즉시 chunked 인코딩으로 클라이언트에 전달
+typedef struct {
+    ev_type_t ev_type;      // EV_CGI
+    int active;
+    int fd;                 // CGI 출력을 읽을 fd (논블로킹)
+    ev_type_t in_ev_type;   // EV_CGI_IN (표준 입력 파이프 이벤트용 태그)
+    int in_fd;              // 요청 본문을 쓸 표준 입력 파이프 (일회성 실행, 없으면 -1)
+    int stdin_open;         // 본문을 더 보내야 함 (끝나면 EOF / 빈 STDIN 레코드)
+    int in_waiting;         // 표준 입력 파이프(풀 워커는 소켓)가 가득 차 EPOLLOUT 대기 중
+    pid_t pid;              // 일회성 실행의 자식 프로세스 (풀 모드는 0)
+    fcgi_pool_t *pool;      // 상주 워커 풀 모드
+    fcgi_worker_t *worker;
+    int paused;             // 클라이언트 전송이 밀려 읽기를 멈춤
+    int headers_sent;       // CGI 헤더를 HTTP 응답 헤더로 변환해 보냈는지
+    int chunked;            // HTTP/1.1: chunked 전송, HTTP/1.0: 연결 종료로 끝을 알림
+    uint64_t started;       // 실행 시작 시각 (µs, 실행 시간 통계용)
+    int keep_alive;         // 요청 시점의 연결 유지 여부 (요청 버퍼는 이미 재사용될 수 있음)
+    buffer_t head;          // 헤더 끝을 만날 때까지 모은 CGI 출력
+    // 응답을 캐시하는 요청: 변환한 응답을 모아 두었다가 끝나면 항목에 넣음 (같은 요청을 기다리는 연결과 공유)
+    struct cache_entry *cache;
+    buffer_t capture;       // 상태 줄 + 헤더 (capture_head 바이트), 이어서 본문
+    size_t capture_head;
+    int capture_overflow;   // 너무 커서 모으기를 포기함
+    // FastCGI 레코드 증분 디코딩 상태
+    unsigned char rec_header[8];
+    size_t rec_header_got;
+    size_t rec_left;        // 현재 레코드에서 남은 내용 바이트
+    size_t pad_left;        // 현재 레코드에서 남은 패딩 바이트
+    // 상주 워커로 보내는 STDIN 레코드 (소켓이 가득 차면 보내던 자리부터 이어서 전송, 패딩은 쓰지 않음)
+    unsigned char in_header[8];
+    size_t in_header_left;  // 아직 보내지 못한 헤더 바이트 (헤더 끝에서부터 셈)
+    size_t in_rec_left;     // 현재 레코드에서 남은 내용 바이트
+} cgi_job_t;
+
+// --- 연결 상태 ---
+typedef struct conn {
+    ev_type_t ev_type; // EV_CONN
+    int fd;
+    struct worker *worker; // 이 연결을 처리하는 epoll 워커 (blocking 모드는 NULL)
+    int closing;     // 현재 응답을 모두 보낸 후 연결 종료
+    int shed;        // 연결 수 한도를 넘어 받은 연결 (첫 요청에 503 으로 답하고 종료)
+    int peer_closed; // 클라이언트가 송신을 종료함 (EOF)
+    buffer_t in;     // 수신 버퍼 (in.off = 현재 요청의 시작 위치)
+    out_seg_t *out_head;   // 전송 대기 중인 응답 조각 (순서대로)
+    out_seg_t *out_tail;
+    size_t out_pending;    // 메모리 조각에 쌓인 미전송 바이트 수
+
+    // 파서 상태: 읽기가 여러 번에 나뉘어도 이어서 파싱
+    size_t scan_off;   // 헤더 끝 탐색을 재개할 위치 (in.off 기준)
+    size_t header_len; // 현재 요청의 헤더 길이
+    size_t body_left;  // 현재 요청 본문 중 아직 소비하지 않은 바이트 (CGI 로 전달 또는 버림)
+    http_request_t req;
+
+    arena_t arena;     // 현재 요청을 처리하는 동안의 임시 할당 (다음 요청 파싱 시 비움)
+
+    // 본문이 있어야 처리할 수 있는 요청(CGI 응답 캐시 키, 플러그인)은 본문이 다 올 때까지 파싱한 요청을 보류
+    char *held_base;   // 보류할 때의 수신 버퍼 위치 (재할당되면 요청의 뷰를 옮김)
+    int continue_sent;          // 보류 중에 100 Continue 를 이미 보냄
+    cache_entry_t *cache_wait;  // 같은 요청을 실행 중인 다른 연결의 결과를 기다림
+    struct conn *wait_next;     // 워커의 대기 목록
+
+    cgi_job_t cgi;     // 실행 중인 CGI (끝날 때까지 다음 요청 처리를 보류)
+    int dead;          // 닫힘 (같은 epoll_wait 결과에 남은 이벤트 무시, 루프 끝에서 해제)
+    struct conn *next_dead;
+
+    // io_uring 모드: 커널에 넘긴 요청이 모두 완료될 때까지 연결 메모리를 해제하지 않음
+    int inflight;      // 완료를 기다리는 요청 수
+    int recv_armed;    // multishot recv 가 걸려 있음
+    int recv_cancel;   // 수신 버퍼가 가득 차 recv 취소를 요청함
+    int send_inflight; // 전송 진행 중 (응답 순서를 지키기 위해 한 번에 하나씩)
+    struct uring_io *io;
+
+    // 통계: 현재 요청의 시작 시각과 분류, 보낸 응답 상태 코드
+    uint64_t req_start; // µs (CLOCK_MONOTONIC)
+    int stat_method;
+    int stat_route;
+    int status;
+
+    // 접근 로그: 요청 줄은 처리 중에 수신 버퍼가 재사용될 수 있으므로 시작할 때 복사
+    char log_request[LOG_REQUEST_MAX];
+    unsigned long long out_total; // 지금까지 응답에 넣은 바이트 (요청별 크기 = 끝 - 시작)
+    unsigned long long out_start;
+    int64_t cgi_usec;             // CGI 실행 시간 (CGI 가 아니면 -1)
+    uint32_t peer;                // 클라이언트 IPv4 주소 (처음 기록할 때 한 번만 조회)
+    int peer_known;
+
+    // 타임아웃: deadline 이 늦춰질 때는 휠을 건드리지 않고, 타이머가 울릴 때 새 시각으로 다시 걺
+    timer_node_t timer;
+    uint64_t deadline;     // 현재 상태의 만료 시각 (ms, 0이면 타임아웃 없음)
+    timeout_kind_t timer_kind;
+    uint64_t last_active;  // 마지막으로 주고받은 시각 (ms)
+    uint64_t header_start; // 현재 요청 헤더의 첫 바이트 (또는 연결 수락) 시각, 헤더 대기 중이 아니면 0
+} conn_t;
+
+// --- 플러그인 호출 하나의 요청/응답 (응답 쪽 콜백은 멤버 위치로 이 구조체를 찾음) ---
+typedef struct {
+    plugin_request_t req;
+    plugin_response_t res;
+    conn_t *conn;
+    int status;
+    const char *reason;
+    const char *content_type;
+    buffer_t headers;    // 플러그인이 추가한 "이름: 값\r\n" 헤더
+    buffer_t body;
+    int failed;          // 응답을 모으다 메모리 부족
+} plugin_call_t;
+
+// --- io_uring 모드의 연결별 전송 상태 (완료될 때까지 커널이 참조하므로 연결에 보관) ---
+typedef struct uring_io {
+    struct iovec iov[MAX_IOV];
+    struct msghdr msg;
+    char *file_buf;    // 파일 조각을 읽어 보낼 버퍼 (URING_FILE_CHUNK, 필요할 때 할당)
+    int file_send;     // 진행 중인 전송이 파일 조각인지
+} uring_io_t;
+
+// --- 워커별 io_uring 인스턴스 ---
+// 제출/완료 큐는 커널과 공유하는 메모리이며, 수신은 제공 버퍼 링에서 커널이 버퍼를 골라 채움
+// user_data 는 연결 포인터에 요청 종류(하위 3비트)를 붙인 값 (포인터가 NULL 이면 리스닝/CGI/무시)
+typedef enum {
+    URING_IGNORE,  // 취소 요청 등 결과를 볼 필요 없음
+    URING_ACCEPT,  // multishot accept (연결 없음)
+    URING_EPOLL,   // CGI fd 를 모아 둔 epoll 인스턴스의 multishot poll (연결 없음)
+    URING_RECV,    // multishot recv
+    URING_READ,    // 파일 조각 읽기 (전송과 연결됨)
+    URING_SEND     // 응답 전송
+} uring_op_t;
+
+typedef struct uring {
+    int fd;
+    unsigned sq_entries;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned sq_local;             // 채워 둔 SQE 까지 포함한 tail (제출 시 커널에 공개)
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *ring_ptr;                // SQ/CQ 링 (IORING_FEAT_SINGLE_MMAP)
+    size_t ring_len;
+    size_t sqes_len;
+    struct io_uring_buf_ring *br;  // 수신용 제공 버퍼 링
+    char *bufs;
+    unsigned short br_tail;
+} uring_t;
+
+// --- epoll / io_uring 워커 쓰레드 ---
+typedef struct worker {
+    int id;
+    int epfd;        // 워커별 epoll 인스턴스 (io_uring 모드에서는 CGI fd 만 등록)
+    int listen_sock; // 모든 워커가 공유하는 리스닝 소켓
+    pthread_t tid;
+    conn_t *dead_conns; // 이번 이벤트 처리 중에 닫힌 연결 (처리 후 해제)
+    uring_t *ring;      // io_uring 모드에서만 사용 (epoll 모드는 NULL)
+    timer_wheel_t wheel; // 이 워커 연결들의 타임아웃
+    int notify_fd;       // 다른 쓰레드가 깨우는 eventfd (기다리던 CGI 응답 캐시 결과가 나옴)
+    ev_type_t notify_ev_type; // EV_NOTIFY
+    conn_t *cache_waiters;    // 다른 연결의 CGI 실행 결과를 기다리는 이 워커의 연결
+} worker_t;
+
+worker_t *workers = NULL;    // 모든 워커 (기다리는 연결이 있는 워커를 깨울 때 사용)
+int worker_count = 0;
+
+// --- 서버 통계 (/server-stats) ---
+// 쓰레드마다 자기 통계 블록에만 기록하고 (잠금이나 원자적 RMW 없이 relaxed load/store),
+// 엔드포인트를 읽을 때만 모든 쓰레드의 블록을 합침
+typedef enum { METHOD_GET, METHOD_POST, METHOD_OTHER, METHOD_COUNT } stat_method_t;
+typedef enum { ROUTE_STATIC, ROUTE_CGI, ROUTE_PLUGIN, ROUTE_STATS, ROUTE_OTHER, ROUTE_COUNT } stat_route_t;
+typedef enum { CGI_EXEC, CGI_POOL, CGI_KIND_COUNT } cgi_kind_t;
+typedef enum { CGI_CACHE_HIT, CGI_CACHE_MISS, CGI_CACHE_COALESCED, CGI_CACHE_RESULTS } cgi_cache_result_t;
+typedef enum { SHED_CONNS, SHED_CGI, SHED_KINDS } shed_kind_t;
+
+// HDR 방식 로그-선형 히스토그램: 값(µs)의 최상위 비트 위치로 구간을 고르고 그 안을 32등분
+typedef struct {
+    atomic_ullong counts[HIST_BUCKETS];
+    atomic_ullong total; // 기록 횟수
+    atomic_ullong sum;   // 값의 합 (µs)
+    atomic_ullong max;
+} histogram_t;
+
+typedef struct thread_stats {
+    atomic_ullong requests[METHOD_COUNT][STATUS_CODES]; // [메소드][상태 코드 - 100]
+    atomic_ullong bytes_in;
+    atomic_ullong bytes_out;
+    atomic_ullong conns_opened; // 활성 연결 수 = 합계(opened) - 합계(closed)
+    atomic_ullong conns_closed;
+    histogram_t latency[ROUTE_COUNT];   // 요청 헤더 수신 ~ 응답 생성 완료 (CGI 는 종료까지)
+    histogram_t cgi_spawn[CGI_KIND_COUNT]; // fork/exec 또는 풀 워커 확보 + 요청 전달
+    histogram_t cgi_run;                // CGI 시작 ~ 출력 종료
+    atomic_ullong timeouts[TIMEOUT_KINDS]; // 종류별 타임아웃으로 닫은 연결 / 중단한 CGI 수
+    atomic_ullong cgi_cache[CGI_CACHE_RESULTS]; // CGI 응답 캐시 적중 / 실행 / 실행 중인 요청에 합류
+    atomic_ullong shed[SHED_KINDS];     // 한도를 넘어 503 으로 거절한 요청 (연결 수 / CGI 수)
+    struct thread_stats *next;
+} thread_stats_t;
+
+pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER; // 등록 목록 보호 (쓰레드당 한 번만 잠금)
+thread_stats_t *stats_list = NULL;   // 등록된 모든 쓰레드의 통계 블록 (해제하지 않음)
+__thread thread_stats_t *my_stats = NULL;
+time_t stats_started;                // 서버 시작 시각 (uptime 계산용)
+
+// --- 접근 로그 ---
+// 요청 쓰레드는 고정 크기 레코드를 자기 링 버퍼에 복사만 하고 (잠금/시스템 콜 없음),
+// 기록 쓰레드가 주기적으로 모든 링을 비우며 Common Log Format 으로 만들어 writev 로 씀
+// 링이 가득 차면 기다리지 않고 버린 수만 셈
+typedef struct {
+    time_t time;
+    uint32_t peer;
+    int status;
+    unsigned long long bytes;  // 응답 바이트 (헤더 포함)
+    uint64_t usec;             // 요청 헤더 수신 ~ 응답 생성 완료
+    int64_t cgi_usec;          // CGI 실행 시간 (없으면 -1)
+    char request[LOG_REQUEST_MAX];
+} log_record_t;
+
+// 단일 생산자(요청 쓰레드) / 단일 소비자(기록 쓰레드) 링: head 와 tail 을 서로 다른 캐시 라인에 둠
+typedef struct log_ring {
+    _Alignas(64) atomic_uint head; // 기록 쓰레드가 다음에 읽을 위치
+    _Alignas(64) atomic_uint tail; // 요청 쓰레드가 다음에 쓸 위치
+    atomic_ullong dropped;
+    log_record_t records[LOG_RING_SIZE];
+    struct log_ring *next;
+} log_ring_t;
+
+pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER; // 링 등록 목록 보호
+log_ring_t *log_rings = NULL;        // 등록된 모든 쓰레드의 링 (해제하지 않음)
+__thread log_ring_t *my_log_ring = NULL;
+int log_enabled = 0;                 // 기록 쓰레드가 동작 중 (서비스 시작 전에 정해짐)
+int log_fd = -1;                     // 접근 로그 출력 (기록 쓰레드만 사용)
+atomic_ullong log_written;           // 기록한 레코드 수
 
 // --- 함수 원형 선언 ---
 void error_handling(char *message);
-void send_error(int clnt_sock, char *status);
-void handle_request(int clnt_sock);
-void handle_get(int clnt_sock, char *uri);
-void handle_post(int clnt_sock, char *uri, char *request_body, int content_length);
-void execute_cgi(int clnt_sock, char *path, char *query_string);
+void parse_options(int argc, char *argv[]);
+void print_usage(const char *prog);
+void run_server(void);
+void run_master(void);
+pid_t spawn_server_process(void);
+void master_signal_handler(int sig);
+void send_error(conn_t *conn, char *status);
+void send_header(conn_t *conn, const char *status, const char *content_type, size_t content_length,
+                 const char *extra_headers);
+void send_not_modified(conn_t *conn, const char *etag);
+void handle_request(conn_t *conn);
+void handle_get(conn_t *conn, char *uri);
+void handle_post(conn_t *conn, char *uri, size_t content_length);
+void execute_cgi(conn_t *conn, char *path, char *query_string);
+int cgi_start_exec(conn_t *conn, char *path, char *query_string);
+ssize_t cgi_write_stdin(conn_t *conn, const char *data, size_t len);
+void cgi_close_stdin(conn_t *conn);
+void cgi_wait_stdin(conn_t *conn, int waiting);
+void cgi_on_writable(conn_t *conn);
+int cgi_flush_stdin(conn_t *conn);
+void cgi_attach(conn_t *conn, int fd);
+void cgi_detach(conn_t *conn);
+void cgi_on_readable(conn_t *conn);
+void cgi_forward(conn_t *conn, const char *data, size_t len);
+void cgi_send_headers(conn_t *conn, char *head, size_t len);
+void cgi_finish(conn_t *conn, int ok);
+void cgi_abort(conn_t *conn);
+void cgi_set_paused(conn_t *conn, int paused);
+void cgi_run_blocking(conn_t *conn);
+void reap_child(pid_t pid);
+
+cgi_cache_rule_t *cgi_cache_find_rule(const char *path);
+int cgi_cache_request(conn_t *conn, const char *path, const char *query_string);
+void cgi_cache_capture(conn_t *conn, const char *data, size_t len);
+void cgi_cache_complete(conn_t *conn, const char *failed);
+void cgi_cache_wake(worker_t *w);
+void cgi_cache_unwait(conn_t *conn);
+
+void plugins_init(void);
+plugin_t *plugin_find(const char *uri);
+int plugin_load(plugin_t *plugin);
+plugin_module_t *plugin_acquire(plugin_t *plugin);
+void plugin_release(plugin_module_t *module);
+void *plugin_watch_thread(void *arg);
+void handle_plugin(conn_t *conn, plugin_t *plugin);
+const char *plugin_req_header(const plugin_request_t *req, const char *name);
+void plugin_res_status(plugin_response_t *res, int code, const char *reason);
+void plugin_res_header(plugin_response_t *res, const char *name, const char *value);
+void plugin_res_write(plugin_response_t *res, const void *data, size_t len);
+
+void fcgi_pools_init(void);
+fcgi_pool_t *fcgi_find_pool(const char *path);
+fcgi_worker_t *fcgi_spawn(fcgi_pool_t *pool);
+void fcgi_kill(fcgi_worker_t *worker);
+fcgi_worker_t *fcgi_acquire(fcgi_pool_t *pool);
+void fcgi_release(fcgi_pool_t *pool, fcgi_worker_t *worker, int reusable);
+void *fcgi_maintain_thread(void *arg);
+int fcgi_start(conn_t *conn, fcgi_pool_t *pool, char *query_string);
+void fcgi_decode(conn_t *conn, const char *data, size_t len);
+void fcgi_stdin_header(cgi_job_t *job, size_t len);
+int fcgi_write_record(int fd, int type, int id, const void *data, size_t len);
+size_t fcgi_put_param(char *buf, const char *name, const char *value);
+int write_full(int fd, const void *data, size_t len);
+
+parse_result_t http_parse(conn_t *conn);
+char *parse_error_status(parse_result_t pr);
+int parse_headers(conn_t *conn, char *start, size_t len);
+const char *find_header(http_request_t *req, const char *name);
+size_t scan_delims_scalar(const char *p, size_t len, char c);
+#ifdef __x86_64__
+size_t scan_delims_sse2(const char *p, size_t len, char c);
+size_t scan_delims_avx2(const char *p, size_t len, char c);
+#endif
+int scan_delims_select(const char *level);
+void request_done(conn_t *conn);
+int request_hold(conn_t *conn);
+int request_needs_body(conn_t *conn);
+int conn_consume_body(conn_t *conn);
+void conn_compact_input(conn_t *conn);
+
+int buffer_append(buffer_t *buf, const void *data, size_t len);
+void buffer_free(buffer_t *buf);
+void *arena_alloc(arena_t *arena, size_t size);
+char *arena_printf(arena_t *arena, const char *fmt, ...);
+void arena_reset(arena_t *arena);
+void arena_free(arena_t *arena);
+
+conn_t *conn_create(int fd);
+void conn_destroy(conn_t *conn);
+void conn_free(conn_t *conn);
+void conn_send(conn_t *conn, const void *data, size_t len);
+void conn_send_file(conn_t *conn, int fd, off_t offset, size_t len);
+out_seg_t *conn_push_seg(conn_t *conn, seg_type_t type);
+void conn_pop_seg(conn_t *conn);
+const char *mime_type(const char *path);
+void conn_send_ref(conn_t *conn, cache_entry_t *entry, size_t off, size_t len);
+
+void cache_init(void);
+cache_entry_t *cache_lookup(const char *key, int gzip);
+cache_entry_t *cache_insert(const char *key, int fd, struct stat *st, variant_t variant);
+int cache_name_matches(cache_entry_t *entry, const char *name);
+int accepts_gzip(conn_t *conn);
+int is_compressible(const char *type);
+int open_gzip_sibling(const char *gz_path, struct stat *orig, struct stat *st);
+char *gzip_compress(const char *data, size_t len, size_t *out_len);
+void cache_release(cache_entry_t *entry);
+void cache_unlink(file_cache_t *cache, cache_entry_t *entry);
+void cache_link(file_cache_t *cache, cache_entry_t *entry, size_t limit);
+void cache_evict(file_cache_t *cache, size_t need, size_t limit);
+size_t cache_charge(cache_entry_t *entry);
+void cache_serve(conn_t *conn, cache_entry_t *entry);
+void *cache_watch_thread(void *arg);
+unsigned long hash_string(const char *str);
+unsigned long hash_bytes(const void *data, size_t len);
+void format_file_headers(char *buf, size_t size, struct stat *st, char *etag, size_t etag_size,
+                         int gzip, int vary);
+int etag_matches(conn_t *conn, const char *etag);
+void http_date(time_t t, char *buf, size_t size);
+int parse_ranges(const char *header, off_t size, byte_range_t *ranges);
+int handle_range(conn_t *conn, const char *type, const char *etag, time_t mtime, off_t size,
+                 cache_entry_t *entry, int fd);
+void send_range_body(conn_t *conn, cache_entry_t *entry, int fd, byte_range_t *range);
+ssize_t conn_fill(conn_t *conn);
+int conn_flush(conn_t *conn);
+int conn_build_iov(conn_t *conn, struct iovec *iov, int *more);
+void conn_consume_output(conn_t *conn, size_t n);
+int conn_process(conn_t *conn);
+
+void run_blocking_loop(int serv_sock);
+void run_epoll_workers(int serv_sock);
+void *epoll_worker(void *arg);
+void accept_connections(worker_t *w);
+void handle_conn_event(worker_t *w, conn_t *conn, uint32_t events);
+void handle_cgi_event(worker_t *w, conn_t *conn, uint32_t events);
+void handle_epoll_events(worker_t *w, struct epoll_event *events, int n);
+void conn_dispatch(conn_t *conn);
+
+void timer_init(timer_wheel_t *wheel);
+void timer_add(timer_wheel_t *wheel, timer_node_t *node, uint64_t expire);
+void timer_remove(timer_wheel_t *wheel, timer_node_t *node);
+int timer_wait_msec(timer_wheel_t *wheel);
+void timer_run(worker_t *w);
+void conn_arm_timer(conn_t *conn);
+void conn_timeout(conn_t *conn);
+void cgi_timeout(conn_t *conn);
+int wait_readable(int fd, uint64_t deadline);
+
+int uring_init(uring_t *ring);
+int uring_setup(uring_t *ring);
+void uring_exit(uring_t *ring);
+int uring_supported(void);
+struct io_uring_sqe *uring_get_sqe(uring_t *ring);
+void uring_submit(uring_t *ring, int wait_msec);
+void uring_recycle_buf(uring_t *ring, unsigned bid);
+void *uring_worker(void *arg);
+void uring_arm_accept(worker_t *w);
+void uring_arm_epoll(worker_t *w);
+void uring_arm_recv(conn_t *conn);
+void uring_handle_cqe(worker_t *w, struct io_uring_cqe *cqe);
+void uring_conn_cqe(worker_t *w, conn_t *conn, uring_op_t op, struct io_uring_cqe *cqe);
+int uring_flush(conn_t *conn);
+
+thread_stats_t *stats_local(void);
+void stat_add(atomic_ullong *counter, unsigned long long n);
+uint64_t now_usec(void);
+void hist_record(histogram_t *hist, uint64_t value);
+uint64_t hist_percentile(histogram_t *hist, double q);
+void stats_request_start(conn_t *conn, int parsed);
+void stats_request_end(conn_t *conn);
+thread_stats_t *stats_merge(void);
+void hist_merge(histogram_t *dst, histogram_t *src);
+void handle_stats(conn_t *conn, const char *query);
+void stats_write_text(FILE *out, thread_stats_t *total);
+void stats_write_prometheus(FILE *out, thread_stats_t *total);
+
+void access_log_init(void);
+int access_log_open(void);
+log_ring_t *log_ring_local(void);
+void access_log_write(conn_t *conn, uint64_t usec);
+void *access_log_thread(void *arg);
+size_t access_log_format(char *buf, size_t size, log_record_t *rec);
+void access_log_flush(struct iovec *iov, int count);
+void access_log_rotate_check(void);
+void access_log_counts(unsigned long long *written, unsigned long long *dropped);
 
 
 // --- main 함수 ---
 int main(int argc, char *argv[]) {
-    int serv_sock, clnt_sock;
-    struct sockaddr_in serv_addr, clnt_addr;
-    socklen_t clnt_addr_size;
+    // 0. 명령행 옵션 처리 및 시그널 설정
+    parse_options(argc, argv);
+    signal(SIGPIPE, SIG_IGN); // 끊어진 소켓에 write 해도 서버가 종료되지 않도록
+
+    // 마스터/워커 모드: 마스터는 워커 프로세스만 관리하고, 각 워커가 자신의 리스닝 소켓으로 서비스
+    if (config.num_procs > 0)
+        run_master();
+    else
+        run_server();
+    return 0;
+}
+
+
+// --- 함수 정의 ---
+
+// 서버 본체: 리스닝 소켓을 열고 선택한 모드의 메인 루프 실행 (단일 프로세스 또는 워커 프로세스)
+void run_server(void) {
+    int serv_sock;
+    struct sockaddr_in serv_addr;
+
+    stats_started = time(NULL);
 
     // 1. 서버 소켓 생성 (TCP)
-    serv_sock = socket(PF_INET, SOCK_STREAM, 0);
+    // CGI 자식 프로세스에 리스닝 소켓이 상속되지 않도록 CLOEXEC 지정
+    serv_sock = socket(PF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
     if (serv_sock == -1)
         error_handling("소켓 생성 오류");
 
@@ -35,223 +842,4562 @@ int main(int argc, char *argv[]) {
     int opt = 1;
     setsockopt(serv_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
 
+    // 워커 프로세스마다 같은 포트에 따로 바인딩하면 커널이 새 연결을 나눠 줌
+    // (accept 큐와 잠금을 공유하지 않으므로 코어 수에 따라 확장)
+    if (config.num_procs > 0 && setsockopt(serv_sock, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) == -1)
+        error_handling("SO_REUSEPORT 설정 오류");
+
     // 2. 주소 정보 초기화 및 설정
     memset(&serv_addr, 0, sizeof(serv_addr));
     serv_addr.sin_family = AF_INET;
     serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    serv_addr.sin_port = htons(PORT);
+    serv_addr.sin_port = htons(config.port);
 
     // 3. 소켓에 주소 할당 (Binding)
     if (bind(serv_sock, (struct sockaddr*) &serv_addr, sizeof(serv_addr)) == -1)
         error_handling("bind() 오류");
 
     // 4. 연결 요청 대기 (Listening)
-    if (listen(serv_sock, 5) == -1)
+    if (listen(serv_sock, config.backlog) == -1)
         error_handling("listen() 오류");
-    
-    printf("간단 웹 서버가 포트 %d에서 실행 중...\n", PORT);
 
-    // 5. 메인 루프: 클라이언트 연결 수락
+    // 5. 정적 파일 캐시 및 파일 변경 감시, 상주 CGI 워커, 플러그인, 접근 로그 기록 쓰레드 준비
+    cache_init();
+    fcgi_pools_init();
+    plugins_init();
+    access_log_init();
+
+    // 6. 모드별 메인 루프 실행
+    if (config.mode == MODE_URING && !uring_supported()) {
+        printf("커널이 io_uring (multishot recv, 제공 버퍼 링)을 지원하지 않아 epoll 모드로 실행\n");
+        config.mode = MODE_EPOLL;
+    }
+    if (config.mode == MODE_BLOCKING) {
+        printf("간단 웹 서버가 포트 %d에서 실행 중... (blocking 모드)\n", config.port);
+        run_blocking_loop(serv_sock);
+    } else {
+        printf("간단 웹 서버가 포트 %d에서 실행 중... (%s 모드, 워커 %d개)\n",
+               config.port, config.mode == MODE_URING ? "io_uring" : "epoll", config.num_threads);
+        run_epoll_workers(serv_sock);
+    }
+
+    close(serv_sock);
+}
+
+// 마스터 프로세스: 워커 프로세스들을 띄우고, 죽은 워커는 다시 띄움
+// 캐시, 상주 CGI 풀, 쓰레드는 모두 워커 안에서 만들어지므로 한 워커의 장애가 다른 워커에 번지지 않음
+void run_master(void) {
+    pid_t *pids = calloc(config.num_procs, sizeof(pid_t));
+    time_t *started = calloc(config.num_procs, sizeof(time_t));
+    struct sigaction sa;
+
+    if (pids == NULL || started == NULL)
+        error_handling("워커 프로세스 목록 할당 오류");
+
+    // 1. 종료 시그널을 받으면 waitpid 에서 빠져나오도록 SA_RESTART 없이 처리기 등록
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = master_signal_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    // 2. 워커 프로세스 생성
+    for (int i = 0; i < config.num_procs; i++) {
+        pids[i] = spawn_server_process();
+        started[i] = time(NULL);
+    }
+    printf("마스터 프로세스(%d): 포트 %d, 워커 프로세스 %d개 x 쓰레드 %d개\n",
+           (int)getpid(), config.port, config.num_procs, config.num_threads);
+    fflush(stdout);
+
+    // 3. 워커가 종료되면 원인을 출력하고 같은 자리에 새 워커 생성
+    while (!master_stop) {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid == -1) {
+            if (errno == EINTR) continue;
+            error_handling("waitpid() 오류");
+        }
+
+        for (int i = 0; i < config.num_procs; i++) {
+            if (pids[i] != pid) continue;
+
+            if (WIFSIGNALED(status))
+                fprintf(stderr, "[마스터] 워커 %d 비정상 종료 (시그널 %d), 재시작\n", (int)pid, WTERMSIG(status));
+            else
+                fprintf(stderr, "[마스터] 워커 %d 종료 (코드 %d), 재시작\n", (int)pid, WEXITSTATUS(status));
+
+            // 시작하자마자 죽는 경우 (bind 실패 등) 재시작을 반복하며 CPU 를 태우지 않도록 잠시 대기
+            if (time(NULL) - started[i] < RESPAWN_DELAY)
+                sleep(RESPAWN_DELAY);
+            if (master_stop) break;
+            pids[i] = spawn_server_process();
+            started[i] = time(NULL);
+        }
+    }
+
+    // 4. 모든 워커에 종료 전달 후 회수
+    for (int i = 0; i < config.num_procs; i++)
+        if (pids[i] > 0)
+            kill(pids[i], SIGTERM);
+    while (waitpid(-1, NULL, 0) > 0 || errno == EINTR)
+        ;
+    free(pids);
+    free(started);
+}
+
+// 워커 프로세스 하나 생성: 자식은 마스터의 시그널 처리기를 되돌리고 서버 본체 실행
+pid_t spawn_server_process(void) {
+    pid_t pid = fork();
+
+    if (pid == -1) {
+        perror("fork() 오류");
+        return -1;
+    }
+    if (pid == 0) {
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        prctl(PR_SET_PDEATHSIG, SIGTERM); // 마스터가 죽으면 워커도 함께 종료
+        run_server();
+        exit(0);
+    }
+    return pid;
+}
+
+void master_signal_handler(int sig) {
+    (void)sig;
+    master_stop = 1;
+}
+
+// 사용법 출력
+void print_usage(const char *prog) {
+    fprintf(stderr,
+            "사용법: %s [옵션]\n"
+            "  -m, --mode epoll|uring|blocking  동작 모드 (기본 epoll, uring 은 미지원 시 epoll)\n"
+            "  -t, --threads N             epoll/io_uring 워커 쓰레드 수 (기본: CPU 코어 수)\n"
+            "  -p, --port N                포트 (기본 %d)\n"
+            "  -c, --cache MB              정적 파일 캐시 용량 (기본 %d, 0이면 끔)\n"
+            "      --fcgi URI              URI의 CGI를 상주 워커 풀로 실행 (여러 번 지정 가능)\n"
+            "      --fcgi-min N            스크립트별 최소 워커 수 (기본 %d)\n"
+            "      --fcgi-max N            스크립트별 최대 워커 수 (기본 %d)\n"
+            "      --fcgi-max-requests N   워커 교체 전 최대 요청 수 (기본 %d)\n"
+            "      --max-body MB           요청 본문 최대 크기 (기본 %d)\n"
+            "  -P, --processes N           마스터/워커 모드: SO_REUSEPORT 워커 프로세스 수\n"
+            "                              (기본 0 = 단일 프로세스, 지정 시 쓰레드 기본값은 1)\n"
+            "      --backlog N             listen() 대기열 길이 (기본 %d)\n"
+            "      --access-log PATH       접근 로그 파일 (기본 - = 표준 출력, off 면 끔)\n"
+            "      --access-log-max MB     접근 로그 파일 회전 크기 (기본 %d, 0이면 회전 안 함)\n"
+            "      --header-timeout SEC    요청 헤더 수신 제한 시간 (기본 %d, 0이면 끔)\n"
+            "      --body-timeout SEC      본문 수신/응답 전송이 멈춰 있을 수 있는 시간 (기본 %d)\n"
+            "      --keepalive-timeout SEC 요청 사이 유휴 연결 유지 시간 (기본 %d)\n"
+            "      --cgi-timeout SEC       CGI 실행 제한 시간, 넘으면 강제 종료 (기본 %d)\n"
+            "      --simd auto|avx2|sse2|scalar  헤더 파서의 구분자 탐색 구현 (기본 auto)\n"
+            "      --cgi-cache URI=SEC     URI의 CGI 응답을 같은 요청(쿼리, 본문)끼리 SEC초 동안 재사용\n"
+            "                              (여러 번 지정 가능, 동시에 온 같은 요청은 한 번만 실행)\n"
+            "      --cgi-cache-mb MB       CGI 응답 캐시 용량 (기본 %d)\n"
+            "      --max-conns N           동시 연결 수 한도, 넘으면 503 후 종료 (기본 0 = 제한 없음)\n"
+            "      --max-cgi N             동시에 실행할 CGI 수 한도, 넘으면 503 (기본 0 = 제한 없음)\n"
+            "      --retry-after SEC       과부하 503 응답의 Retry-After (기본 %d)\n"
+            "      --plugin PREFIX=FILE    PREFIX 아래 요청을 플러그인 디렉토리의 FILE(.so)이 워커 쓰레드 안에서 처리\n"
+            "                              (여러 번 지정 가능, 파일이 바뀌면 실행 중에 다시 로드)\n"
+            "      --plugin-dir DIR        플러그인 디렉토리 (기본 %s)\n",
+            prog, PORT, DEFAULT_CACHE_MB, config.fcgi_min, config.fcgi_max, config.fcgi_max_requests,
+            DEFAULT_MAX_BODY_MB, DEFAULT_BACKLOG, DEFAULT_LOG_MAX_MB, DEFAULT_HEADER_TIMEOUT,
+            DEFAULT_BODY_TIMEOUT, DEFAULT_KEEPALIVE_TIMEOUT, DEFAULT_CGI_TIMEOUT, DEFAULT_CGI_CACHE_MB,
+            DEFAULT_RETRY_AFTER, DEFAULT_PLUGIN_DIR);
+}
+
+// 명령행 옵션 처리
+void parse_options(int argc, char *argv[]) {
+    enum { OPT_FCGI = 256, OPT_FCGI_MIN, OPT_FCGI_MAX, OPT_FCGI_MAX_REQUESTS, OPT_MAX_BODY, OPT_BACKLOG,
+           OPT_ACCESS_LOG, OPT_ACCESS_LOG_MAX, OPT_HEADER_TIMEOUT, OPT_BODY_TIMEOUT, OPT_KEEPALIVE_TIMEOUT,
+           OPT_CGI_TIMEOUT, OPT_SIMD, OPT_CGI_CACHE, OPT_CGI_CACHE_MB,
+           OPT_MAX_CONNS, OPT_MAX_CGI, OPT_RETRY_AFTER, OPT_PLUGIN, OPT_PLUGIN_DIR };
+    static const struct option long_options[] = {
+        { "mode",              required_argument, NULL, 'm' },
+        { "threads",           required_argument, NULL, 't' },
+        { "port",              required_argument, NULL, 'p' },
+        { "cache",             required_argument, NULL, 'c' },
+        { "fcgi",              required_argument, NULL, OPT_FCGI },
+        { "fcgi-min",          required_argument, NULL, OPT_FCGI_MIN },
+        { "fcgi-max",          required_argument, NULL, OPT_FCGI_MAX },
+        { "fcgi-max-requests", required_argument, NULL, OPT_FCGI_MAX_REQUESTS },
+        { "max-body",          required_argument, NULL, OPT_MAX_BODY },
+        { "processes",         required_argument, NULL, 'P' },
+        { "backlog",           required_argument, NULL, OPT_BACKLOG },
+        { "access-log",        required_argument, NULL, OPT_ACCESS_LOG },
+        { "access-log-max",    required_argument, NULL, OPT_ACCESS_LOG_MAX },
+        { "header-timeout",    required_argument, NULL, OPT_HEADER_TIMEOUT },
+        { "body-timeout",      required_argument, NULL, OPT_BODY_TIMEOUT },
+        { "keepalive-timeout", required_argument, NULL, OPT_KEEPALIVE_TIMEOUT },
+        { "cgi-timeout",       required_argument, NULL, OPT_CGI_TIMEOUT },
+        { "simd",              required_argument, NULL, OPT_SIMD },
+        { "cgi-cache",         required_argument, NULL, OPT_CGI_CACHE },
+        { "cgi-cache-mb",      required_argument, NULL, OPT_CGI_CACHE_MB },
+        { "max-conns",         required_argument, NULL, OPT_MAX_CONNS },
+        { "max-cgi",           required_argument, NULL, OPT_MAX_CGI },
+        { "retry-after",       required_argument, NULL, OPT_RETRY_AFTER },
+        { "plugin",            required_argument, NULL, OPT_PLUGIN },
+        { "plugin-dir",        required_argument, NULL, OPT_PLUGIN_DIR },
+        { "help",              no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int c;
+
+    while ((c = getopt_long(argc, argv, "m:t:p:c:P:h", long_options, NULL)) != -1) {
+        switch (c) {
+        case 'm':
+            if (strcmp(optarg, "blocking") == 0)
+                config.mode = MODE_BLOCKING;
+            else if (strcmp(optarg, "epoll") == 0)
+                config.mode = MODE_EPOLL;
+            else if (strcmp(optarg, "uring") == 0)
+                config.mode = MODE_URING;
+            else
+                error_handling("알 수 없는 모드 (-m epoll|uring|blocking)");
+            break;
+        case 't':
+            config.num_threads = atoi(optarg);
+            break;
+        case 'p':
+            config.port = atoi(optarg);
+            break;
+        case 'c':
+            config.cache_size = (size_t)atol(optarg) * 1024 * 1024;
+            break;
+        case OPT_FCGI:
+            if (fcgi_pool_count == MAX_FCGI_POOLS || strncmp(optarg, "/cgi-bin/", 9) != 0)
+                error_handling("--fcgi 는 /cgi-bin/ 아래 스크립트만, 최대 16개까지 지정 가능");
+            snprintf(fcgi_pools[fcgi_pool_count].uri, sizeof(fcgi_pools[0].uri), "%s", optarg);
+            snprintf(fcgi_pools[fcgi_pool_count].path, sizeof(fcgi_pools[0].path), ".%s", optarg);
+            fcgi_pool_count++;
+            break;
+        case OPT_FCGI_MIN:
+            config.fcgi_min = atoi(optarg);
+            break;
+        case OPT_FCGI_MAX:
+            config.fcgi_max = atoi(optarg);
+            break;
+        case OPT_FCGI_MAX_REQUESTS:
+            config.fcgi_max_requests = atoi(optarg);
+            break;
+        case OPT_MAX_BODY:
+            config.max_body = (size_t)atol(optarg) * 1024 * 1024;
+            break;
+        case 'P':
+            config.num_procs = atoi(optarg);
+            break;
+        case OPT_BACKLOG:
+            config.backlog = atoi(optarg);
+            break;
+        case OPT_ACCESS_LOG:
+            config.access_log = strcmp(optarg, "off") == 0 ? NULL : optarg;
+            break;
+        case OPT_ACCESS_LOG_MAX:
+            config.access_log_max = (size_t)atol(optarg) * 1024 * 1024;
+            break;
+        case OPT_HEADER_TIMEOUT:
+            config.header_timeout = atoi(optarg);
+            break;
+        case OPT_BODY_TIMEOUT:
+            config.body_timeout = atoi(optarg);
+            break;
+        case OPT_KEEPALIVE_TIMEOUT:
+            config.keepalive_timeout = atoi(optarg);
+            break;
+        case OPT_CGI_TIMEOUT:
+            config.cgi_timeout = atoi(optarg);
+            break;
+        case OPT_SIMD:
+            config.simd = optarg;
+            break;
+        case OPT_CGI_CACHE: {
+            char *eq = strrchr(optarg, '=');
+            if (cgi_cache_rule_count == MAX_CGI_CACHE_RULES || strncmp(optarg, "/cgi-bin/", 9) != 0 ||
+                eq == NULL || atoi(eq + 1) <= 0 || eq - optarg >= (int)sizeof(cgi_cache_rules[0].path) - 1)
+                error_handling("--cgi-cache 는 /cgi-bin/스크립트=초 형식으로, 최대 16개까지 지정 가능");
+            cgi_cache_rule_t *rule = &cgi_cache_rules[cgi_cache_rule_count++];
+            snprintf(rule->path, sizeof(rule->path), ".%.*s", (int)(eq - optarg), optarg);
+            rule->ttl = atoi(eq + 1);
+            break;
+        }
+        case OPT_CGI_CACHE_MB:
+            config.cgi_cache_size = (size_t)atol(optarg) * 1024 * 1024;
+            break;
+        case OPT_MAX_CONNS:
+            config.max_conns = atoi(optarg);
+            break;
+        case OPT_MAX_CGI:
+            config.max_cgi = atoi(optarg);
+            break;
+        case OPT_RETRY_AFTER:
+            config.retry_after = atoi(optarg);
+            break;
+        case OPT_PLUGIN: {
+            char *eq = strchr(optarg, '=');
+            if (plugin_count == MAX_PLUGINS || optarg[0] != '/' || eq == NULL || eq[1] == '\0' ||
+                strchr(eq + 1, '/') || eq - optarg >= (int)sizeof(plugins[0].prefix) ||
+                strlen(eq + 1) >= sizeof(plugins[0].file))
+                error_handling("--plugin 은 /접두어=파일.so 형식으로, 최대 16개까지 지정 가능");
+            plugin_t *plugin = &plugins[plugin_count++];
+            size_t len = eq - optarg;
+            while (len > 1 && optarg[len - 1] == '/') // "/app/" 도 "/app" 과 같게
+                len--;
+            snprintf(plugin->prefix, sizeof(plugin->prefix), "%.*s", (int)len, optarg);
+            plugin->prefix_len = len;
+            snprintf(plugin->file, sizeof(plugin->file), "%s", eq + 1);
+            break;
+        }
+        case OPT_PLUGIN_DIR:
+            config.plugin_dir = optarg;
+            break;
+        default:
+            print_usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    if (config.fcgi_min < 0) config.fcgi_min = 0;
+    if (config.fcgi_max < 1) config.fcgi_max = 1;
+    if (config.fcgi_min > config.fcgi_max) config.fcgi_min = config.fcgi_max;
+
+    if (scan_delims_select(config.simd) == -1)
+        error_handling("이 CPU 에서 사용할 수 없는 --simd 값 (auto|avx2|sse2|scalar)");
+
+    if (config.max_conns < 0) config.max_conns = 0;
+    if (config.max_cgi < 0) config.max_cgi = 0;
+    if (config.retry_after < 0) config.retry_after = 0;
+    if (config.num_procs < 0) config.num_procs = 0;
+    if (config.backlog <= 0) config.backlog = DEFAULT_BACKLOG;
+
+    // 워커 수가 지정되지 않으면 CPU 코어 수만큼 생성 (마스터/워커 모드는 프로세스로 나누므로 1개)
+    if (config.num_threads <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        config.num_threads = (config.num_procs > 0 || cores <= 0) ? 1 : (int)cores;
+    }
+}
+
+// 기존 방식의 메인 루프: 클라이언트 하나를 끝까지 처리한 후 다음 연결 수락
+void run_blocking_loop(int serv_sock) {
+    struct sockaddr_in clnt_addr;
+    socklen_t clnt_addr_size;
+
     while (1) {
         clnt_addr_size = sizeof(clnt_addr);
-        clnt_sock = accept(serv_sock, (struct sockaddr*)&clnt_addr, &clnt_addr_size);
-        
+        int clnt_sock = accept4(serv_sock, (struct sockaddr*)&clnt_addr, &clnt_addr_size, SOCK_CLOEXEC);
+
         if (clnt_sock == -1) {
             perror("accept() 오류");
             continue;
         }
 
-        // 클라이언트 요청 처리
-        handle_request(clnt_sock);
-        
-        // 소켓 닫기
-        close(clnt_sock);
+        conn_t *conn = conn_create(clnt_sock);
+        if (conn == NULL) {
+            close(clnt_sock);
+            continue;
+        }
+
+        // 1. 요청이 완성될 때까지 수신 (헤더 타임아웃이 지나면 포기해 다음 클라이언트가 막히지 않도록)
+        uint64_t deadline = config.header_timeout > 0 ? now_usec() + config.header_timeout * 1000000ULL
+                                                      : UINT64_MAX;
+        parse_result_t pr;
+        while ((pr = http_parse(conn)) == PARSE_INCOMPLETE) {
+            if (!wait_readable(conn->fd, deadline)) {
+                stat_add(&stats_local()->timeouts[TIMEOUT_HEADER], 1);
+                if (conn->in.len > conn->in.off) {
+                    stats_request_start(conn, 0);
+                    conn->req.keep_alive = 0;
+                    send_error(conn, "408 Request Timeout");
+                    stats_request_end(conn);
+                }
+                break;
+            }
+            if (conn_fill(conn) <= 0) break;
+        }
+
+        // 응답을 캐시하는 CGI 요청과 플러그인 요청은 본문까지 받음 (못 받으면 캐시 없이 실행, 플러그인은 400)
+        while (pr == PARSE_OK && request_hold(conn)) {
+            conn_flush(conn); // 100 Continue
+            if (!wait_readable(conn->fd, deadline) || conn_fill(conn) <= 0) {
+                conn->held_base = NULL;
+                break;
+            }
+        }
+
+        // 2. 클라이언트 요청 처리 후 응답 전송 (이 모드는 요청 하나 후 연결 종료)
+        if (pr == PARSE_OK) {
+            handle_request(conn);
+            request_done(conn);
+            if (conn->cgi.active)
+                cgi_run_blocking(conn);
+        } else if (pr != PARSE_INCOMPLETE) {
+            stats_request_start(conn, 0);
+            send_error(conn, parse_error_status(pr));
+            stats_request_end(conn);
+        }
+        conn_flush(conn);
+
+        // 3. 소켓 닫기
+        conn_destroy(conn);
     }
-    
-    close(serv_sock);
-    return 0;
 }
 
+// epoll (또는 io_uring) 워커 쓰레드들을 생성하고 종료를 기다림
+void run_epoll_workers(int serv_sock) {
+    // 리스닝 소켓을 논블로킹으로 전환 (여러 워커가 동시에 accept 시도)
+    fcntl(serv_sock, F_SETFL, fcntl(serv_sock, F_GETFL) | O_NONBLOCK);
 
-// --- 함수 정의 ---
+    workers = calloc(config.num_threads, sizeof(worker_t));
+    if (workers == NULL)
+        error_handling("워커 메모리 할당 오류");
+    worker_count = config.num_threads;
 
-// 요청 처리 함수
-void handle_request(int clnt_sock) {
-    char buf[BUF_SIZE * 2]; // 넉넉하게 버퍼 확보
-    char method[10];
-    char uri[256];
-    char version[10];
-    int content_length = 0;
-    
-    // 1. 요청 메시지 수신 (헤더 및 본문 일부)
-    ssize_t bytes_read = read(clnt_sock, buf, sizeof(buf) - 1);
-    if (bytes_read <= 0) return;
-    buf[bytes_read] = '\0';
-    
-    // 2. 요청 라인 파싱 (메소드, URI, 버전)
-    // sscanf의 안전성을 위해 버퍼 크기를 제한하는 것이 좋으나, 교육용 예제이므로 단순화
-    sscanf(buf, "%s %s %s", method, uri, version);
-
-    // 3. Content-Length 헤더 추출 (POST 요청을 위해)
-    char *len_ptr = strstr(buf, "Content-Length: ");
-    if (len_ptr) {
-        // len_ptr 위치에서 Content-Length 값을 추출
-        sscanf(len_ptr, "Content-Length: %d", &content_length);
-    }
-
-    // 4. 요청 본문(Body) 시작 위치 찾기
-    char *body_start = strstr(buf, "\r\n\r\n");
-    char *post_data = (body_start) ? (body_start + 4) : NULL;
-    
-    printf("\n[요청 수신] %s %s (크기: %zd)\n", method, uri, bytes_read);
-
-    // 5. 메소드별 처리 분기
-    if (strcmp(method, "GET") == 0) {
-        handle_get(clnt_sock, uri);
-    } else if (strcmp(method, "POST") == 0) {
-        handle_post(clnt_sock, uri, post_data, content_length);
-    } else {
-        send_error(clnt_sock, "501 Not Implemented");
+    for (int i = 0; i < config.num_threads; i++) {
+        workers[i].id = i;
+        workers[i].listen_sock = serv_sock;
+        workers[i].epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (workers[i].epfd == -1)
+            error_handling("epoll_create1() 오류");
+
+        // 다른 쓰레드가 이 워커를 깨울 eventfd (io_uring 모드도 epoll 인스턴스를 통해 받음)
+        struct epoll_event ev;
+        workers[i].notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        workers[i].notify_ev_type = EV_NOTIFY;
+        ev.events = EPOLLIN;
+        ev.data.ptr = &workers[i].notify_ev_type;
+        if (workers[i].notify_fd == -1 || epoll_ctl(workers[i].epfd, EPOLL_CTL_ADD, workers[i].notify_fd, &ev) == -1)
+            error_handling("eventfd() 오류");
+        if (pthread_create(&workers[i].tid, NULL,
+                           config.mode == MODE_URING ? uring_worker : epoll_worker, &workers[i]) != 0)
+            error_handling("pthread_create() 오류");
     }
+
+    for (int i = 0; i < config.num_threads; i++)
+        pthread_join(workers[i].tid, NULL);
+    free(workers);
 }
 
-// GET 요청 처리: 정적 파일 응답
-void handle_get(int clnt_sock, char *uri) {
-    char file_path[256] = "."; // 현재 디렉토리를 문서 루트로 가정
-    char read_buf[BUF_SIZE];
-    
-    // 1. URI 정규화: "/"는 기본 파일로 대체
-    if (strcmp(uri, "/") == 0) {
-        strcat(file_path, "/index.html"); 
-    } else {
-        strcat(file_path, uri);
+// 워커 쓰레드 본체: 자신의 epoll 인스턴스로 이벤트를 기다리며 연결을 처리
+void *epoll_worker(void *arg) {
+    worker_t *w = arg;
+    struct epoll_event events[MAX_EVENTS];
+    struct epoll_event ev;
+
+    // 1. 공유 리스닝 소켓 등록
+    // EPOLLEXCLUSIVE: 새 연결 하나에 모든 워커가 깨어나는 thundering herd 방지
+    ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+    ev.data.ptr = NULL; // data.ptr == NULL 이면 리스닝 소켓
+    if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->listen_sock, &ev) == -1)
+        error_handling("epoll_ctl() 오류");
+
+    // 2. 이벤트 루프: 타이머가 걸려 있으면 다음 tick 까지만 기다림
+    timer_init(&w->wheel);
+    while (1) {
+        int n = epoll_wait(w->epfd, events, MAX_EVENTS, timer_wait_msec(&w->wheel));
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            error_handling("epoll_wait() 오류");
+        }
+
+        w->wheel.now = now_usec() / 1000;
+        handle_epoll_events(w, events, n);
+        timer_run(w);
+
+        // 3. 이번 이벤트 처리 중에 닫힌 연결 해제 (같은 배치에 남은 이벤트가 없으므로 안전)
+        while (w->dead_conns) {
+            conn_t *conn = w->dead_conns;
+            w->dead_conns = conn->next_dead;
+            conn_free(conn);
+        }
     }
-    
-    // 2. 파일 열기 및 응답
-    FILE *fp = fopen(file_path, "r");
-    if (fp == NULL) {
-        send_error(clnt_sock, "404 Not Found");
-        return;
+    return NULL;
+}
+
+// epoll_wait 결과 처리: data.ptr 가 가리키는 태그로 이벤트 출처를 구분
+void handle_epoll_events(worker_t *w, struct epoll_event *events, int n) {
+    for (int i = 0; i < n; i++) {
+        ev_type_t *type = events[i].data.ptr;
+        if (type == NULL)
+            accept_connections(w);
+        else if (*type == EV_CONN)
+            handle_conn_event(w, (conn_t *)type, events[i].events);
+        else if (*type == EV_CGI)
+            handle_cgi_event(w, (conn_t *)((char *)type - offsetof(conn_t, cgi)), events[i].events);
+        else if (*type == EV_NOTIFY)
+            cgi_cache_wake(w);
+        else
+            handle_cgi_event(w, (conn_t *)((char *)type - offsetof(conn_t, cgi.in_ev_type)), EPOLLOUT);
     }
+}
+
+// 대기 중인 연결을 모두 수락하여 이 워커의 epoll에 등록
+void accept_connections(worker_t *w) {
+    while (1) {
+        int clnt_sock = accept4(w->listen_sock, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clnt_sock == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                perror("accept() 오류");
+            return;
+        }
 
-    // 3. HTTP 헤더 전송 (200 OK)
-    char header[] = "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\n\r\n";
-    write(clnt_sock, header, strlen(header));
+        conn_t *conn = conn_create(clnt_sock);
+        if (conn == NULL) {
+            close(clnt_sock);
+            continue;
+        }
+        conn->worker = w;
+        conn->last_active = conn->header_start = w->wheel.now;
 
-    // 4. 파일 내용 전송
-    while (!feof(fp)) {
-        size_t bytes_read = fread(read_buf, 1, BUF_SIZE, fp);
-        if (bytes_read > 0) {
-            write(clnt_sock, read_buf, bytes_read);
+        // 엣지 트리거로 읽기/쓰기 이벤트를 한 번에 등록
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = conn;
+        if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, clnt_sock, &ev) == -1) {
+            perror("epoll_ctl() 오류");
+            conn_destroy(conn);
+            continue;
         }
+        conn_arm_timer(conn);
     }
+}
+
+// 클라이언트 소켓 이벤트 처리
+void handle_conn_event(worker_t *w, conn_t *conn, uint32_t events) {
+    (void)w;
 
-    fclose(fp);
-    printf("[응답] GET: 200 OK (%s)\n", file_path);
+    if (conn->dead) return;
+    if (events & EPOLLERR)
+        conn_destroy(conn); // close() 시 epoll에서도 자동 제거
+    else
+        conn_dispatch(conn);
 }
 
-// POST 요청 처리 및 CGI 실행
-void handle_post(int clnt_sock, char *uri, char *post_data, int content_length) {
-    // CGI 경로 검사
-    if (strncmp(uri, "/cgi-bin/", 9) == 0) {
-        char cgi_path[256] = ".";
-        strcat(cgi_path, uri);
-        
-        printf("[POST] Content-Length: %d\n", content_length);
+// CGI 이벤트 처리: 출력은 읽은 만큼 클라이언트로 전달, 표준 입력이 비면 본문 전달 재개
+// (상주 워커는 한 소켓으로 주고받으므로 EPOLLIN 과 EPOLLOUT 이 같은 이벤트로 옴)
+void handle_cgi_event(worker_t *w, conn_t *conn, uint32_t events) {
+    (void)w;
+
+    if (conn->dead || !conn->cgi.active) return;
+    if (events & EPOLLOUT)
+        cgi_on_writable(conn);
+    if ((events & ~EPOLLOUT) && conn->cgi.active)
+        cgi_on_readable(conn);
+    conn_dispatch(conn);
+}
+
+// 이벤트 처리 후 공통: 연결을 진행시키고, 닫지 않으면 바뀐 상태에 맞게 타이머를 다시 정함
+void conn_dispatch(conn_t *conn) {
+    if (conn_process(conn) == -1)
+        conn_destroy(conn);
+    else
+        conn_arm_timer(conn);
+}
+
+// --- 타임아웃 (해시 타이머 휠) ---
+
+void timer_init(timer_wheel_t *wheel) {
+    for (int i = 0; i < TIMER_SLOTS; i++)
+        wheel->slots[i].prev = wheel->slots[i].next = &wheel->slots[i];
+    wheel->now = now_usec() / 1000;
+    wheel->tick = wheel->now / TIMER_TICK_MS;
+    wheel->count = 0;
+}
+
+// 만료 시각이 속한 tick 의 칸에 추가 (이미 지난 시각이면 다음 처리할 칸)
+void timer_add(timer_wheel_t *wheel, timer_node_t *node, uint64_t expire) {
+    uint64_t tick = (expire + TIMER_TICK_MS - 1) / TIMER_TICK_MS; // 일찍 울리지 않도록 올림
+    if (tick < wheel->tick)
+        tick = wheel->tick;
+
+    timer_node_t *head = &wheel->slots[tick & (TIMER_SLOTS - 1)];
+    node->expire = expire;
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+    wheel->count++;
+}
+
+void timer_remove(timer_wheel_t *wheel, timer_node_t *node) {
+    if (node->next == NULL) return;
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = NULL;
+    wheel->count--;
+}
+
+// 이벤트 대기 시간: 다음 tick 까지 (걸린 타이머가 없으면 무기한)
+int timer_wait_msec(timer_wheel_t *wheel) {
+    if (wheel->count == 0) return -1;
+
+    uint64_t now = now_usec() / 1000, next = wheel->tick * TIMER_TICK_MS;
+    return next > now ? (int)(next - now) : 0;
+}
+
+// 지금 시각까지의 칸을 차례로 처리 (칸을 통째로 떼어 낸 뒤 처리하므로 처리 중 다시 걸어도 안전)
+// 한 바퀴 넘게 밀렸으면 모든 칸을 한 번씩만 보면 충분
+void timer_run(worker_t *w) {
+    timer_wheel_t *wheel = &w->wheel;
+    uint64_t target = wheel->now / TIMER_TICK_MS;
+    int slots = 0;
+
+    while (wheel->tick <= target && slots++ < TIMER_SLOTS) {
+        timer_node_t *head = &wheel->slots[wheel->tick++ & (TIMER_SLOTS - 1)];
+        if (head->next == head) continue;
+
+        timer_node_t due = { head->prev, head->next, 0 };
+        due.next->prev = &due;
+        due.prev->next = &due;
+        head->prev = head->next = head;
+
+        while (due.next != &due) {
+            timer_node_t *node = due.next;
+            node->prev->next = node->next;
+            node->next->prev = node->prev;
+            node->prev = node->next = NULL;
+            wheel->count--;
 
-        // POST 데이터가 존재하면 쿼리 스트링으로 사용
-        char query_string[BUF_SIZE] = "";
-        if (post_data) {
-            strncpy(query_string, post_data, BUF_SIZE - 1);
-            query_string[BUF_SIZE - 1] = '\0';
+            if (node->expire > wheel->now) // 한 바퀴 이상 남은 타이머
+                timer_add(wheel, node, node->expire);
+            else
+                conn_timeout((conn_t *)((char *)node - offsetof(conn_t, timer)));
         }
+    }
+    if (wheel->tick <= target)
+        wheel->tick = target + 1;
+}
 
-        execute_cgi(clnt_sock, cgi_path, query_string);
+// 연결 상태에 맞는 타임아웃 종류와 만료 시각을 정해 타이머에 반영 (이벤트를 처리할 때마다 호출)
+// 만료 시각이 늦춰지기만 하면 (대부분의 활동) 값만 바꾸고, 앞당겨질 때만 휠에서 옮김
+void conn_arm_timer(conn_t *conn) {
+    timer_wheel_t *wheel = &conn->worker->wheel;
+    uint64_t since;
+    int secs;
+
+    if (conn->cgi.active || conn->cache_wait) {
+        conn->timer_kind = TIMEOUT_CGI;
+        since = conn->cgi.started / 1000;
+        secs = config.cgi_timeout;
+        // 업로드 중이면 본문 수신이 멈춘 것도 감시 (둘 중 먼저 오는 쪽)
+        if (conn->body_left > 0 && config.body_timeout > 0 &&
+            (secs <= 0 || conn->last_active + config.body_timeout * 1000ULL < since + secs * 1000ULL)) {
+            conn->timer_kind = TIMEOUT_BODY;
+            since = conn->last_active;
+            secs = config.body_timeout;
+        }
+    } else if (conn->out_head || conn->body_left > 0) {
+        conn->timer_kind = TIMEOUT_BODY;
+        since = conn->last_active;
+        secs = config.body_timeout;
+    } else if (conn->in.len > conn->in.off || conn->header_start) {
+        if (conn->header_start == 0)
+            conn->header_start = wheel->now;
+        conn->timer_kind = TIMEOUT_HEADER;
+        since = conn->header_start; // 조금씩 보내도 연장되지 않음 (slowloris)
+        secs = config.header_timeout;
     } else {
-        send_error(clnt_sock, "404 Not Found");
+        conn->timer_kind = TIMEOUT_KEEPALIVE;
+        since = conn->last_active;
+        secs = config.keepalive_timeout;
+    }
+
+    conn->deadline = secs > 0 ? since + (uint64_t)secs * 1000 : 0;
+    if (conn->deadline && (conn->timer.next == NULL || conn->deadline < conn->timer.expire)) {
+        timer_remove(wheel, &conn->timer);
+        timer_add(wheel, &conn->timer, conn->deadline);
     }
 }
 
-// CGI 프로그램 실행
-void execute_cgi(int clnt_sock, char *path, char *query_string) {
-    int cgi_output[2];
-    int pid;
-    
-    // 1. CGI 프로그램이 결과를 보낼 파이프 생성
-    if (pipe(cgi_output) < 0) {
-        send_error(clnt_sock, "500 Internal Server Error");
-        perror("pipe() 오류");
+// 타이머가 울림: 그 사이 활동으로 연장됐으면 다시 걸고, 아니면 종류에 맞게 정리
+void conn_timeout(conn_t *conn) {
+    timer_wheel_t *wheel = &conn->worker->wheel;
+
+    if (conn->deadline == 0) return; // 타임아웃이 필요 없는 상태가 됨
+    if (conn->deadline > wheel->now) {
+        timer_add(wheel, &conn->timer, conn->deadline);
         return;
     }
 
-    // 2. 자식 프로세스 생성
-    if ((pid = fork()) < 0) {
-        send_error(clnt_sock, "500 Internal Server Error");
-        perror("fork() 오류");
+    stat_add(&stats_local()->timeouts[conn->timer_kind], 1);
+    if (conn->timer_kind == TIMEOUT_CGI) {
+        cgi_timeout(conn);
+    } else if (conn->timer_kind == TIMEOUT_HEADER && conn->in.len > conn->in.off) {
+        // 헤더를 보내다 멈춤: 408 을 보내고 종료 (전송도 멈추면 본문 타임아웃으로 닫힘)
+        stats_request_start(conn, 0);
+        conn->req.keep_alive = 0;
+        conn->closing = 1;
+        send_error(conn, "408 Request Timeout");
+        stats_request_end(conn);
+    } else {
+        conn_destroy(conn); // 유휴 연결이나 읽지 않는 클라이언트는 조용히 닫음
         return;
     }
+    conn_dispatch(conn);
+}
 
-    if (pid == 0) { // 자식 프로세스 (CGI 실행)
-        // 3. CGI의 표준 출력(stdout)을 파이프의 쓰기 종단에 연결
-        close(cgi_output[0]); // 읽기 종단 닫기
-        dup2(cgi_output[1], STDOUT_FILENO); // stdout을 파이프의 쓰기 종단으로 리다이렉션
-        
-        // 4. CGI 환경 변수 설정
-        setenv("REQUEST_METHOD", "POST", 1);
-        setenv("QUERY_STRING", query_string, 1);
-        
-        // 5. CGI 프로그램 실행 (exec)
-        execlp(path, path, NULL);
-        
-        // execlp 실패 시 에러 출력 및 종료
-        exit(1);
-        
-    } else { // 부모 프로세스 (웹 서버)
-        int status;
-        char cgi_buf[BUF_SIZE];
-        ssize_t bytes_read;
-        
-        // 3. 파이프의 쓰기 종단 닫기
-        close(cgi_output[1]); 
-        
-        // 4. CGI 실행 완료 대기
-        waitpid(pid, &status, 0);
-
-        // 5. CGI 실행 결과 수신
-        char header[] = "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\n\r\n";
-        write(clnt_sock, header, strlen(header));
-        
-        printf("[응답] CGI: 200 OK (쿼리: %s)\n", query_string);
-
-        // 6. 파이프에서 CGI 출력 결과를 읽어 클라이언트에게 전송
-        while ((bytes_read = read(cgi_output[0], cgi_buf, BUF_SIZE)) > 0) {
-            write(clnt_sock, cgi_buf, bytes_read);
-        }
-        
-        close(cgi_output[0]);
+// blocking 모드: deadline(µs)까지 fd 가 읽기 가능해지기를 기다림. 1: 읽기 가능, 0: 시간 초과
+int wait_readable(int fd, uint64_t deadline) {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+
+    while (1) {
+        uint64_t now = now_usec();
+        if (now >= deadline) return 0;
+        int n = poll(&pfd, 1, (int)((deadline - now + 999) / 1000));
+        if (n > 0) return 1;
+        if (n == -1 && errno != EINTR) return 1; // 오류는 이어지는 read 가 알려 줌
     }
 }
 
-// HTTP 에러 응답 전송
-void send_error(int clnt_sock, char *status) {
-    char header[BUF_SIZE];
-    char body[BUF_SIZE];
+// --- io_uring 백엔드 ---
+// 워커마다 링 하나: multishot accept 로 연결을 받고, multishot recv 가 제공 버퍼에 채운 데이터를
+// 수신 버퍼로 옮긴 뒤 epoll 모드와 같은 conn_process 로 처리. 응답은 sendmsg, 파일은 read -> send 를
+// 연결(IOSQE_IO_LINK)해서 제출하며, 한 번의 이벤트 처리 동안 쌓인 요청은 io_uring_enter 한 번으로 제출
+// CGI fd 는 기존 epoll 인스턴스에 그대로 등록하고, 그 epoll fd 자체를 링에서 multishot poll 로 감시
 
-    // 응답 본문 생성
-    sprintf(body, "<html><head><title>오류</title></head><body><h1>%s</h1><p>요청한 자원을 처리할 수 없습니다.</p></body></html>", status);
-    
-    // 응답 헤더 생성
-    sprintf(header, "HTTP/1.1 %s\r\nContent-Type: text/html\r\nContent-Length: %zu\r\n\r\n", status, strlen(body));
+// 링 생성. 실패 시 (커널 미지원 포함) 만들던 자원을 정리하고 -1
+int uring_init(uring_t *ring) {
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+    if (uring_setup(ring) == -1) {
+        uring_exit(ring);
+        return -1;
+    }
+    return 0;
+}
 
-    // 헤더와 본문 전송
-    write(clnt_sock, header, strlen(header));
-    write(clnt_sock, body, strlen(body));
-    
-    printf("[응답] 오류: %s\n", status);
+// 제출/완료 큐 매핑, 필요한 연산 지원 확인, 수신용 제공 버퍼 링 등록
+int uring_setup(uring_t *ring) {
+    struct io_uring_params params;
+    static const int required_ops[] = {
+        IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG, IORING_OP_SEND, IORING_OP_READ,
+        IORING_OP_POLL_ADD, IORING_OP_ASYNC_CANCEL,
+        IORING_OP_SEND_ZC // multishot recv 와 같은 커널(6.0)에서 추가됨: 버전 확인용
+    };
+
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = URING_ENTRIES * 4; // multishot 요청은 완료가 여러 번 오므로 넉넉히
+    ring->fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params); // ENOSYS, EPERM 이면 미지원
+    if (ring->fd == -1)
+        return -1;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP) ||
+        !(params.features & IORING_FEAT_EXT_ARG))
+        return -1;
+
+    // 1. 제출/완료 큐 매핑
+    size_t sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ring_len = sq_len > cq_len ? sq_len : cq_len;
+    ring->ring_ptr = mmap(NULL, ring->ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring->fd, IORING_OFF_SQ_RING);
+    if (ring->ring_ptr == MAP_FAILED) {
+        ring->ring_ptr = NULL;
+        return -1;
+    }
+    ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        return -1;
+    }
+
+    char *p = ring->ring_ptr;
+    ring->sq_entries = params.sq_entries;
+    ring->sq_head = (unsigned *)(p + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(p + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(p + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(p + params.sq_off.array);
+    ring->sq_local = *ring->sq_tail;
+    ring->cq_head = (unsigned *)(p + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(p + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(p + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(p + params.cq_off.cqes);
+
+    // 2. 필요한 연산을 커널이 지원하는지 확인
+    size_t probe_size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, probe_size);
+    if (probe == NULL)
+        return -1;
+    int ok = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    for (size_t i = 0; ok && i < sizeof(required_ops) / sizeof(required_ops[0]); i++)
+        ok = required_ops[i] <= probe->last_op && (probe->ops[required_ops[i]].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    if (!ok)
+        return -1;
+
+    // 3. 제공 버퍼 링 등록: recv 마다 버퍼를 미리 잡아 두지 않고 데이터가 올 때 커널이 고름
+    ring->br = mmap(NULL, URING_BUFS * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring->br == MAP_FAILED) {
+        ring->br = NULL;
+        return -1;
+    }
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long)ring->br;
+    reg.ring_entries = URING_BUFS;
+    reg.bgid = 0;
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1)
+        return -1;
+    ring->bufs = malloc((size_t)URING_BUFS * URING_BUF_SIZE);
+    if (ring->bufs == NULL)
+        return -1;
+    for (unsigned i = 0; i < URING_BUFS; i++)
+        uring_recycle_buf(ring, i);
+    return 0;
 }
 
-void error_handling(char *message) {
-    fputs(message, stderr);
-    fputc('\n', stderr);
-    exit(1);
-}
\ No newline at end of file
+void uring_exit(uring_t *ring) {
+    if (ring->sqes)
+        munmap(ring->sqes, ring->sqes_len);
+    if (ring->ring_ptr)
+        munmap(ring->ring_ptr, ring->ring_len);
+    if (ring->br)
+        munmap(ring->br, URING_BUFS * sizeof(struct io_uring_buf));
+    free(ring->bufs);
+    if (ring->fd != -1)
+        close(ring->fd);
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+// 시작 시 한 번 확인: 커널이 필요한 기능을 모두 지원하는지
+int uring_supported(void) {
+    uring_t ring;
+
+    if (uring_init(&ring) == -1)
+        return 0;
+    uring_exit(&ring);
+    return 1;
+}
+
+// 빈 SQE 하나 확보 (제출 큐가 가득 차면 먼저 제출해 자리를 만듦)
+struct io_uring_sqe *uring_get_sqe(uring_t *ring) {
+    if (ring->sq_local - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) == ring->sq_entries)
+        uring_submit(ring, 0);
+
+    unsigned idx = ring->sq_local & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[idx] = idx;
+    ring->sq_local++;
+    return sqe;
+}
+
+// 채워 둔 SQE 를 커널에 공개하고 제출
+// wait_msec: 완료가 하나 이상 생길 때까지 기다릴 시간 (0: 기다리지 않음, -1: 무기한)
+void uring_submit(uring_t *ring, int wait_msec) {
+    __atomic_store_n(ring->sq_tail, ring->sq_local, __ATOMIC_RELEASE);
+    unsigned to_submit = ring->sq_local - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (to_submit == 0 && wait_msec == 0)
+        return;
+
+    unsigned flags = wait_msec ? IORING_ENTER_GETEVENTS : 0;
+    struct __kernel_timespec ts = { wait_msec / 1000, (wait_msec % 1000) * 1000000L };
+    struct io_uring_getevents_arg arg = { 0, 0, 0, (unsigned long)&ts };
+    if (wait_msec > 0)
+        flags |= IORING_ENTER_EXT_ARG; // 제한 시간은 확장 인자로 전달 (시간이 지나면 -ETIME)
+
+    if (syscall(__NR_io_uring_enter, ring->fd, to_submit, wait_msec ? 1 : 0, flags,
+                wait_msec > 0 ? &arg : NULL, wait_msec > 0 ? sizeof(arg) : 0) == -1 &&
+        errno != EINTR && errno != EAGAIN && errno != EBUSY && errno != ETIME)
+        error_handling("io_uring_enter() 오류");
+}
+
+// 다 쓴 제공 버퍼를 링에 돌려줌
+void uring_recycle_buf(uring_t *ring, unsigned bid) {
+    struct io_uring_buf *buf = &ring->br->bufs[ring->br_tail & (URING_BUFS - 1)];
+    buf->addr = (unsigned long)(ring->bufs + (size_t)bid * URING_BUF_SIZE);
+    buf->len = URING_BUF_SIZE;
+    buf->bid = bid;
+    ring->br_tail++;
+    __atomic_store_n(&ring->br->tail, ring->br_tail, __ATOMIC_RELEASE);
+}
+
+// io_uring 워커 쓰레드 본체: 제출과 완료 대기를 한 번의 io_uring_enter 로 처리
+void *uring_worker(void *arg) {
+    worker_t *w = arg;
+
+    // 1. 링 생성 후 공유 리스닝 소켓과 CGI 용 epoll fd 감시 시작
+    w->ring = malloc(sizeof(uring_t));
+    if (w->ring == NULL || uring_init(w->ring) == -1)
+        error_handling("io_uring 초기화 오류");
+    uring_arm_accept(w);
+    uring_arm_epoll(w);
+
+    // 2. 이벤트 루프: 타이머가 걸려 있으면 다음 tick 까지만 기다림
+    timer_init(&w->wheel);
+    while (1) {
+        uring_submit(w->ring, timer_wait_msec(&w->wheel));
+        w->wheel.now = now_usec() / 1000;
+
+        unsigned head = *w->ring->cq_head;
+        while (head != __atomic_load_n(w->ring->cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe cqe = w->ring->cqes[head & *w->ring->cq_mask];
+            head++;
+            __atomic_store_n(w->ring->cq_head, head, __ATOMIC_RELEASE);
+            uring_handle_cqe(w, &cqe);
+        }
+        timer_run(w);
+
+        // 3. 이번 완료 처리 중에 닫혔고 걸린 요청도 없는 연결 해제
+        while (w->dead_conns) {
+            conn_t *conn = w->dead_conns;
+            w->dead_conns = conn->next_dead;
+            conn_free(conn);
+        }
+    }
+    return NULL;
+}
+
+void uring_arm_accept(worker_t *w) {
+    struct io_uring_sqe *sqe = uring_get_sqe(w->ring);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = w->listen_sock;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = URING_ACCEPT;
+}
+
+void uring_arm_epoll(worker_t *w) {
+    struct io_uring_sqe *sqe = uring_get_sqe(w->ring);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = w->epfd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = URING_EPOLL;
+}
+
+// multishot recv 걸기 (이미 걸려 있으면 무시). conn_fill 에서 읽을 필요가 있을 때 호출
+void uring_arm_recv(conn_t *conn) {
+    if (conn->recv_armed) return;
+
+    struct io_uring_sqe *sqe = uring_get_sqe(conn->worker->ring);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = (unsigned long)conn | URING_RECV;
+    conn->recv_armed = 1;
+    conn->inflight++;
+}
+
+// 완료 이벤트 처리: user_data 로 출처를 구분
+void uring_handle_cqe(worker_t *w, struct io_uring_cqe *cqe) {
+    conn_t *conn = (conn_t *)(unsigned long)(cqe->user_data & ~7UL);
+    uring_op_t op = cqe->user_data & 7;
+
+    if (conn) {
+        uring_conn_cqe(w, conn, op, cqe);
+    } else if (op == URING_ACCEPT) {
+        if (cqe->res >= 0) {
+            conn = conn_create(cqe->res);
+            if (conn == NULL) {
+                close(cqe->res);
+            } else {
+                conn->worker = w;
+                conn->last_active = conn->header_start = w->wheel.now;
+                conn_dispatch(conn); // 첫 recv 걸기
+            }
+        } else if (cqe->res != -EAGAIN && cqe->res != -EINTR) {
+            fprintf(stderr, "accept() 오류: %s\n", strerror(-cqe->res));
+        }
+        if (!(cqe->flags & IORING_CQE_F_MORE))
+            uring_arm_accept(w);
+    } else if (op == URING_EPOLL) {
+        // CGI fd 는 레벨 트리거라 한 번에 다 읽지 못하면 다음 poll 완료에서 이어서 처리
+        struct epoll_event events[MAX_EVENTS];
+        int n;
+        do {
+            n = epoll_wait(w->epfd, events, MAX_EVENTS, 0);
+            if (n > 0)
+                handle_epoll_events(w, events, n);
+        } while (n == MAX_EVENTS);
+        if (!(cqe->flags & IORING_CQE_F_MORE))
+            uring_arm_epoll(w);
+    }
+}
+
+// 연결의 요청 완료 처리
+void uring_conn_cqe(worker_t *w, conn_t *conn, uring_op_t op, struct io_uring_cqe *cqe) {
+    int res = cqe->res;
+
+    // 1. 완료 회계: multishot recv 는 F_MORE 가 없는 마지막 완료에서만 끝난 것으로 봄
+    if (op == URING_RECV) {
+        if (cqe->flags & IORING_CQE_F_BUFFER) {
+            unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            if (!conn->dead && res > 0) {
+                stat_add(&stats_local()->bytes_in, res);
+                conn->last_active = w->wheel.now;
+                if (buffer_append(&conn->in, w->ring->bufs + (size_t)bid * URING_BUF_SIZE, res) == -1)
+                    res = -ENOMEM;
+            }
+            uring_recycle_buf(w->ring, bid);
+        }
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            conn->recv_armed = 0;
+            conn->recv_cancel = 0;
+            conn->inflight--;
+        }
+    } else {
+        conn->inflight--;
+    }
+
+    if (conn->dead) {
+        if (conn->inflight == 0) {
+            conn->next_dead = w->dead_conns;
+            w->dead_conns = conn;
+        }
+        return;
+    }
+
+    // 2. 종류별 처리
+    if (op == URING_RECV) {
+        if (res == 0) {
+            conn->peer_closed = 1;
+        } else if (res < 0 && res != -ENOBUFS && res != -ECANCELED) {
+            conn_destroy(conn);
+            return;
+        }
+        // 수신 버퍼가 한도에 차면 recv 를 취소 (처리해서 자리가 나면 conn_fill 이 다시 검)
+        if (res > 0 && conn->recv_armed && !conn->recv_cancel &&
+            conn->in.len - conn->in.off >= MAX_REQUEST_SIZE) {
+            struct io_uring_sqe *sqe = uring_get_sqe(w->ring);
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = (unsigned long)conn | URING_RECV;
+            sqe->user_data = URING_IGNORE;
+            conn->recv_cancel = 1;
+        }
+    } else if (op == URING_READ) {
+        return; // 짧게 읽히면 연결된 send 가 -ECANCELED 로 끝나므로 거기서 처리
+    } else if (op == URING_SEND) {
+        conn->send_inflight = 0;
+        if (res <= 0) { // 파일이 잘려 읽기가 짧았던 경우(-ECANCELED) 포함
+            conn_destroy(conn);
+            return;
+        }
+        stat_add(&stats_local()->bytes_out, res);
+        conn->last_active = w->wheel.now;
+        if (conn->io->file_send) {
+            out_seg_t *seg = conn->out_head;
+            seg->file_off += res;
+            seg->file_left -= res;
+            if (seg->file_left == 0)
+                conn_pop_seg(conn);
+        } else {
+            conn_consume_output(conn, res);
+        }
+    }
+
+    // 3. epoll 모드와 같은 처리 (다음 요청 파싱, 다음 전송 제출)
+    conn_dispatch(conn);
+}
+
+// io_uring 모드의 conn_flush: 전송이 진행 중이 아니면 다음 조각 전송을 제출
+// 반환값 1: 보낼 것이 없음, 0: 전송 진행 중 (완료 시 conn_process 가 다시 호출됨), -1: 오류
+int uring_flush(conn_t *conn) {
+    uring_t *ring = conn->worker->ring;
+    out_seg_t *seg = conn->out_head;
+
+    if (conn->send_inflight) return 0;
+    if (seg == NULL) return 1;
+    if (conn->io == NULL && (conn->io = calloc(1, sizeof(uring_io_t))) == NULL)
+        return -1;
+
+    uring_io_t *io = conn->io;
+    if (seg->type != SEG_FILE) {
+        // 1. 연속된 메모리/캐시 조각을 sendmsg 하나로 (MSG_WAITALL: 커널이 끝까지 보냄)
+        int more;
+        memset(&io->msg, 0, sizeof(io->msg));
+        io->msg.msg_iov = io->iov;
+        io->msg.msg_iovlen = conn_build_iov(conn, io->iov, &more);
+
+        struct io_uring_sqe *sqe = uring_get_sqe(ring);
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = conn->fd;
+        sqe->addr = (unsigned long)&io->msg;
+        sqe->msg_flags = MSG_WAITALL | (more ? MSG_MORE : 0);
+        sqe->user_data = (unsigned long)conn | URING_SEND;
+        io->file_send = 0;
+        conn->inflight++;
+    } else {
+        // 2. 파일 조각: read 와 send 를 연결해 한 번에 제출 (읽기가 끝나면 커널이 바로 전송)
+        size_t len = seg->file_left < URING_FILE_CHUNK ? seg->file_left : URING_FILE_CHUNK;
+        if (io->file_buf == NULL && (io->file_buf = malloc(URING_FILE_CHUNK)) == NULL)
+            return -1;
+
+        struct io_uring_sqe *sqe = uring_get_sqe(ring);
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = seg->file_fd;
+        sqe->addr = (unsigned long)io->file_buf;
+        sqe->len = len;
+        sqe->off = seg->file_off;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->user_data = (unsigned long)conn | URING_READ;
+
+        sqe = uring_get_sqe(ring);
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = conn->fd;
+        sqe->addr = (unsigned long)io->file_buf;
+        sqe->len = len;
+        sqe->msg_flags = MSG_WAITALL;
+        sqe->user_data = (unsigned long)conn | URING_SEND;
+        io->file_send = 1;
+        conn->inflight += 2;
+    }
+    conn->send_inflight = 1;
+    return 0;
+}
+
+// 연결 처리: 수신 -> 파이프라인된 요청을 순서대로 처리 -> 응답 전송
+// 반환값 0: 연결 유지 (다음 이벤트 대기), -1: 연결 종료 필요
+int conn_process(conn_t *conn) {
+    int progress;
+
+    do {
+        progress = 0;
+
+        // 1. 엣지 트리거이므로 EAGAIN이 나올 때까지 읽음 (미처리 바이트가 한도를 넘으면 중단)
+        // 종료 예정이어도 CGI 에 보낼 본문이 남았으면 계속 읽음
+        while (!conn->peer_closed && (!conn->closing || conn->body_left > 0) &&
+               conn->in.len - conn->in.off < MAX_REQUEST_SIZE) {
+            ssize_t r = conn_fill(conn);
+            if (r > 0) continue;
+            if (r == 0)
+                conn->peer_closed = 1;
+            else if (errno != EAGAIN && errno != EWOULDBLOCK)
+                return -1;
+            break;
+        }
+
+        // 2. 요청 본문을 도착한 만큼 CGI 표준 입력으로 전달 (CGI가 없으면 버림)
+        if (conn->body_left > 0) {
+            if (conn_consume_body(conn))
+                progress = 1;
+            if (conn->body_left > 0 && conn->peer_closed && conn->in.off == conn->in.len) {
+                // 본문 도중 클라이언트가 끊음: 받은 만큼으로 끝내고 응답 후 종료
+                conn->body_left = 0;
+                conn->closing = 1;
+                if (conn->cgi.stdin_open)
+                    cgi_close_stdin(conn);
+            }
+        }
+
+        // 3. 버퍼에 완성된 요청이 있으면 도착 순서대로 처리
+        // 응답이 너무 많이 밀려 있으면 먼저 전송한 후 이어서 처리
+        // 이전 요청의 본문이나 CGI 응답이 진행 중이면 순서를 지키기 위해 다음 요청은 보류
+        while (!conn->closing && !conn->cgi.active && !conn->cache_wait && conn->body_left == 0 &&
+               conn->out_pending < MAX_PENDING_OUTPUT) {
+            parse_result_t pr = http_parse(conn);
+            if (pr == PARSE_INCOMPLETE)
+                break;
+
+            if (pr == PARSE_OK) {
+                if (request_hold(conn))
+                    break;
+                handle_request(conn);
+                request_done(conn);
+                conn_consume_body(conn);
+            } else {
+                stats_request_start(conn, 0);
+                conn->req.keep_alive = 0;
+                conn->closing = 1;
+                send_error(conn, parse_error_status(pr));
+                stats_request_end(conn);
+            }
+            progress = 1;
+        }
+
+        // 4. 응답 전송 (소켓 버퍼가 가득 차면 다음 EPOLLOUT 에서 이어서 전송)
+        int r = conn_flush(conn);
+        if (r == -1) return -1;
+        if (r == 0) return 0;
+
+        // 5. CGI 출력(또는 같은 요청의 실행 결과)을 기다리는 중: 밀린 응답을 다 보냈으면 CGI 읽기 재개
+        // 본문을 전달해 수신 버퍼에 자리가 났으면 다시 읽으러 감 (엣지 트리거라 새 이벤트가 없음)
+        if (conn->cgi.active || conn->cache_wait) {
+            if (conn->cgi.paused)
+                cgi_set_paused(conn, 0);
+            if (!progress) return 0;
+            continue;
+        }
+        if (conn->closing) return -1;
+        if (conn->peer_closed && !progress) return -1;
+    } while (progress);
+
+    return 0;
+}
+
+// 버퍼 끝에 데이터 추가 (항상 '\0'으로 끝나도록 유지)
+int buffer_append(buffer_t *buf, const void *data, size_t len) {
+    if (buf->len + len + 1 > buf->cap) {
+        size_t new_cap = buf->cap ? buf->cap : BUF_SIZE;
+        while (new_cap < buf->len + len + 1)
+            new_cap *= 2;
+        char *p = realloc(buf->data, new_cap);
+        if (p == NULL) return -1;
+        buf->data = p;
+        buf->cap = new_cap;
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+    return 0;
+}
+
+void buffer_free(buffer_t *buf) {
+    free(buf->data);
+    memset(buf, 0, sizeof(*buf));
+}
+
+// 요청별 영역에서 size 바이트 할당 (8바이트 정렬). 블록이 모자라면 두 배 이상 큰 블록을 앞에 추가
+void *arena_alloc(arena_t *arena, size_t size) {
+    arena_block_t *block = arena->head;
+    size = (size + 7) & ~(size_t)7;
+
+    if (block == NULL || block->cap - block->used < size) {
+        size_t cap = block ? block->cap * 2 : ARENA_BLOCK_SIZE;
+        while (cap < size) cap *= 2;
+        arena_block_t *nb = malloc(sizeof(arena_block_t) + cap);
+        if (nb == NULL) return NULL;
+        nb->next = block;
+        nb->cap = cap;
+        nb->used = 0;
+        arena->head = block = nb;
+    }
+    void *p = block->data + block->used;
+    block->used += size;
+    return p;
+}
+
+// printf 형식 문자열을 요청별 영역에 만듦 (길이 제한 없음, 실패하면 NULL)
+char *arena_printf(arena_t *arena, const char *fmt, ...) {
+    va_list ap;
+
+    va_start(ap, fmt);
+    int len = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if (len < 0) return NULL;
+
+    char *p = arena_alloc(arena, len + 1);
+    if (p == NULL) return NULL;
+    va_start(ap, fmt);
+    vsnprintf(p, len + 1, fmt, ap);
+    va_end(ap);
+    return p;
+}
+
+// 다음 요청 준비: 가장 큰 (첫) 블록만 남기고 비움. 같은 크기의 요청이 이어지면 malloc 이 없음
+void arena_reset(arena_t *arena) {
+    arena_block_t *block = arena->head;
+    if (block == NULL) return;
+
+    while (block->next) {
+        arena_block_t *old = block->next;
+        block->next = old->next;
+        free(old);
+    }
+    block->used = 0;
+}
+
+void arena_free(arena_t *arena) {
+    arena_reset(arena);
+    free(arena->head);
+    arena->head = NULL;
+}
+
+conn_t *conn_create(int fd) {
+    conn_t *conn = calloc(1, sizeof(conn_t));
+    if (conn == NULL) return NULL;
+    conn->ev_type = EV_CONN;
+    conn->fd = fd;
+    conn->cgi.ev_type = EV_CGI;
+    conn->cgi.in_ev_type = EV_CGI_IN;
+    conn->cgi.fd = -1;
+    conn->cgi.in_fd = -1;
+    conn->shed = atomic_fetch_add(&conn_count, 1) >= config.max_conns && config.max_conns > 0;
+    stat_add(&stats_local()->conns_opened, 1);
+    return conn;
+}
+
+// 연결 종료: 소켓과 CGI를 즉시 닫고, epoll 모드에서는 메모리 해제를 이벤트 배치 뒤로 미룸
+// io_uring 모드에서는 걸려 있는 요청이 모두 완료된 뒤에 해제 (uring_conn_cqe)
+void conn_destroy(conn_t *conn) {
+    if (conn->cgi.active)
+        cgi_abort(conn);
+    if (conn->cache_wait)
+        cgi_cache_unwait(conn);
+    if (conn->worker)
+        timer_remove(&conn->worker->wheel, &conn->timer);
+    if (conn->worker && conn->worker->ring) {
+        // 이 fd 를 쓰는 SQE 를 닫기 전에 제출하고, shutdown 으로 걸려 있는 recv/send 를 끝냄
+        uring_submit(conn->worker->ring, 0);
+        shutdown(conn->fd, SHUT_RDWR);
+    } else if (conn->worker) {
+        // 다른 쓰레드가 fork 한 CGI 자식이 exec 전까지 이 소켓을 물려받고 있으면 close 만으로는
+        // epoll 등록이 남아 해제된 연결로 이벤트가 오므로 먼저 직접 제거
+        epoll_ctl(conn->worker->epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+    }
+    close(conn->fd);
+    conn->dead = 1;
+
+    if (conn->worker) {
+        if (conn->inflight == 0) {
+            conn->next_dead = conn->worker->dead_conns;
+            conn->worker->dead_conns = conn;
+        }
+    } else {
+        conn_free(conn);
+    }
+}
+
+void conn_free(conn_t *conn) {
+    buffer_free(&conn->in);
+    buffer_free(&conn->cgi.head);
+    buffer_free(&conn->cgi.capture);
+    arena_free(&conn->arena);
+    while (conn->out_head)
+        conn_pop_seg(conn);
+    if (conn->io)
+        free(conn->io->file_buf);
+    free(conn->io);
+    free(conn);
+    atomic_fetch_sub(&conn_count, 1);
+    stat_add(&stats_local()->conns_closed, 1);
+}
+
+// 출력 리스트 끝에 새 조각 추가
+out_seg_t *conn_push_seg(conn_t *conn, seg_type_t type) {
+    out_seg_t *seg = calloc(1, sizeof(out_seg_t));
+    if (seg == NULL) return NULL;
+    seg->type = type;
+    seg->file_fd = -1;
+    if (conn->out_tail)
+        conn->out_tail->next = seg;
+    else
+        conn->out_head = seg;
+    conn->out_tail = seg;
+    return seg;
+}
+
+// 출력 리스트 맨 앞 조각 제거 (전송 완료 또는 연결 종료 시)
+void conn_pop_seg(conn_t *conn) {
+    out_seg_t *seg = conn->out_head;
+    conn->out_head = seg->next;
+    if (conn->out_head == NULL)
+        conn->out_tail = NULL;
+    if (seg->type == SEG_MEM)
+        conn->out_pending -= seg->mem.len - seg->mem.off;
+    if (seg->file_fd != -1)
+        close(seg->file_fd);
+    if (seg->ref)
+        cache_release(seg->ref);
+    buffer_free(&seg->mem);
+    free(seg);
+}
+
+// 응답 데이터를 출력 리스트에 추가 (실제 전송은 conn_flush 에서)
+// 마지막 조각이 메모리 조각이면 이어 붙여서 writev 조각 수를 줄임
+void conn_send(conn_t *conn, const void *data, size_t len) {
+    out_seg_t *seg = conn->out_tail;
+    if (seg == NULL || seg->type != SEG_MEM)
+        seg = conn_push_seg(conn, SEG_MEM);
+    if (seg == NULL || buffer_append(&seg->mem, data, len) == -1) {
+        perror("응답 버퍼 할당 오류");
+        return;
+    }
+    conn->out_pending += len;
+    conn->out_total += len;
+}
+
+// 캐시 항목의 일부 구간을 복사 없이 응답에 추가 (전송이 끝날 때까지 참조 유지)
+void conn_send_ref(conn_t *conn, cache_entry_t *entry, size_t off, size_t len) {
+    out_seg_t *seg = conn_push_seg(conn, SEG_REF);
+    if (seg == NULL) return;
+    atomic_fetch_add(&entry->refs, 1);
+    seg->ref = entry;
+    seg->ref_data = entry->data + off;
+    seg->ref_len = len;
+    conn->out_total += len;
+}
+
+// 파일 구간을 응답에 추가 (fd 소유권을 넘겨받아 전송 후 닫음)
+// 작은 파일은 앞의 헤더와 같은 메모리 조각에 읽어 넣어 writev 한 번으로 보내고,
+// 큰 파일은 sendfile로 사용자 공간 복사 없이 전송
+void conn_send_file(conn_t *conn, int fd, off_t offset, size_t len) {
+    if (len <= INLINE_FILE_MAX) {
+        char read_buf[INLINE_FILE_MAX];
+        ssize_t n = (len > 0) ? pread(fd, read_buf, len, offset) : 0;
+        if (n > 0)
+            conn_send(conn, read_buf, n);
+        close(fd);
+        return;
+    }
+
+    out_seg_t *seg = conn_push_seg(conn, SEG_FILE);
+    if (seg == NULL) {
+        close(fd);
+        return;
+    }
+    seg->file_fd = fd;
+    seg->file_off = offset;
+    seg->file_left = len;
+    conn->out_total += len;
+}
+
+// 소켓에서 한 번 읽어 수신 버퍼에 추가. 반환값은 read()와 동일
+// io_uring 모드에서는 데이터가 recv 완료로 들어오므로 recv 를 걸어 두고 EAGAIN 반환
+ssize_t conn_fill(conn_t *conn) {
+    char buf[BUF_SIZE * 4];
+    ssize_t bytes_read;
+
+    if (conn->worker && conn->worker->ring) {
+        uring_arm_recv(conn);
+        errno = EAGAIN;
+        return -1;
+    }
+
+    do {
+        bytes_read = read(conn->fd, buf, sizeof(buf));
+    } while (bytes_read == -1 && errno == EINTR);
+
+    if (bytes_read > 0) {
+        stat_add(&stats_local()->bytes_in, bytes_read);
+        if (conn->worker)
+            conn->last_active = conn->worker->wheel.now;
+        if (buffer_append(&conn->in, buf, bytes_read) == -1)
+            return -1;
+    }
+    return bytes_read;
+}
+
+// 출력 리스트 전송. 1: 모두 전송, 0: 소켓 버퍼 가득 참(EAGAIN), -1: 오류
+// io_uring 모드에서는 전송 요청을 제출만 하고 0 반환 (완료 시 다시 호출됨)
+int conn_flush(conn_t *conn) {
+    if (conn->worker && conn->worker->ring)
+        return uring_flush(conn);
+
+    while (conn->out_head) {
+        out_seg_t *seg = conn->out_head;
+        ssize_t n;
+
+        if (seg->type != SEG_FILE) {
+            // 1. 연속된 메모리/캐시 조각을 한 번의 sendmsg(writev)로 전송
+            // 뒤에 파일 조각이 이어지면 MSG_MORE로 헤더와 파일 앞부분이 같은 패킷에 실리도록 함
+            struct iovec iov[MAX_IOV];
+            int more;
+            struct msghdr msg = { 0 };
+            msg.msg_iov = iov;
+            msg.msg_iovlen = conn_build_iov(conn, iov, &more);
+            n = sendmsg(conn->fd, &msg, more ? MSG_MORE : 0);
+            if (n == -1) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+                return -1;
+            }
+
+            // 2. 보낸 만큼 조각 소비
+            stat_add(&stats_local()->bytes_out, n);
+            if (conn->worker)
+                conn->last_active = conn->worker->wheel.now;
+            conn_consume_output(conn, n);
+        } else {
+            // 3. 파일 조각: 커널에서 소켓으로 직접 복사 (sendfile이 file_off를 갱신)
+            size_t chunk = seg->file_left < SENDFILE_CHUNK ? seg->file_left : SENDFILE_CHUNK;
+            n = sendfile(conn->fd, seg->file_fd, &seg->file_off, chunk);
+            if (n == -1) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+                return -1;
+            }
+            if (n == 0) return -1; // 전송 중 파일이 잘림: 약속한 길이를 채울 수 없음
+            stat_add(&stats_local()->bytes_out, n);
+            if (conn->worker)
+                conn->last_active = conn->worker->wheel.now;
+            seg->file_left -= n;
+            if (seg->file_left == 0)
+                conn_pop_seg(conn);
+        }
+    }
+    return 1;
+}
+
+// 출력 리스트 앞쪽의 연속된 메모리/캐시 조각을 iovec 으로 모음
+// more: 바로 뒤에 파일 조각이 이어지는지. 반환값: iovec 개수
+int conn_build_iov(conn_t *conn, struct iovec *iov, int *more) {
+    int iovcnt = 0;
+    out_seg_t *s;
+
+    for (s = conn->out_head; s && s->type != SEG_FILE && iovcnt < MAX_IOV; s = s->next) {
+        if (s->type == SEG_MEM) {
+            iov[iovcnt].iov_base = s->mem.data + s->mem.off;
+            iov[iovcnt].iov_len = s->mem.len - s->mem.off;
+        } else {
+            iov[iovcnt].iov_base = (void *)s->ref_data;
+            iov[iovcnt].iov_len = s->ref_len;
+        }
+        iovcnt++;
+    }
+    *more = (s && s->type == SEG_FILE);
+    return iovcnt;
+}
+
+// 메모리/캐시 조각에서 보낸 만큼 소비
+void conn_consume_output(conn_t *conn, size_t n) {
+    while (n > 0) {
+        out_seg_t *seg = conn->out_head;
+        size_t left = (seg->type == SEG_MEM) ? seg->mem.len - seg->mem.off : seg->ref_len;
+        if (n < left) {
+            if (seg->type == SEG_MEM) {
+                seg->mem.off += n;
+                conn->out_pending -= n;
+            } else {
+                seg->ref_data += n;
+                seg->ref_len -= n;
+            }
+            break;
+        }
+        n -= left;
+        conn_pop_seg(conn);
+    }
+}
+
+// 증분 HTTP 파서: 수신 버퍼의 in.off 위치에서 시작하는 요청 헤더를 파싱
+// 헤더가 여러 번의 read로 나뉘어 오면 이전에 확인한 위치부터 탐색을 재개하고,
+// 한 번의 read에 여러 요청이 들어 있으면 request_done() 후 다음 요청을 이어서 파싱
+// 본문은 기다리지 않음: 헤더가 완성되면 바로 처리하고 본문은 conn_consume_body 로 흘려보냄
+parse_result_t http_parse(conn_t *conn) {
+    char *start = conn->in.data + conn->in.off;
+    size_t avail = conn->in.len - conn->in.off;
+
+    if (conn->held_base) // 본문을 기다리며 보류한 요청 (이미 파싱함, request_hold)
+        return PARSE_OK;
+
+    // 1. 헤더 끝 탐색: 줄바꿈 문자만 벡터로 건너뛰며 찾고, 그 자리에서 "\r\n\r\n" 인지 확인
+    // (경계에 걸친 빈 줄을 위해 3바이트 겹쳐서 재탐색)
+    size_t pos = conn->scan_off > 3 ? conn->scan_off - 3 : 0;
+    while ((pos += scan_delims(start + pos, avail - pos, '\n')) < avail) {
+        if (start[pos] == '\n' && pos >= 3 && memcmp(start + pos - 3, "\r\n\r\n", 4) == 0)
+            break;
+        pos++;
+    }
+    if (pos >= avail) {
+        conn->scan_off = avail;
+        return (avail >= MAX_REQUEST_SIZE) ? PARSE_TOO_LARGE : PARSE_INCOMPLETE;
+    }
+
+    // 2. 요청 라인과 헤더 파싱 (새 요청이므로 이전 요청의 임시 할당을 비움)
+    arena_reset(&conn->arena);
+    conn->header_len = pos + 1;
+    int r = parse_headers(conn, start, conn->header_len);
+    if (r == -2)
+        return PARSE_UNSUPPORTED;
+    if (r == -1)
+        return PARSE_ERROR;
+    if (conn->req.content_length > config.max_body)
+        return PARSE_TOO_LARGE;
+    return PARSE_OK;
+}
+
+// 파싱 실패 응답 상태 (어느 경우든 요청 경계를 믿을 수 없으므로 호출한 쪽이 연결을 닫음)
+char *parse_error_status(parse_result_t pr) {
+    if (pr == PARSE_TOO_LARGE) return "413 Payload Too Large";
+    if (pr == PARSE_UNSUPPORTED) return "501 Not Implemented";
+    return "400 Bad Request";
+}
+
+// 요청 라인과 헤더를 제자리에서 분리하여 conn->req 에 뷰로 기록 (구분자 자리에 '\0' 삽입)
+// 구분자(CR, LF, ':', ' ')는 scan_delims 로 16/32바이트씩 찾으므로 긴 URI 나 값도 한 번만 훑음
+// 본문 길이는 Content-Length 하나로만 정함: 길이가 모호하면 -1 (400), identity 가 아닌 Transfer-Encoding 은 -2 (501)
+// (keep-alive 연결에서 본문 경계를 잘못 잡으면 본문 안에 숨긴 요청이 다음 요청으로 처리됨)
+int parse_headers(conn_t *conn, char *start, size_t len) {
+    http_request_t *req = &conn->req;
+    char *end = start + len - 2; // 마지막 빈 줄의 "\r\n" 앞
+    char *p = start;
+    const char *connection = NULL;
+    int have_length = 0;
+    int have_te = 0, te_identity = 1;
+    size_t n;
+
+    req->header_count = 0;
+    req->content_length = 0;
+
+    // 1. 요청 라인: METHOD SP URI SP VERSION CRLF
+    char **fields[3] = { &req->method, &req->uri, &req->version };
+    size_t *lens[3] = { &req->method_len, &req->uri_len, NULL };
+    for (int i = 0; i < 3; i++) {
+        char delim = i < 2 ? ' ' : '\r';
+        n = scan_delims(p, end - p, ' ');
+        if (n == 0 || p + n >= end || p[n] != delim || (delim == '\r' && p[n + 1] != '\n'))
+            return -1;
+        *fields[i] = p;
+        if (lens[i]) *lens[i] = n;
+        p[n] = '\0';
+        p += n + (i < 2 ? 1 : 2);
+    }
+    if (strncmp(req->version, "HTTP/1.", 7) != 0 || strlen(req->version) != 8)
+        return -1;
+    req->http11 = req->version[7] == '1';
+
+    // 2. 헤더 필드: "이름:" 뒤와 값 끝의 공백은 무시, 이름은 대소문자 구분 없이 비교
+    while (p < end) {
+        n = scan_delims(p, end - p, ':');
+        if (n == 0 || p[n] != ':' || p[n - 1] == ' ' || p[n - 1] == '\t')
+            return -1; // 콜론 없는 줄, 빈 이름, 이름과 콜론 사이 공백 (RFC 7230 3.2.4)
+        char *name = p;
+        size_t name_len = n;
+        p[n] = '\0';
+
+        char *value = p + n + 1;
+        n = scan_delims(value, end - value, '\r');
+        if (value[n] != '\r' || value[n + 1] != '\n') return -1; // 단독 LF 등
+        p = value + n + 2;
+        while (n > 0 && (value[n - 1] == ' ' || value[n - 1] == '\t')) n--;
+        value[n] = '\0';
+        while (*value == ' ' || *value == '\t') { value++; n--; }
+
+        // 자주 쓰는 헤더는 여기서 바로 해석 (길이로 먼저 거름)
+        if (name_len == 14 && strcasecmp(name, "Content-Length") == 0) {
+            char *endp;
+            unsigned long long cl = strtoull(value, &endp, 10);
+            if (n == 0 || *endp != '\0' || value[0] == '-' || have_length)
+                return -1; // 쉼표로 이어 붙였거나 여러 번 온 길이는 같은 값이라도 거절
+            req->content_length = (size_t)cl;
+            have_length = 1;
+        } else if (name_len == 17 && strcasecmp(name, "Transfer-Encoding") == 0) {
+            have_te = 1;
+            if (strcasecmp(value, "identity") != 0)
+                te_identity = 0; // chunked 등 (여러 번 오거나 쉼표로 이어 붙인 목록 포함)
+        } else if (name_len == 10 && strcasecmp(name, "Connection") == 0) {
+            connection = value;
+        }
+
+        if (req->header_count == MAX_HEADERS) continue; // 초과 헤더는 무시
+        http_header_t *h = &req->headers[req->header_count++];
+        h->name = name;
+        h->name_len = name_len;
+        h->value = value;
+        h->value_len = n;
+    }
+    if (have_te && have_length)
+        return -1;
+    if (!te_identity)
+        return -2;
+
+    // 3. 연결 유지 여부: HTTP/1.1은 기본 유지, HTTP/1.0은 keep-alive 명시 시에만 유지
+    if (strcmp(req->version, "HTTP/1.0") == 0)
+        req->keep_alive = connection && strcasecmp(connection, "keep-alive") == 0;
+    else
+        req->keep_alive = !(connection && strcasecmp(connection, "close") == 0);
+
+    // blocking 모드는 비교를 위해 기존처럼 요청마다 연결을 닫음
+    if (config.mode == MODE_BLOCKING)
+        req->keep_alive = 0;
+
+    return 0;
+}
+
+// 헤더 값 조회 (이름은 대소문자 구분 없음, 길이가 다르면 비교하지 않음). 없으면 NULL
+const char *find_header(http_request_t *req, const char *name) {
+    size_t len = strlen(name);
+    for (int i = 0; i < req->header_count; i++) {
+        if (req->headers[i].name_len == len && strcasecmp(req->headers[i].name, name) == 0)
+            return req->headers[i].value;
+    }
+    return NULL;
+}
+
+// --- 구분자 탐색 (헤더 파서) ---
+// p[0..len) 에서 '\r', '\n', c 중 처음 나오는 위치 (없으면 len)
+// 시작할 때 CPU 에 맞는 구현을 골라 scan_delims 에 넣음 (AVX2 > SSE2 > 바이트 단위)
+size_t scan_delims_scalar(const char *p, size_t len, char c) {
+    for (size_t i = 0; i < len; i++)
+        if (p[i] == '\r' || p[i] == '\n' || p[i] == c)
+            return i;
+    return len;
+}
+
+#ifdef __x86_64__
+// 16바이트씩 세 문자와 비교한 결과를 OR 한 뒤 movemask 의 최하위 비트가 첫 위치
+size_t scan_delims_sse2(const char *p, size_t len, char c) {
+    const __m128i cr = _mm_set1_epi8('\r'), lf = _mm_set1_epi8('\n'), ch = _mm_set1_epi8(c);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)),
+                                   _mm_cmpeq_epi8(v, ch));
+        int mask = _mm_movemask_epi8(hit);
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return i + scan_delims_scalar(p + i, len - i, c);
+}
+
+// 32바이트씩 비교. 남은 부분도 이 함수 안에서 처리: VEX 가 아닌 SSE2 함수를 부르면
+// 상위 레지스터 상태가 남아 있는 동안 호출마다 AVX-SSE 전환 비용을 물게 됨
+__attribute__((target("avx2")))
+size_t scan_delims_avx2(const char *p, size_t len, char c) {
+    const __m256i cr = _mm256_set1_epi8('\r'), lf = _mm256_set1_epi8('\n'), ch = _mm256_set1_epi8(c);
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf)),
+                                      _mm256_cmpeq_epi8(v, ch));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    if (i + 16 <= len) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm256_castsi256_si128(cr)),
+                                                _mm_cmpeq_epi8(v, _mm256_castsi256_si128(lf))),
+                                   _mm_cmpeq_epi8(v, _mm256_castsi256_si128(ch)));
+        int mask = _mm_movemask_epi8(hit);
+        if (mask)
+            return i + __builtin_ctz(mask);
+        i += 16;
+    }
+    for (; i < len; i++)
+        if (p[i] == '\r' || p[i] == '\n' || p[i] == c)
+            return i;
+    return len;
+}
+#endif
+
+// 구분자 탐색 구현 선택 (level: "auto", "avx2", "sse2", "scalar"). 지원하지 않는 수준이면 -1
+int scan_delims_select(const char *level) {
+    int automatic = strcmp(level, "auto") == 0;
+
+#ifdef __x86_64__
+    __builtin_cpu_init();
+    if ((automatic && __builtin_cpu_supports("avx2")) ||
+        (strcmp(level, "avx2") == 0 && __builtin_cpu_supports("avx2"))) {
+        scan_delims = scan_delims_avx2;
+        scan_delims_name = "avx2";
+        return 0;
+    }
+    if (automatic || strcmp(level, "sse2") == 0) { // x86-64 는 SSE2 가 기본
+        scan_delims = scan_delims_sse2;
+        scan_delims_name = "sse2";
+        return 0;
+    }
+#endif
+    if (automatic || strcmp(level, "scalar") == 0) {
+        scan_delims = scan_delims_scalar;
+        scan_delims_name = "scalar";
+        return 0;
+    }
+    return -1;
+}
+
+// 요청 처리 완료: 헤더 바이트를 버리고 본문 소비 및 다음 (파이프라인된) 요청 파싱 준비
+void request_done(conn_t *conn) {
+    conn->in.off += conn->header_len;
+    conn->body_left = conn->req.content_length;
+    conn->scan_off = 0;
+    conn->header_len = 0;
+    conn->header_start = 0;
+    conn->continue_sent = 0;
+
+    if (!conn->req.keep_alive)
+        conn->closing = 1;
+
+    conn_compact_input(conn);
+}
+
+// 본문까지 있어야 처리할 수 있는 요청은 본문이 수신 버퍼에 다 모일 때까지 파싱한 요청을 보류
+// (1: 보류, 수신 버퍼 한도를 넘는 본문은 보류하지 않음)
+// 보류하는 동안 수신 버퍼가 재할당되면 요청의 뷰를 새 위치로 옮김
+int request_hold(conn_t *conn) {
+    http_request_t *req = &conn->req;
+
+    if (conn->held_base && conn->held_base != conn->in.data) {
+        ptrdiff_t delta = conn->in.data - conn->held_base;
+        req->method += delta;
+        req->uri += delta;
+        req->version += delta;
+        for (int i = 0; i < req->header_count; i++) {
+            req->headers[i].name += delta;
+            req->headers[i].value += delta;
+        }
+    }
+    conn->held_base = NULL;
+
+    if (conn->peer_closed || conn->in.len - conn->in.off >= conn->header_len + req->content_length ||
+        conn->header_len + req->content_length > MAX_REQUEST_SIZE || !request_needs_body(conn))
+        return 0;
+
+    // 확인을 기다린 뒤 본문을 보내는 클라이언트에게는 지금 알려야 본문이 옴
+    const char *expect = find_header(req, "Expect");
+    if (!conn->continue_sent && expect && strcasecmp(expect, "100-continue") == 0 && req->http11) {
+        conn_send(conn, "HTTP/1.1 100 Continue\r\n\r\n", 25);
+        conn->continue_sent = 1;
+    }
+    conn->held_base = conn->in.data;
+    return 1;
+}
+
+// 본문이 다 있어야 처리할 수 있는 요청: 플러그인 경로, 응답을 캐시하는 스크립트로 온 POST (캐시 키)
+int request_needs_body(conn_t *conn) {
+    http_request_t *req = &conn->req;
+    char path[sizeof(cgi_cache_rules[0].path)];
+
+    if (plugin_find(req->uri)) return 1;
+    if (cgi_cache_rule_count == 0 || config.cgi_cache_size == 0 || strcmp(req->method, "POST") != 0)
+        return 0;
+    size_t path_len = strcspn(req->uri, "?");
+    if (path_len + 2 > sizeof(path)) return 0;
+    snprintf(path, sizeof(path), ".%.*s", (int)path_len, req->uri);
+    return cgi_cache_find_rule(path) != NULL;
+}
+
+// 수신 버퍼에 있는 본문 바이트를 소비: CGI 표준 입력이 열려 있으면 전달하고, 아니면 버림
+// 수신 버퍼 크기가 제한되어 있으므로 본문이 아무리 커도 메모리 사용량은 일정
+// 반환값: 소비한 바이트가 있으면 1
+int conn_consume_body(conn_t *conn) {
+    size_t avail = conn->in.len - conn->in.off;
+    if (avail > conn->body_left) avail = conn->body_left;
+    if (avail == 0) return 0;
+
+    ssize_t n = avail;
+    if (conn->cgi.active && conn->cgi.stdin_open) {
+        n = cgi_write_stdin(conn, conn->in.data + conn->in.off, avail);
+        if (n == -1) { // CGI 가 입력을 닫음: 나머지는 버림
+            cgi_close_stdin(conn);
+            n = avail;
+        }
+    }
+    if (n == 0) return 0;
+
+    conn->in.off += n;
+    conn->body_left -= n;
+    if (conn->body_left == 0 && conn->cgi.active && conn->cgi.stdin_open)
+        cgi_close_stdin(conn); // 본문 끝: CGI 에 EOF 전달
+    conn_compact_input(conn);
+    return 1;
+}
+
+// 소비한 바이트를 버리고 남은 데이터를 버퍼 앞으로 당겨 버퍼가 계속 커지지 않도록 함
+void conn_compact_input(conn_t *conn) {
+    if (conn->in.off == conn->in.len) {
+        conn->in.off = conn->in.len = 0;
+    } else if (conn->in.off > conn->in.cap / 2) {
+        memmove(conn->in.data, conn->in.data + conn->in.off, conn->in.len - conn->in.off);
+        conn->in.len -= conn->in.off;
+        conn->in.off = 0;
+        conn->in.data[conn->in.len] = '\0';
+    }
+}
+
+// 파일 확장자로 Content-Type 결정
+const char *mime_type(const char *path) {
+    static const struct {
+        const char *ext;
+        const char *type;
+    } types[] = {
+        { ".html", "text/html; charset=utf-8" },
+        { ".htm",  "text/html; charset=utf-8" },
+        { ".css",  "text/css; charset=utf-8" },
+        { ".js",   "application/javascript; charset=utf-8" },
+        { ".json", "application/json; charset=utf-8" },
+        { ".txt",  "text/plain; charset=utf-8" },
+        { ".xml",  "application/xml; charset=utf-8" },
+        { ".svg",  "image/svg+xml" },
+        { ".png",  "image/png" },
+        { ".jpg",  "image/jpeg" },
+        { ".jpeg", "image/jpeg" },
+        { ".gif",  "image/gif" },
+        { ".webp", "image/webp" },
+        { ".ico",  "image/x-icon" },
+        { ".pdf",  "application/pdf" },
+        { ".mp4",  "video/mp4" },
+        { ".wasm", "application/wasm" },
+    };
+
+    const char *dot = strrchr(path, '.');
+    if (dot && strchr(dot, '/') == NULL) {
+        for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+            if (strcasecmp(dot, types[i].ext) == 0)
+                return types[i].type;
+        }
+    }
+    return "application/octet-stream";
+}
+
+// 문자열 해시 (djb2)
+unsigned long hash_string(const char *str) {
+    unsigned long h = 5381;
+    while (*str)
+        h = h * 33 + (unsigned char)*str++;
+    return h;
+}
+
+// 바이트열 해시 (djb2, '\0' 이 섞인 키용)
+unsigned long hash_bytes(const void *data, size_t len) {
+    const unsigned char *p = data;
+    unsigned long h = 5381;
+    for (size_t i = 0; i < len; i++)
+        h = h * 33 + p[i];
+    return h;
+}
+
+// 정적 파일 응답 헤더 생성 (Content-Length/Connection 제외) 및 ETag 계산
+// ETag는 inode, 크기, 수정 시각(ns)으로 만들어 파일이 바뀌면 달라지고, 압축 변형은 "-gz"를 붙여 구분
+// vary: 압축 여부가 Accept-Encoding 에 따라 달라지는 응답 (중간 캐시가 변형을 섞지 않도록)
+void format_file_headers(char *buf, size_t size, struct stat *st, char *etag, size_t etag_size,
+                         int gzip, int vary) {
+    char date[64];
+
+    snprintf(etag, etag_size, "\"%lx-%lx-%llx%s\"", (unsigned long)st->st_ino, (unsigned long)st->st_size,
+             (unsigned long long)st->st_mtim.tv_sec * 1000000000ULL + st->st_mtim.tv_nsec, gzip ? "-gz" : "");
+    http_date(st->st_mtime, date, sizeof(date));
+    // 압축 변형은 Range 대상이 아님 (Range 요청에는 항상 원본으로 응답)
+    snprintf(buf, size, "ETag: %s\r\nLast-Modified: %s\r\n%s%s", etag, date,
+             gzip ? "Content-Encoding: gzip\r\n" : "Accept-Ranges: bytes\r\n",
+             vary ? "Vary: Accept-Encoding\r\n" : "");
+}
+
+// HTTP 날짜 형식 (예: Sun, 06 Nov 1994 08:49:37 GMT)
+void http_date(time_t t, char *buf, size_t size) {
+    struct tm tm;
+
+    gmtime_r(&t, &tm);
+    strftime(buf, size, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+// Accept-Encoding 에 q=0 이 아닌 gzip (또는 *) 이 있는지 확인
+int accepts_gzip(conn_t *conn) {
+    const char *p = find_header(&conn->req, "Accept-Encoding");
+
+    while (p && *p) {
+        p += strspn(p, " \t,");
+        size_t name_len = strcspn(p, " \t;,");
+        int match = (name_len == 4 && strncasecmp(p, "gzip", 4) == 0) || (name_len == 1 && *p == '*');
+        const char *end = p + strcspn(p, ",");
+
+        if (match) {
+            const char *q = strstr(p, "q=");
+            return q == NULL || q > end || strtod(q + 2, NULL) > 0;
+        }
+        p = end;
+    }
+    return 0;
+}
+
+// 압축 효과가 있는 텍스트 계열인지 (이미지, 동영상 등은 이미 압축되어 있음)
+int is_compressible(const char *type) {
+    return strncmp(type, "text/", 5) == 0 || strstr(type, "javascript") || strstr(type, "json") ||
+           strstr(type, "xml");
+}
+
+// 미리 압축된 "<path>.gz" 가 있고 원본보다 오래되지 않았으면 열어서 반환 (없으면 -1)
+int open_gzip_sibling(const char *gz_path, struct stat *orig, struct stat *st) {
+    int fd = open(gz_path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return -1;
+    if (fstat(fd, st) == -1 || !S_ISREG(st->st_mode) ||
+        st->st_mtim.tv_sec < orig->st_mtim.tv_sec ||
+        (st->st_mtim.tv_sec == orig->st_mtim.tv_sec && st->st_mtim.tv_nsec < orig->st_mtim.tv_nsec)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// gzip 형식으로 압축 (반환값은 free 필요, 실패 시 NULL)
+char *gzip_compress(const char *data, size_t len, size_t *out_len) {
+    z_stream zs;
+
+    memset(&zs, 0, sizeof(zs));
+    // windowBits 15 + 16: zlib 대신 gzip 헤더/트레일러
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return NULL;
+
+    size_t cap = deflateBound(&zs, len);
+    char *out = malloc(cap);
+    if (out == NULL) {
+        deflateEnd(&zs);
+        return NULL;
+    }
+    zs.next_in = (Bytef *)data;
+    zs.avail_in = len;
+    zs.next_out = (Bytef *)out;
+    zs.avail_out = cap;
+    if (deflate(&zs, Z_FINISH) != Z_STREAM_END) {
+        deflateEnd(&zs);
+        free(out);
+        return NULL;
+    }
+    *out_len = zs.total_out;
+    deflateEnd(&zs);
+    return out;
+}
+
+// If-None-Match 헤더가 현재 ETag와 일치하는지 확인 (목록 또는 "*")
+int etag_matches(conn_t *conn, const char *etag) {
+    const char *inm = find_header(&conn->req, "If-None-Match");
+    if (inm == NULL) return 0;
+    return strcmp(inm, "*") == 0 || strstr(inm, etag) != NULL;
+}
+
+// 캐시 초기화: 파일 변경 감시용 inotify 인스턴스와 감시 쓰레드 생성
+void cache_init(void) {
+    pthread_t tid;
+
+    if (config.cache_size == 0) return;
+
+    file_cache.inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (file_cache.inotify_fd == -1) {
+        // 무효화 없이 캐시하면 오래된 내용을 보낼 수 있으므로 캐시를 끔
+        perror("inotify_init1() 오류 (캐시 비활성화)");
+        config.cache_size = 0;
+        return;
+    }
+    if (pthread_create(&tid, NULL, cache_watch_thread, NULL) != 0)
+        error_handling("pthread_create() 오류");
+    pthread_detach(tid);
+}
+
+// 캐시 조회: 적중 시 참조를 하나 늘려 반환 (사용 후 cache_release)
+// 같은 파일의 원본과 압축 변형은 키가 같고 gzip 으로 구분
+cache_entry_t *cache_lookup(const char *key, int gzip) {
+    cache_entry_t *entry;
+
+    if (config.cache_size == 0) return NULL;
+
+    pthread_rwlock_rdlock(&file_cache.lock);
+    for (entry = file_cache.buckets[hash_string(key) % CACHE_BUCKETS]; entry; entry = entry->hash_next) {
+        if (entry->gzip == gzip && strcmp(entry->key, key) == 0) {
+            atomic_store(&entry->referenced, 1);
+            atomic_fetch_add(&entry->refs, 1);
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&file_cache.lock);
+    return entry;
+}
+
+// 참조 해제: 마지막 참조가 풀리면 메모리 반환
+void cache_release(cache_entry_t *entry) {
+    if (atomic_fetch_sub(&entry->refs, 1) == 1) {
+        free(entry->key);
+        free(entry->name);
+        free(entry->data);
+        free(entry);
+    }
+}
+
+// 해시 테이블과 CLOCK 리스트에서 제거 (쓰기 잠금 상태에서 호출)
+void cache_unlink(file_cache_t *cache, cache_entry_t *entry) {
+    cache_entry_t **pp = &cache->buckets[entry->hash % CACHE_BUCKETS];
+    while (*pp != entry)
+        pp = &(*pp)->hash_next;
+    *pp = entry->hash_next;
+
+    if (entry->clock_next == entry) {
+        cache->hand = NULL;
+    } else {
+        entry->clock_prev->clock_next = entry->clock_next;
+        entry->clock_next->clock_prev = entry->clock_prev;
+        if (cache->hand == entry)
+            cache->hand = entry->clock_next;
+    }
+
+    cache->bytes -= cache_charge(entry);
+    cache_release(entry); // 캐시가 쥐고 있던 참조
+}
+
+// 용량에 세는 크기: 응답과 (CGI 캐시의) 키. 실행 중인 CGI 항목은 아직 내용이 없으므로 0
+size_t cache_charge(cache_entry_t *entry) {
+    return entry->pending ? 0 : entry->len + entry->key_len;
+}
+
+// CLOCK 제거: need 바이트가 들어갈 자리가 날 때까지 참조 비트가 꺼진 항목부터 제거 (쓰기 잠금 상태)
+// 참조 비트가 켜진 항목은 비트만 끄고 한 번 더 기회를 주며, 실행 중인 CGI 항목은 건너뜀
+void cache_evict(file_cache_t *cache, size_t need, size_t limit) {
+    while (cache->hand && cache->bytes + need > limit) {
+        cache_entry_t *victim = cache->hand;
+        if (victim->pending || atomic_exchange(&victim->referenced, 0)) {
+            cache->hand = victim->clock_next;
+        } else {
+            cache_unlink(cache, victim);
+        }
+    }
+}
+
+// 자리를 만든 뒤 해시 테이블과 CLOCK 리스트에 등록 (쓰기 잠금 상태, 캐시의 참조는 호출자가 포함해 둠)
+void cache_link(file_cache_t *cache, cache_entry_t *entry, size_t limit) {
+    cache_evict(cache, cache_charge(entry), limit);
+
+    unsigned long b = entry->hash % CACHE_BUCKETS;
+    entry->hash_next = cache->buckets[b];
+    cache->buckets[b] = entry;
+    if (cache->hand == NULL) {
+        entry->clock_prev = entry->clock_next = entry;
+        cache->hand = entry;
+    } else { // 바늘 바로 뒤(가장 늦게 검사될 위치)에 삽입
+        cache_entry_t *h = cache->hand;
+        entry->clock_next = h;
+        entry->clock_prev = h->clock_prev;
+        h->clock_prev->clock_next = entry;
+        h->clock_prev = entry;
+    }
+    cache->bytes += cache_charge(entry);
+}
+
+// 파일을 읽어 직렬화된 응답을 만들고 캐시에 등록
+// VARIANT_GZIP 은 여기서 한 번만 압축하고, 파일이 바뀌어 무효화될 때까지 압축 결과를 재사용
+// 용량을 넘으면 CLOCK 알고리즘으로 최근에 참조되지 않은 항목부터 제거
+// 반환값은 호출자 참조가 포함된 항목 (실패 시 NULL)
+cache_entry_t *cache_insert(const char *key, int fd, struct stat *st, variant_t variant) {
+    char file_headers[256];
+    char head[BUF_SIZE];
+    char etag[64];
+
+    if (config.cache_size == 0 || (size_t)st->st_size > CACHE_MAX_FILE ||
+        (size_t)st->st_size > config.cache_size)
+        return NULL;
+
+    // 1. 읽기 전에 디렉토리 감시를 먼저 등록 (읽는 도중의 변경도 무효화 이벤트로 잡힘)
+    char dir[256];
+    const char *slash = strrchr(key, '/');
+    size_t dir_len = slash ? (size_t)(slash - key) : 0;
+    if (dir_len == 0 || dir_len >= sizeof(dir)) return NULL;
+    memcpy(dir, key, dir_len);
+    dir[dir_len] = '\0';
+    int wd = inotify_add_watch(file_cache.inotify_fd, dir,
+                               IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE |
+                               IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF);
+    if (wd == -1) return NULL;
+
+    // 2. 파일 내용 읽기 (압축 변형이면 압축하고, 줄지 않으면 원본을 그대로 씀)
+    char *body = malloc(st->st_size + 1);
+    size_t body_len = 0;
+    if (body == NULL) return NULL;
+    while (body_len < (size_t)st->st_size) {
+        ssize_t n = pread(fd, body + body_len, st->st_size - body_len, body_len);
+        if (n <= 0) break;
+        body_len += n;
+    }
+    if (body_len != (size_t)st->st_size) { // 읽는 중 파일이 잘림
+        free(body);
+        return NULL;
+    }
+
+    int gzip = (variant == VARIANT_GZIP_FILE);
+    if (variant == VARIANT_GZIP) {
+        size_t gz_len;
+        char *gz = gzip_compress(body, body_len, &gz_len);
+        if (gz && gz_len < body_len) {
+            free(body);
+            body = gz;
+            body_len = gz_len;
+            gzip = 1;
+        } else {
+            free(gz);
+        }
+    }
+
+    // 3. 헤더 + 본문을 하나의 버퍼에 직렬화
+    format_file_headers(file_headers, sizeof(file_headers), st, etag, sizeof(etag),
+                        gzip, variant != VARIANT_RAW || is_compressible(mime_type(key)));
+    int head_len = snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %zu\r\n%s",
+                            mime_type(key), body_len, file_headers);
+
+    cache_entry_t *entry = calloc(1, sizeof(cache_entry_t));
+    if (entry == NULL) {
+        free(body);
+        return NULL;
+    }
+    entry->len = head_len + 2 + body_len;
+    entry->head_len = head_len;
+    entry->data = malloc(entry->len);
+    entry->key = strdup(key);
+    entry->name = strdup(slash + 1);
+    if (entry->data == NULL || entry->key == NULL || entry->name == NULL) {
+        free(body);
+        atomic_store(&entry->refs, 1);
+        cache_release(entry);
+        return NULL;
+    }
+    memcpy(entry->data, head, head_len);
+    memcpy(entry->data + head_len, "\r\n", 2);
+    memcpy(entry->data + head_len + 2, body, body_len);
+    free(body);
+
+    strcpy(entry->etag, etag);
+    entry->mtime = st->st_mtime;
+    entry->gzip = (variant != VARIANT_RAW);
+    entry->wd = wd;
+    entry->hash = hash_string(key);
+    atomic_store(&entry->refs, 2); // 캐시 + 호출자
+    atomic_store(&entry->referenced, 1);
+
+    // 4. 등록 (같은 키와 변형이 이미 있으면 교체, 용량을 넘으면 CLOCK 알고리즘으로 제거)
+    pthread_rwlock_wrlock(&file_cache.lock);
+
+    for (cache_entry_t *old = file_cache.buckets[entry->hash % CACHE_BUCKETS]; old; old = old->hash_next) {
+        if (old->gzip == entry->gzip && strcmp(old->key, key) == 0) {
+            cache_unlink(&file_cache, old);
+            break;
+        }
+    }
+    cache_link(&file_cache, entry, config.cache_size);
+
+    pthread_rwlock_unlock(&file_cache.lock);
+    return entry;
+}
+
+// 캐시 항목으로 응답: HTTP/1.1 keep-alive 연결은 저장된 응답 그대로 보내고,
+// 그 외에는 헤더 끝에 Connection 헤더만 끼워 넣음 (어느 경우든 writev 한 번)
+void cache_serve(conn_t *conn, cache_entry_t *entry) {
+    if (conn->req.keep_alive && conn->req.http11) {
+        conn_send_ref(conn, entry, 0, entry->len);
+    } else {
+        const char *connection = conn->req.keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+        conn_send_ref(conn, entry, 0, entry->head_len);
+        conn_send(conn, connection, strlen(connection));
+        conn_send_ref(conn, entry, entry->head_len, entry->len - entry->head_len);
+    }
+    conn->status = atoi(entry->data + 9); // "HTTP/1.1 " 뒤 (CGI 응답 캐시는 200 이 아닐 수도 있음)
+}
+
+// 파일 변경 감시 쓰레드: 문서 루트의 파일이 바뀌면 해당 캐시 항목 무효화
+void *cache_watch_thread(void *arg) {
+    char events[BUF_SIZE * 4] __attribute__((aligned(__alignof__(struct inotify_event))));
+    (void)arg;
+
+    while (1) {
+        ssize_t len = read(file_cache.inotify_fd, events, sizeof(events));
+        if (len <= 0) {
+            if (len == -1 && errno == EINTR) continue;
+            perror("inotify read() 오류");
+            return NULL;
+        }
+
+        pthread_rwlock_wrlock(&file_cache.lock);
+        for (char *p = events; p < events + len; ) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            // 디렉토리 자체가 사라지면 그 안의 모든 항목, 아니면 이름이 같은 항목만 제거
+            int whole_dir = (ev->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF | IN_Q_OVERFLOW)) != 0;
+
+            for (int b = 0; b < CACHE_BUCKETS; b++) {
+                cache_entry_t *entry = file_cache.buckets[b];
+                while (entry) {
+                    cache_entry_t *next = entry->hash_next;
+                    if ((ev->mask & IN_Q_OVERFLOW) ||
+                        (entry->wd == ev->wd && (whole_dir || (ev->len && cache_name_matches(entry, ev->name))))) {
+                        printf("[캐시] 무효화: %s\n", entry->key);
+                        cache_unlink(&file_cache, entry);
+                    }
+                    entry = next;
+                }
+            }
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+        pthread_rwlock_unlock(&file_cache.lock);
+    }
+    return NULL;
+}
+
+// 변경된 파일 이름이 캐시 항목에 영향을 주는지: 압축 변형은 "<이름>.gz" 의 생성/변경에도 무효화
+int cache_name_matches(cache_entry_t *entry, const char *name) {
+    size_t len = strlen(entry->name);
+
+    if (strcmp(entry->name, name) == 0) return 1;
+    return entry->gzip && strncmp(entry->name, name, len) == 0 && strcmp(name + len, ".gz") == 0;
+}
+
+// 요청 처리 함수
+void handle_request(conn_t *conn) {
+    http_request_t *req = &conn->req;
+
+    stats_request_start(conn, 1);
+
+    // 연결 수 한도를 넘어 받은 연결: 요청을 처리하지 않고 바로 503 후 종료 (대기열에 쌓아 두지 않음)
+    // 요청을 읽은 뒤에 답하므로 읽지 않은 데이터 때문에 RST 로 끊겨 응답이 사라지지 않음
+    if (conn->shed) {
+        conn->req.keep_alive = 0;
+        stat_add(&stats_local()->shed[SHED_CONNS], 1);
+        send_error(conn, "503 Service Unavailable");
+        stats_request_end(conn);
+        return;
+    }
+
+    // 메소드별 처리 분기 (플러그인에 연결된 경로는 메소드와 관계없이 플러그인이 처리)
+    plugin_t *plugin = plugin_find(req->uri);
+    if (strcmp(req->method, "GET") == 0)
+        conn->stat_method = METHOD_GET;
+    else if (strcmp(req->method, "POST") == 0)
+        conn->stat_method = METHOD_POST;
+
+    if (plugin) {
+        handle_plugin(conn, plugin);
+    } else if (conn->stat_method == METHOD_GET) {
+        handle_get(conn, req->uri);
+    } else if (conn->stat_method == METHOD_POST) {
+        handle_post(conn, req->uri, req->content_length);
+    } else {
+        send_error(conn, "501 Not Implemented");
+    }
+
+    // CGI 는 출력이 끝날 때 기록 (cgi_finish, 다른 연결의 실행을 기다리면 cgi_cache_wake)
+    if (!conn->cgi.active && !conn->cache_wait)
+        stats_request_end(conn);
+}
+
+// GET 요청 처리: 정적 파일 응답
+void handle_get(conn_t *conn, char *uri) {
+    char file_headers[256];
+    char etag[64];
+    struct stat st;
+
+    // 내장 통계 엔드포인트 (파일보다 우선)
+    if (strncmp(uri, "/server-stats", 13) == 0 && (uri[13] == '\0' || uri[13] == '?')) {
+        conn->stat_route = ROUTE_STATS;
+        handle_stats(conn, uri[13] ? uri + 14 : "");
+        return;
+    }
+    conn->stat_route = ROUTE_STATIC;
+
+    // 1. URI 정규화: 현재 디렉토리를 문서 루트로 가정하고 "/"는 기본 파일로 대체
+    // 경로는 요청별 영역에 만들므로 긴 URI 도 잘리지 않음
+    char *file_path = arena_printf(&conn->arena, ".%s", strcmp(uri, "/") == 0 ? "/index.html" : uri);
+    if (file_path == NULL) {
+        send_error(conn, "500 Internal Server Error");
+        return;
+    }
+
+    // 2. 캐시 적중: 디스크 접근 없이 저장된 응답 (또는 304, 206) 전송
+    // 압축 가능한 형식이고 클라이언트가 gzip 을 받으면 압축 변형을 찾음 (Range 요청은 항상 원본)
+    const char *type = mime_type(file_path);
+    int compressible = is_compressible(type);
+    int gzip = compressible && accepts_gzip(conn) && find_header(&conn->req, "Range") == NULL;
+    cache_entry_t *entry = cache_lookup(file_path, gzip);
+    if (entry) {
+        if (etag_matches(conn, entry->etag))
+            send_not_modified(conn, entry->etag);
+        else if (gzip || !handle_range(conn, type, entry->etag, entry->mtime,
+                                       entry->len - entry->head_len - 2, entry, -1))
+            cache_serve(conn, entry);
+        cache_release(entry);
+        return;
+    }
+
+    // 3. 파일 열기 (일반 파일만 허용: 연결 재사용을 위해 길이를 알아야 함)
+    int fd = open(file_path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1 || fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        if (fd != -1) close(fd);
+        send_error(conn, "404 Not Found");
+        return;
+    }
+
+    // 4. 미리 압축된 .gz 파일이 있으면 원본 대신 사용, 없으면 캐시에 넣을 때 압축
+    variant_t variant = gzip ? VARIANT_GZIP : VARIANT_RAW;
+    if (gzip) {
+        struct stat gz_st;
+        char *gz_path = arena_printf(&conn->arena, "%s.gz", file_path);
+        int gz_fd = gz_path ? open_gzip_sibling(gz_path, &st, &gz_st) : -1;
+        if (gz_fd != -1) {
+            close(fd);
+            fd = gz_fd;
+            st = gz_st;
+            variant = VARIANT_GZIP_FILE;
+        }
+    }
+
+    // 5. 캐시할 수 있는 크기면 직렬화하여 캐시에 넣고 그 항목으로 응답 (또는 304)
+    entry = cache_insert(file_path, fd, &st, variant);
+    if (entry) {
+        close(fd);
+        if (etag_matches(conn, entry->etag))
+            send_not_modified(conn, entry->etag);
+        else if (gzip || !handle_range(conn, type, entry->etag, entry->mtime,
+                                       entry->len - entry->head_len - 2, entry, -1))
+            cache_serve(conn, entry);
+        cache_release(entry);
+        return;
+    }
+
+    // 6. 캐시하지 않는 경우: 실시간 압축은 하지 않고 원본 (또는 .gz 파일) 그대로 전송
+    // 클라이언트가 가진 버전과 같으면 본문 없이 304
+    format_file_headers(file_headers, sizeof(file_headers), &st, etag, sizeof(etag),
+                        variant == VARIANT_GZIP_FILE, compressible);
+    if (etag_matches(conn, etag)) {
+        close(fd);
+        send_not_modified(conn, etag);
+        return;
+    }
+
+    // 대용량 파일의 이어받기/탐색: 요청한 구간만 파일 오프셋으로 바로 전송 (sendfile)
+    if (!gzip && handle_range(conn, type, etag, st.st_mtime, st.st_size, NULL, fd)) {
+        close(fd);
+        return;
+    }
+
+    // 7. HTTP 헤더 전송 (200 OK, 확장자별 Content-Type과 실제 파일 크기)
+    send_header(conn, "200 OK", type, st.st_size, file_headers);
+
+    // 8. 파일 내용 전송 (작은 파일은 헤더와 합쳐 writev, 큰 파일은 sendfile)
+    conn_send_file(conn, fd, 0, st.st_size);
+}
+
+// Range 헤더 해석: "bytes=" 뒤의 "a-b", "a-", "-n" 목록
+// 반환값: 만족 가능한 구간 수 (0이면 416), -1 이면 형식 오류/구간 과다 (Range 무시하고 전체 전송)
+int parse_ranges(const char *header, off_t size, byte_range_t *ranges) {
+    const char *p = header;
+    int count = 0;
+
+    if (strncasecmp(p, "bytes=", 6) != 0) return -1;
+    p += 6;
+
+    while (*p) {
+        char *end;
+        long long first, last;
+
+        p += strspn(p, " \t");
+        if (*p == '-') { // 끝에서 n 바이트
+            last = strtoll(p + 1, &end, 10);
+            if (end == p + 1 || last < 0) return -1;
+            first = size > last ? size - last : 0;
+            last = size - 1;
+        } else {
+            first = strtoll(p, &end, 10);
+            if (end == p || first < 0 || *end != '-') return -1;
+            p = end + 1;
+            if (*p >= '0' && *p <= '9') {
+                last = strtoll(p, &end, 10);
+                if (last < first) return -1;
+            } else {
+                last = size - 1;
+                end = (char *)p;
+            }
+            if (last > size - 1) last = size - 1;
+        }
+
+        // 파일 범위 밖의 구간은 건너뜀 (모두 밖이면 416)
+        if (first < size && first <= last) {
+            if (count == MAX_RANGES) return -1;
+            ranges[count].start = first;
+            ranges[count].len = last - first + 1;
+            count++;
+        }
+
+        p = end + strspn(end, " \t");
+        if (*p == ',') p++;
+        else if (*p != '\0') return -1;
+    }
+    return count;
+}
+
+// Range 요청이면 206 (구간 하나) / multipart/byteranges (여러 구간) / 416 응답을 만들고 1 반환
+// Range 가 없거나, If-Range 가 현재 버전과 다르거나, 형식이 잘못되었으면 0 (전체 응답)
+// 본문은 캐시 항목이 있으면 복사 없이 참조하고, 없으면 fd 의 구간을 sendfile 로 전송
+int handle_range(conn_t *conn, const char *type, const char *etag, time_t mtime, off_t size,
+                 cache_entry_t *entry, int fd) {
+    const char *range = find_header(&conn->req, "Range");
+    const char *if_range = find_header(&conn->req, "If-Range");
+    byte_range_t ranges[MAX_RANGES];
+    char date[64];
+    char extra[BUF_SIZE];
+
+    if (range == NULL) return 0;
+
+    // 1. If-Range: 클라이언트가 가진 조각이 현재 파일의 것일 때만 구간 전송 (강한 ETag 또는 날짜 일치)
+    http_date(mtime, date, sizeof(date));
+    if (if_range && strcmp(if_range, etag) != 0 && strcmp(if_range, date) != 0)
+        return 0;
+
+    int count = parse_ranges(range, size, ranges);
+    if (count == -1) return 0;
+
+    // 2. 만족할 수 있는 구간이 없음
+    if (count == 0) {
+        snprintf(extra, sizeof(extra), "Content-Range: bytes */%lld\r\n", (long long)size);
+        send_header(conn, "416 Range Not Satisfiable", type, 0, extra);
+        return 1;
+    }
+
+    // 3. 구간 하나: Content-Range 와 함께 그 구간만 전송
+    if (count == 1) {
+        snprintf(extra, sizeof(extra),
+                 "Content-Range: bytes %lld-%lld/%lld\r\nETag: %s\r\nLast-Modified: %s\r\nAccept-Ranges: bytes\r\n",
+                 (long long)ranges[0].start, (long long)(ranges[0].start + ranges[0].len - 1),
+                 (long long)size, etag, date);
+        send_header(conn, "206 Partial Content", type, ranges[0].len, extra);
+        send_range_body(conn, entry, fd, &ranges[0]);
+        return 1;
+    }
+
+    // 4. 여러 구간: multipart/byteranges (전체 길이를 먼저 계산해 Content-Length 로 보냄)
+    static atomic_ulong boundary_seq;
+    char boundary[40];
+    char part_head[BUF_SIZE];
+    size_t total = 0;
+
+    snprintf(boundary, sizeof(boundary), "%lx%lx", (unsigned long)time(NULL),
+             atomic_fetch_add(&boundary_seq, 1) ^ hash_string(etag));
+    for (int i = 0; i < count; i++) {
+        total += snprintf(part_head, sizeof(part_head),
+                          "\r\n--%s\r\nContent-Type: %s\r\nContent-Range: bytes %lld-%lld/%lld\r\n\r\n",
+                          boundary, type, (long long)ranges[i].start,
+                          (long long)(ranges[i].start + ranges[i].len - 1), (long long)size);
+        total += ranges[i].len;
+    }
+    total += strlen(boundary) + 8; // "\r\n--" boundary "--\r\n"
+
+    char multipart_type[80];
+    snprintf(multipart_type, sizeof(multipart_type), "multipart/byteranges; boundary=%s", boundary);
+    snprintf(extra, sizeof(extra), "ETag: %s\r\nLast-Modified: %s\r\nAccept-Ranges: bytes\r\n", etag, date);
+    send_header(conn, "206 Partial Content", multipart_type, total, extra);
+
+    for (int i = 0; i < count; i++) {
+        int len = snprintf(part_head, sizeof(part_head),
+                           "\r\n--%s\r\nContent-Type: %s\r\nContent-Range: bytes %lld-%lld/%lld\r\n\r\n",
+                           boundary, type, (long long)ranges[i].start,
+                           (long long)(ranges[i].start + ranges[i].len - 1), (long long)size);
+        conn_send(conn, part_head, len);
+        send_range_body(conn, entry, fd, &ranges[i]);
+    }
+    int len = snprintf(part_head, sizeof(part_head), "\r\n--%s--\r\n", boundary);
+    conn_send(conn, part_head, len);
+    return 1;
+}
+
+// 구간 본문 전송: 캐시 항목은 본문 부분을 참조, 파일은 fd 를 복제해 그 구간만 sendfile
+void send_range_body(conn_t *conn, cache_entry_t *entry, int fd, byte_range_t *range) {
+    if (entry) {
+        conn_send_ref(conn, entry, entry->head_len + 2 + range->start, range->len);
+        return;
+    }
+
+    int dup_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0); // 조각마다 fd 를 소유하고 전송 후 닫으므로 복제
+    if (dup_fd == -1) {
+        perror("fcntl(F_DUPFD_CLOEXEC) 오류");
+        conn->closing = 1; // 약속한 길이를 채울 수 없으므로 연결을 끊어 잘린 응답임을 알림
+        return;
+    }
+    conn_send_file(conn, dup_fd, range->start, range->len);
+}
+
+// POST 요청 처리 및 CGI 실행
+// 본문은 여기서 읽지 않고 도착하는 대로 CGI 표준 입력으로 전달됨
+void handle_post(conn_t *conn, char *uri, size_t content_length) {
+    // CGI 경로 검사
+    if (strncmp(uri, "/cgi-bin/", 9) == 0) {
+        // URI의 "?" 뒤는 CGI 규약대로 QUERY_STRING 으로 전달 (요청별 영역에 복사하므로 길이 제한 없음)
+        char *query = strchr(uri, '?');
+        size_t path_len = query ? (size_t)(query - uri) : strlen(uri);
+        char *cgi_path = arena_printf(&conn->arena, ".%.*s", (int)path_len, uri);
+        char *query_string = arena_printf(&conn->arena, "%s", query ? query + 1 : "");
+        if (cgi_path == NULL || query_string == NULL) {
+            send_error(conn, "500 Internal Server Error");
+            return;
+        }
+
+        conn->stat_route = ROUTE_CGI;
+
+        // CGI 표준 입력과 CONTENT_LENGTH 는 Content-Length 로만 정함: chunked 업로드는 파서가 이미 501 로 거절하지만,
+        // 길이를 모르는 본문을 빈 입력으로 넘겨 조용히 잃지 않도록 실행 전에 한 번 더 확인
+        const char *te = find_header(&conn->req, "Transfer-Encoding");
+        if (te && strcasecmp(te, "identity") != 0) {
+            conn->req.keep_alive = 0;
+            send_error(conn, "501 Not Implemented");
+            return;
+        }
+
+        // 응답을 캐시하는 스크립트: 캐시에 있거나 같은 요청이 실행 중이면 실행하지 않음
+        if (cgi_cache_request(conn, cgi_path, query_string))
+            return;
+
+        // 본문 전송 전에 확인을 기다리는 클라이언트에게 바로 보내라고 알림
+        const char *expect = find_header(&conn->req, "Expect");
+        if (expect && strcasecmp(expect, "100-continue") == 0 && content_length > 0 &&
+            conn->req.http11 && !conn->continue_sent)
+            conn_send(conn, "HTTP/1.1 100 Continue\r\n\r\n", 25);
+
+        execute_cgi(conn, cgi_path, query_string);
+        if (conn->cgi.cache && !conn->cgi.active) // 시작 실패나 거절: 기다리던 연결에도 알림
+            cgi_cache_complete(conn, conn->status == 503 ? "503 Service Unavailable" : "502 Bad Gateway");
+    } else {
+        send_error(conn, "404 Not Found");
+    }
+}
+
+// CGI 프로그램 실행: 상주 워커 풀이 있는 스크립트는 풀에서, 나머지는 요청마다 fork/exec
+// 출력은 이벤트 루프가 읽는 대로 클라이언트에 전달 (cgi_on_readable)
+// 시작에 걸린 시간(fork/exec 또는 풀 워커 확보)과 시작 시각을 통계용으로 기록
+void execute_cgi(conn_t *conn, char *path, char *query_string) {
+    fcgi_pool_t *pool = fcgi_find_pool(path);
+    uint64_t start = now_usec();
+    cgi_kind_t kind = CGI_POOL;
+
+    // 동시 실행 한도: 넘으면 프로세스를 만들거나 워커를 기다리지 않고 바로 503 (cgi_detach 에서 반환)
+    if (atomic_fetch_add(&cgi_running, 1) >= config.max_cgi && config.max_cgi > 0) {
+        atomic_fetch_sub(&cgi_running, 1);
+        stat_add(&stats_local()->shed[SHED_CGI], 1);
+        send_error(conn, "503 Service Unavailable");
+        return;
+    }
+
+    if (pool == NULL || fcgi_start(conn, pool, query_string) == -1) {
+        kind = CGI_EXEC;
+        if (cgi_start_exec(conn, path, query_string) == -1) {
+            atomic_fetch_sub(&cgi_running, 1);
+            send_error(conn, "500 Internal Server Error");
+            return;
+        }
+    }
+    conn->cgi.started = start;
+    hist_record(&stats_local()->cgi_spawn[kind], now_usec() - start);
+}
+
+// 일회성 CGI 실행 (프로토콜을 지원하지 않는 스크립트용 기존 방식)
+int cgi_start_exec(conn_t *conn, char *path, char *query_string) {
+    int cgi_output[2];
+    int cgi_input[2];
+    int pid;
+    char content_length[32];
+    const char *content_type = find_header(&conn->req, "Content-Type");
+
+    snprintf(content_length, sizeof(content_length), "%zu", conn->req.content_length);
+
+    // 1. CGI 프로그램이 결과를 보낼 파이프와 요청 본문을 받을 파이프 생성
+    // 다른 쓰레드가 동시에 fork 해도 파이프가 새지 않도록 CLOEXEC 지정
+    if (pipe2(cgi_output, O_CLOEXEC) < 0) {
+        perror("pipe() 오류");
+        return -1;
+    }
+    if (pipe2(cgi_input, O_CLOEXEC) < 0) {
+        perror("pipe() 오류");
+        close(cgi_output[0]);
+        close(cgi_output[1]);
+        return -1;
+    }
+
+    // 2. 자식 프로세스 생성
+    if ((pid = fork()) < 0) {
+        close(cgi_output[0]);
+        close(cgi_output[1]);
+        close(cgi_input[0]);
+        close(cgi_input[1]);
+        perror("fork() 오류");
+        return -1;
+    }
+
+    if (pid == 0) { // 자식 프로세스 (CGI 실행)
+        // 실행 시간 초과 시 스크립트가 띄운 하위 프로세스까지 함께 끝낼 수 있도록 별도 프로세스 그룹
+        setpgid(0, 0);
+
+        // 3. CGI의 표준 출력(stdout)을 파이프의 쓰기 종단에, 표준 입력(stdin)을 본문 파이프에 연결
+        close(cgi_output[0]); // 읽기 종단 닫기
+        close(cgi_input[1]);
+        dup2(cgi_output[1], STDOUT_FILENO); // stdout을 파이프의 쓰기 종단으로 리다이렉션 (dup2 결과는 CLOEXEC 해제)
+        dup2(cgi_input[0], STDIN_FILENO);
+
+        // 4. CGI 환경 변수 설정 (본문 길이와 형식은 CGI/1.1 규약의 변수로 전달)
+        setenv("GATEWAY_INTERFACE", "CGI/1.1", 1);
+        setenv("SERVER_PROTOCOL", conn->req.version, 1);
+        setenv("REQUEST_METHOD", "POST", 1);
+        setenv("SCRIPT_NAME", path + 1, 1);
+        setenv("QUERY_STRING", query_string, 1);
+        setenv("CONTENT_LENGTH", content_length, 1);
+        if (content_type)
+            setenv("CONTENT_TYPE", content_type, 1);
+
+        // 5. CGI 프로그램 실행 (exec)
+        execlp(path, path, NULL);
+
+        // execlp 실패 시 에러 출력 및 종료
+        _exit(1);
+    }
+
+    // 부모 프로세스 (웹 서버)
+    // 3. 파이프의 쓰기 종단을 닫고, 자식이 끝나기를 기다리지 않고 출력을 읽기 시작
+    // (기다리면 파이프 버퍼보다 큰 출력에서 교착 상태가 됨)
+    close(cgi_output[1]);
+    close(cgi_input[0]);
+    conn->cgi.pid = pid;
+    cgi_attach(conn, cgi_output[0]);
+
+    // 4. 본문 파이프는 논블로킹으로 두고 본문이 도착하는 대로 씀 (본문이 없으면 바로 EOF)
+    conn->cgi.in_fd = cgi_input[1];
+    conn->cgi.stdin_open = 1;
+    fcntl(cgi_input[1], F_SETFL, fcntl(cgi_input[1], F_GETFL) | O_NONBLOCK);
+    if (conn->req.content_length == 0)
+        cgi_close_stdin(conn);
+    return 0;
+}
+
+// CGI 출력 fd 를 이벤트 루프에 등록 (레벨 트리거)
+void cgi_attach(conn_t *conn, int fd) {
+    cgi_job_t *job = &conn->cgi;
+
+    job->active = 1;
+    job->fd = fd;
+    job->stdin_open = 0;
+    job->in_waiting = 0;
+    job->paused = 0;
+    job->headers_sent = 0;
+    job->keep_alive = conn->req.keep_alive;
+    job->chunked = strcmp(conn->req.version, "HTTP/1.0") != 0;
+    job->head.len = job->head.off = 0;
+    job->rec_header_got = job->rec_left = job->pad_left = 0;
+    job->in_header_left = job->in_rec_left = 0;
+    // 풀 워커 소켓도 논블로킹: 느린 워커에 큰 본문을 보내느라 이벤트 루프가 멈추지 않도록
+    // (fcgi_start 의 요청 레코드는 작고, 유휴 워커의 소켓은 비어 있으므로 write_full 로 한 번에 들어감)
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    if (conn->worker) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = job;
+        if (epoll_ctl(conn->worker->epfd, EPOLL_CTL_ADD, fd, &ev) == -1)
+            perror("epoll_ctl() 오류");
+    }
+}
+
+// 이벤트 루프에서 CGI fd 제거 (파이프는 닫고, 풀 워커 소켓은 워커에게 돌려줌)
+void cgi_detach(conn_t *conn) {
+    cgi_job_t *job = &conn->cgi;
+
+    if (job->stdin_open) {
+        job->stdin_open = 0;
+        cgi_wait_stdin(conn, 0); // close 전에 epoll 에서 제거 (conn_destroy 참고)
+        if (job->in_fd != -1)
+            close(job->in_fd);
+        job->in_fd = -1;
+    }
+
+    if (conn->worker)
+        epoll_ctl(conn->worker->epfd, EPOLL_CTL_DEL, job->fd, NULL);
+    if (job->pool == NULL)
+        close(job->fd);
+    job->fd = -1;
+    job->in_waiting = 0; // 풀 워커가 끝 레코드를 기다리던 경우 (소켓 등록은 위에서 함께 제거)
+    job->active = 0;
+    atomic_fetch_sub(&cgi_running, 1);
+}
+
+// 요청 본문을 CGI 표준 입력으로 씀. 반환값: 받아들인 바이트 수 (가득 차면 0), 오류 시 -1
+// 파이프(풀 워커는 소켓)가 가득 차면 쓰기 가능해질 때까지 대기
+ssize_t cgi_write_stdin(conn_t *conn, const char *data, size_t len) {
+    cgi_job_t *job = &conn->cgi;
+
+    if (job->in_waiting) return 0;
+
+    // 상주 워커: FCGI_STDIN 레코드로 전송 (헤더를 먼저 다 보낸 뒤 내용은 레코드에 남은 만큼만)
+    // 내용을 일부만 보냈으면 남은 바이트는 수신 버퍼에 그대로 있으므로 다음 호출에서 이어서 보냄
+    if (job->pool) {
+        if (job->in_header_left == 0 && job->in_rec_left == 0) {
+            if (len > FCGI_MAX_CONTENT) len = FCGI_MAX_CONTENT;
+            fcgi_stdin_header(job, len);
+        }
+        int r = cgi_flush_stdin(conn);
+        if (r <= 0) return r;
+        if (len > job->in_rec_left) len = job->in_rec_left;
+    }
+
+    ssize_t n = write(job->pool ? job->fd : job->in_fd, data, len);
+    if (n >= 0) {
+        if (job->pool) job->in_rec_left -= n;
+        return n;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        cgi_wait_stdin(conn, 1);
+        return 0;
+    }
+    if (errno == EINTR) return 0;
+    return -1; // EPIPE: CGI 가 입력을 읽지 않고 종료
+}
+
+// 본문 끝: 표준 입력 파이프를 닫거나 (EOF) 빈 STDIN 레코드 전송
+void cgi_close_stdin(conn_t *conn) {
+    cgi_job_t *job = &conn->cgi;
+
+    job->stdin_open = 0;
+    if (job->pool) {
+        // 보내던 레코드가 남았으면 (본문 도중 클라이언트가 끊김) 레코드 경계를 맞출 수 없으므로 실패 처리
+        if (job->in_header_left > 0 || job->in_rec_left > 0) {
+            cgi_finish(conn, 0);
+            return;
+        }
+        fcgi_stdin_header(job, 0);
+        if (cgi_flush_stdin(conn) == -1) // 0 이면 쓰기 가능해질 때 cgi_on_writable 에서 마저 보냄
+            cgi_finish(conn, 0);
+        return;
+    }
+    cgi_wait_stdin(conn, 0);
+    close(job->in_fd);
+    job->in_fd = -1;
+}
+
+// 상주 워커로 보낼 STDIN 레코드 헤더 준비 (내용 길이 0 은 본문 끝)
+void fcgi_stdin_header(cgi_job_t *job, size_t len) {
+    unsigned char header[8] = { FCGI_VERSION_1, FCGI_STDIN, 0, 1, len >> 8, len & 0xff, 0, 0 };
+
+    memcpy(job->in_header, header, sizeof(header));
+    job->in_header_left = sizeof(header);
+    job->in_rec_left = len;
+}
+
+// 보내지 못한 STDIN 레코드 헤더 전송. 반환값: 다 보냄 1, 소켓이 가득 차 대기 0, 오류 -1
+int cgi_flush_stdin(conn_t *conn) {
+    cgi_job_t *job = &conn->cgi;
+
+    while (job->in_header_left > 0) {
+        ssize_t n = write(job->fd, job->in_header + sizeof(job->in_header) - job->in_header_left, job->in_header_left);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                cgi_wait_stdin(conn, 1);
+                return 0;
+            }
+            return -1;
+        }
+        job->in_header_left -= n;
+    }
+    return 1;
+}
+
+// 표준 입력 파이프의 쓰기 가능 이벤트 감시 시작/중지
+// 풀 워커는 출력과 같은 소켓이므로 따로 등록하지 않고 그 소켓의 이벤트에 EPOLLOUT 을 더하거나 뺌
+void cgi_wait_stdin(conn_t *conn, int waiting) {
+    cgi_job_t *job = &conn->cgi;
+
+    if (job->in_waiting == waiting) return;
+    job->in_waiting = waiting;
+    if (conn->worker) {
+        struct epoll_event ev;
+        if (job->pool) {
+            ev.events = (job->paused ? 0 : EPOLLIN) | (waiting ? EPOLLOUT : 0);
+            ev.data.ptr = job;
+            epoll_ctl(conn->worker->epfd, EPOLL_CTL_MOD, job->fd, &ev);
+            return;
+        }
+        ev.events = EPOLLOUT;
+        ev.data.ptr = &job->in_ev_type;
+        epoll_ctl(conn->worker->epfd, waiting ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, job->in_fd, &ev);
+    }
+}
+
+// 표준 입력에 다시 쓸 수 있음: 본문 전달은 conn_process 에서 재개하고,
+// 본문 끝의 빈 STDIN 레코드를 다 보내지 못했으면 여기서 마저 보냄
+void cgi_on_writable(conn_t *conn) {
+    cgi_wait_stdin(conn, 0);
+    if (conn->cgi.pool && !conn->cgi.stdin_open && cgi_flush_stdin(conn) == -1)
+        cgi_finish(conn, 0);
+}
+
+// 클라이언트 전송이 밀리면 CGI 읽기를 멈추고, 다 보내면 재개 (메모리 사용 제한)
+void cgi_set_paused(conn_t *conn, int paused) {
+    conn->cgi.paused = paused;
+    if (conn->worker) {
+        struct epoll_event ev;
+        ev.events = (paused ? 0 : EPOLLIN) | (conn->cgi.pool && conn->cgi.in_waiting ? EPOLLOUT : 0);
+        ev.data.ptr = &conn->cgi;
+        epoll_ctl(conn->worker->epfd, EPOLL_CTL_MOD, conn->cgi.fd, &ev);
+    }
+}
+
+// CGI 출력 읽기: 읽을 수 있는 만큼 읽어 바로 전달 (EAGAIN 또는 EOF 까지)
+void cgi_on_readable(conn_t *conn) {
+    cgi_job_t *job = &conn->cgi;
+    char buf[BUF_SIZE * 16];
+
+    while (job->active) {
+        if (conn->out_pending >= MAX_PENDING_OUTPUT) {
+            cgi_set_paused(conn, 1);
+            return;
+        }
+
+        ssize_t n = job->pool ? recv(job->fd, buf, sizeof(buf), MSG_DONTWAIT) : read(job->fd, buf, sizeof(buf));
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            cgi_finish(conn, 0);
+            return;
+        }
+        if (n == 0) { // 파이프/소켓 EOF
+            cgi_finish(conn, job->pool == NULL); // 풀 워커는 END_REQUEST 전에 끊기면 실패
+            return;
+        }
+
+        if (job->pool)
+            fcgi_decode(conn, buf, n);
+        else
+            cgi_forward(conn, buf, n);
+    }
+}
+
+// CGI 표준 출력 바이트 전달: 헤더 부분은 모아서 변환하고, 본문은 chunk 로 감싸 전송
+void cgi_forward(conn_t *conn, const char *data, size_t len) {
+    cgi_job_t *job = &conn->cgi;
+    char size_line[32];
+
+    if (!job->headers_sent) {
+        // 1. 빈 줄(\r\n\r\n 또는 \n\n)이 나올 때까지 헤더를 모음
+        buffer_append(&job->head, data, len);
+        char *head = job->head.data;
+        char *end = strstr(head, "\r\n\r\n");
+        size_t sep = 4;
+        char *lf_end = strstr(head, "\n\n");
+        if (lf_end && (end == NULL || lf_end < end)) {
+            end = lf_end;
+            sep = 2;
+        }
+        if (end == NULL) {
+            if (job->head.len > CGI_MAX_HEADER)
+                cgi_finish(conn, 0);
+            return;
+        }
+
+        // 2. CGI 헤더를 HTTP 응답 헤더로 변환해 보내고, 뒤에 붙어 온 본문은 이어서 전달
+        size_t head_len = end - head;
+        size_t body_len = job->head.len - head_len - sep;
+        job->headers_sent = 1;
+        cgi_send_headers(conn, head, head_len);
+        if (body_len > 0)
+            cgi_forward(conn, end + sep, body_len);
+        job->head.len = 0;
+        return;
+    }
+
+    if (len == 0) return; // 길이 0 chunk 는 응답 끝을 뜻하므로 보내지 않음
+    cgi_cache_capture(conn, data, len);
+    if (job->chunked) {
+        int n = snprintf(size_line, sizeof(size_line), "%zx\r\n", len);
+        conn_send(conn, size_line, n);
+        conn_send(conn, data, len);
+        conn_send(conn, "\r\n", 2);
+    } else {
+        conn_send(conn, data, len);
+    }
+}
+
+// CGI 헤더 변환: "Status:" 는 상태 줄로, 나머지는 그대로 전달하고 본문 길이 관련 헤더는 서버가 결정
+void cgi_send_headers(conn_t *conn, char *head, size_t len) {
+    cgi_job_t *job = &conn->cgi;
+    char status[64] = "200 OK";
+    char header[CGI_MAX_HEADER + 256];
+    size_t hlen = 0;
+    int has_type = 0, has_location = 0, has_status = 0;
+    char *save;
+
+    head[len] = '\0';
+    for (char *line = strtok_r(head, "\r\n", &save); line; line = strtok_r(NULL, "\r\n", &save)) {
+        char *colon = strchr(line, ':');
+        if (colon == NULL) continue;
+        *colon = '\0';
+        char *value = colon + 1;
+        while (*value == ' ' || *value == '\t') value++;
+
+        if (strcasecmp(line, "Status") == 0) {
+            snprintf(status, sizeof(status), "%s", value);
+            has_status = 1;
+            continue;
+        }
+        if (strcasecmp(line, "Content-Length") == 0 || strcasecmp(line, "Transfer-Encoding") == 0 ||
+            strcasecmp(line, "Connection") == 0)
+            continue;
+        if (strcasecmp(line, "Content-Type") == 0) {
+            has_type = 1;
+            line = "Content-Type";
+        }
+        if (strcasecmp(line, "Location") == 0)
+            has_location = 1;
+        hlen += snprintf(header + hlen, sizeof(header) - hlen, "%s: %s\r\n", line, value);
+        if (hlen >= sizeof(header)) hlen = sizeof(header) - 1;
+    }
+    if (has_location && !has_status)
+        strcpy(status, "302 Found");
+
+    // HTTP/1.0 클라이언트는 chunked 를 모르므로 연결 종료로 본문 끝을 알림
+    if (!job->chunked)
+        conn->closing = 1;
+
+    char prefix[BUF_SIZE];
+    int plen = snprintf(prefix, sizeof(prefix), "HTTP/1.1 %s\r\n%s", status,
+                        has_type ? "" : "Content-Type: text/html; charset=utf-8\r\n");
+    conn_send(conn, prefix, plen);
+    conn_send(conn, header, hlen);
+    if (job->cache) { // 캐시에는 전송 방식과 Connection 을 뺀 헤더만 둠 (응답할 때 Content-Length 로 채움)
+        cgi_cache_capture(conn, prefix, plen);
+        cgi_cache_capture(conn, header, hlen);
+        job->capture_head = job->capture.len;
+    }
+    plen = snprintf(prefix, sizeof(prefix), "%sConnection: %s\r\n\r\n",
+                    job->chunked ? "Transfer-Encoding: chunked\r\n" : "",
+                    (job->keep_alive && job->chunked) ? "keep-alive" : "close");
+    conn_send(conn, prefix, plen);
+    conn->status = atoi(status);
+}
+
+// CGI 종료 처리: 정상이면 마지막 chunk 로 응답을 닫고, 헤더도 못 받았으면 502
+void cgi_finish(conn_t *conn, int ok) {
+    cgi_job_t *job = &conn->cgi;
+    // 워커가 본문을 다 받기 전에 응답을 끝냈으면 소켓에 남은 STDIN 레코드가 다음 요청에 섞이므로 재사용하지 않음
+    int stdin_done = !job->stdin_open && job->in_header_left == 0;
+
+    if (!job->headers_sent) {
+        // 헤더 없이 끝남 (실행 실패 등): 아직 아무것도 보내지 않았으므로 오류 응답 가능
+        send_error(conn, "502 Bad Gateway");
+    } else if (!ok) {
+        // 본문 도중 실패: 길이 0 chunk 를 보내면 정상 종료로 오인되므로 연결을 끊음
+        conn->closing = 1;
+    } else if (job->chunked) {
+        conn_send(conn, "0\r\n\r\n", 5);
+    }
+    conn->cgi_usec = now_usec() - job->started;
+    hist_record(&stats_local()->cgi_run, conn->cgi_usec);
+    stats_request_end(conn);
+    if (job->cache)
+        cgi_cache_complete(conn, job->headers_sent && ok ? NULL : "502 Bad Gateway");
+
+    cgi_detach(conn);
+    buffer_free(&job->head);
+
+    if (job->pool) {
+        fcgi_release(job->pool, job->worker, ok && stdin_done);
+        job->pool = NULL;
+        job->worker = NULL;
+    } else {
+        reap_child(job->pid);
+        job->pid = 0;
+    }
+}
+
+// 클라이언트가 먼저 끊긴 경우: CGI를 중단시키고 정리
+void cgi_abort(conn_t *conn) {
+    cgi_job_t *job = &conn->cgi;
+
+    if (job->cache)
+        cgi_cache_complete(conn, "502 Bad Gateway");
+    cgi_detach(conn);
+    if (job->pool) {
+        fcgi_release(job->pool, job->worker, 0); // 요청 도중 상태를 알 수 없으므로 교체
+        job->pool = NULL;
+        job->worker = NULL;
+    } else {
+        // 시간 초과 때처럼 프로세스 그룹 전체를 SIGKILL: SIGTERM 을 무시하는 스크립트나 손자 프로세스가
+        // 남으면 끝낼 타이머가 없어 계속 돌고 정리 목록에도 영영 남음
+        kill(-job->pid, SIGKILL);
+        reap_child(job->pid);
+        job->pid = 0;
+    }
+}
+
+// CGI 실행 시간 초과: 자식(상주 워커면 그 워커)을 SIGKILL 로 끝내고 연결도 종료
+// 아직 응답 헤더를 보내지 않았으면 504, 본문 도중이면 chunk 를 끝맺지 않고 끊어 잘렸음을 알림
+void cgi_timeout(conn_t *conn) {
+    cgi_job_t *job = &conn->cgi;
+
+    // 다른 연결이 실행 중인 같은 요청을 기다리다 시간 초과 (실행 중인 쪽은 자기 타이머로 정리)
+    if (conn->cache_wait) {
+        cgi_cache_unwait(conn);
+        conn->req.keep_alive = 0;
+        conn->closing = 1;
+        send_error(conn, "504 Gateway Timeout");
+        stats_request_end(conn);
+        return;
+    }
+
+    // SIGTERM 을 무시하는 스크립트도 있으므로 SIGKILL (일회성 실행은 프로세스 그룹 전체)
+    if (job->pool)
+        kill(job->worker->pid, SIGKILL);
+    else
+        kill(-job->pid, SIGKILL);
+    conn->req.keep_alive = 0;
+    conn->closing = 1;
+    conn->body_left = 0; // 남은 업로드는 받지 않음
+    if (!job->headers_sent)
+        send_error(conn, "504 Gateway Timeout");
+    if (job->cache)
+        cgi_cache_complete(conn, "504 Gateway Timeout");
+    conn->cgi_usec = now_usec() - job->started;
+    hist_record(&stats_local()->cgi_run, conn->cgi_usec);
+    stats_request_end(conn);
+    cgi_abort(conn);
+}
+
+// blocking 모드: CGI가 끝날 때까지 본문을 CGI 로 보내고 출력을 읽어 바로 클라이언트로 전송
+void cgi_run_blocking(conn_t *conn) {
+    struct pollfd pfd[3];
+    uint64_t deadline = config.cgi_timeout > 0 ? conn->cgi.started + config.cgi_timeout * 1000000ULL : 0;
+
+    conn_flush(conn); // 100 Continue 등 이미 쌓인 응답을 먼저 보냄
+    while (conn->cgi.active) {
+        int n = 0;
+
+        // 받아 둔 본문을 CGI 로 전달 (클라이언트가 본문 도중 끊으면 받은 만큼으로 끝냄)
+        if (conn->body_left > 0) {
+            conn_consume_body(conn);
+            if (conn->body_left > 0 && conn->peer_closed && conn->in.off == conn->in.len) {
+                conn->body_left = 0;
+                if (conn->cgi.stdin_open)
+                    cgi_close_stdin(conn);
+            }
+        }
+
+        size_t buffered = conn->in.len - conn->in.off;
+
+        pfd[n].fd = conn->cgi.fd;
+        pfd[n++].events = POLLIN | (conn->cgi.pool && conn->cgi.in_waiting ? POLLOUT : 0);
+        if (conn->cgi.in_waiting && conn->cgi.pool == NULL) { // 표준 입력 파이프가 비기를 기다림
+            pfd[n].fd = conn->cgi.in_fd;
+            pfd[n++].events = POLLOUT;
+        }
+        if (conn->body_left > buffered && buffered < MAX_REQUEST_SIZE && !conn->peer_closed) {
+            pfd[n].fd = conn->fd; // 본문이 더 올 예정
+            pfd[n++].events = POLLIN;
+        }
+        int wait_msec = -1;
+        if (deadline) {
+            uint64_t now = now_usec();
+            if (now >= deadline) {
+                stat_add(&stats_local()->timeouts[TIMEOUT_CGI], 1);
+                cgi_timeout(conn);
+                conn_flush(conn);
+                return;
+            }
+            wait_msec = (deadline - now + 999) / 1000;
+        }
+        if (poll(pfd, n, wait_msec) == -1 && errno != EINTR)
+            break;
+
+        for (int i = 1; i < n; i++) {
+            if (pfd[i].revents == 0) continue;
+            if (pfd[i].fd == conn->fd) {
+                if (conn_fill(conn) <= 0)
+                    conn->peer_closed = 1;
+            } else {
+                cgi_on_writable(conn);
+            }
+        }
+        if (pfd[0].revents & POLLOUT) // 풀 워커 소켓에 본문을 더 쓸 수 있음
+            cgi_on_writable(conn);
+        if ((pfd[0].revents & ~POLLOUT) && conn->cgi.active)
+            cgi_on_readable(conn);
+        if (conn_flush(conn) == -1) {
+            if (conn->cgi.active)
+                cgi_abort(conn);
+            return;
+        }
+    }
+}
+
+// 종료된 CGI 자식 회수. 아직 실행 중이면 목록에 두었다가 다음 호출 때 다시 확인
+void reap_child(pid_t pid) {
+    pthread_mutex_lock(&reap_lock);
+    if (pid > 0 && waitpid(pid, NULL, WNOHANG) == 0) {
+        if (reap_count == reap_cap) {
+            int cap = reap_cap ? reap_cap * 2 : 16;
+            pid_t *p = realloc(reap_pids, cap * sizeof(pid_t));
+            if (p) {
+                reap_pids = p;
+                reap_cap = cap;
+            }
+        }
+        if (reap_count < reap_cap)
+            reap_pids[reap_count++] = pid;
+    }
+    for (int i = 0; i < reap_count; ) {
+        if (waitpid(reap_pids[i], NULL, WNOHANG) != 0)
+            reap_pids[i] = reap_pids[--reap_count];
+        else
+            i++;
+    }
+    pthread_mutex_unlock(&reap_lock);
+}
+
+// --- CGI 응답 캐시 ---
+
+cgi_cache_rule_t *cgi_cache_find_rule(const char *path) {
+    for (int i = 0; i < cgi_cache_rule_count; i++) {
+        if (strcmp(cgi_cache_rules[i].path, path) == 0)
+            return &cgi_cache_rules[i];
+    }
+    return NULL;
+}
+
+// 응답을 캐시하는 스크립트면 캐시에서 응답하거나, 같은 요청이 실행 중이면 그 결과를 기다림 (1: 처리함)
+// 처음 보는 요청이면 빈 항목을 등록하고 0 을 돌려 이 연결이 실행 (결과는 cgi_cache_complete 에서 채움)
+// 키: 스크립트 경로, QUERY_STRING, Content-Type, 본문 (본문이 수신 버퍼에 다 있을 때만 캐시)
+int cgi_cache_request(conn_t *conn, const char *path, const char *query_string) {
+    http_request_t *req = &conn->req;
+    const char *content_type = find_header(req, "Content-Type");
+    const char *body = conn->in.data + conn->in.off + conn->header_len;
+
+    if (config.cgi_cache_size == 0 || cgi_cache_find_rule(path) == NULL ||
+        conn->in.len - conn->in.off < conn->header_len + req->content_length)
+        return 0;
+
+    // 1. 키 만들기 ('\0' 으로 구분해 이어 붙임)
+    const char *parts[3] = { path, query_string, content_type ? content_type : "" };
+    size_t key_len = req->content_length, off = 0;
+    for (int i = 0; i < 3; i++)
+        key_len += strlen(parts[i]) + 1;
+    char *key = arena_alloc(&conn->arena, key_len);
+    if (key == NULL) return 0;
+    for (int i = 0; i < 3; i++) {
+        size_t n = strlen(parts[i]) + 1;
+        memcpy(key + off, parts[i], n);
+        off += n;
+    }
+    memcpy(key + off, body, req->content_length);
+    unsigned long hash = hash_bytes(key, key_len);
+
+    // 2. 조회 (만료된 항목은 지우고 없는 것으로 봄)
+    pthread_rwlock_wrlock(&cgi_cache.lock);
+    cache_entry_t *entry;
+    for (entry = cgi_cache.buckets[hash % CACHE_BUCKETS]; entry; entry = entry->hash_next) {
+        if (entry->hash == hash && entry->key_len == key_len && memcmp(entry->key, key, key_len) == 0)
+            break;
+    }
+    if (entry && !entry->pending && entry->expires <= now_usec() / 1000) {
+        cache_unlink(&cgi_cache, entry);
+        entry = NULL;
+    }
+
+    // 3. 적중: 실행 없이 저장된 응답 전송
+    if (entry && !entry->pending) {
+        atomic_store(&entry->referenced, 1);
+        atomic_fetch_add(&entry->refs, 1);
+        pthread_rwlock_unlock(&cgi_cache.lock);
+        cache_serve(conn, entry);
+        cache_release(entry);
+        stat_add(&stats_local()->cgi_cache[CGI_CACHE_HIT], 1);
+        return 1;
+    }
+
+    // 4. 같은 요청이 실행 중: 끝나면 실행한 쓰레드가 이 워커를 깨움 (blocking 모드는 한 번에 하나라 생기지 않음)
+    if (entry) {
+        if (conn->worker == NULL) {
+            pthread_rwlock_unlock(&cgi_cache.lock);
+            return 0;
+        }
+        atomic_fetch_add(&entry->refs, 1);
+        entry->wake_mask |= 1ULL << (conn->worker->id % 64);
+        pthread_rwlock_unlock(&cgi_cache.lock);
+        conn->cache_wait = entry;
+        conn->wait_next = conn->worker->cache_waiters;
+        conn->worker->cache_waiters = conn;
+        conn->cgi.started = now_usec(); // CGI 실행 제한 시간을 기다리는 시간에도 적용
+        stat_add(&stats_local()->cgi_cache[CGI_CACHE_COALESCED], 1);
+        return 1;
+    }
+
+    // 5. 처음 보는 요청: 실행 중 표시만 한 항목을 등록하고 이 연결이 실행
+    entry = calloc(1, sizeof(cache_entry_t));
+    if (entry == NULL || (entry->key = malloc(key_len)) == NULL) {
+        pthread_rwlock_unlock(&cgi_cache.lock);
+        free(entry);
+        return 0;
+    }
+    memcpy(entry->key, key, key_len);
+    entry->key_len = key_len;
+    entry->hash = hash;
+    entry->pending = 1;
+    atomic_store(&entry->refs, 2); // 캐시 + 실행하는 연결
+    cache_link(&cgi_cache, entry, config.cgi_cache_size);
+    pthread_rwlock_unlock(&cgi_cache.lock);
+
+    conn->cgi.cache = entry;
+    conn->cgi.capture.len = 0;
+    conn->cgi.capture_head = 0;
+    conn->cgi.capture_overflow = 0;
+    stat_add(&stats_local()->cgi_cache[CGI_CACHE_MISS], 1);
+    return 0;
+}
+
+// 실행 중인 요청의 응답(변환한 헤더와 본문)을 캐시용으로 모음. 캐시 파일 한도를 넘으면 포기
+void cgi_cache_capture(conn_t *conn, const char *data, size_t len) {
+    cgi_job_t *job = &conn->cgi;
+
+    if (job->cache == NULL || job->capture_overflow) return;
+    if (job->capture.len + len > CACHE_MAX_FILE || buffer_append(&job->capture, data, len) == -1) {
+        job->capture_overflow = 1;
+        buffer_free(&job->capture);
+    }
+}
+
+// 실행이 끝남: 모은 응답을 항목에 넣고 기다리던 연결이 있는 워커를 깨움
+// 200 응답은 TTL 동안 보관하고, 그 밖의 응답은 지금 기다리는 연결에만 전달한 뒤 제거
+// failed: 실패한 경우 기다리던 연결에 보낼 상태 (NULL 이면 정상 종료)
+void cgi_cache_complete(conn_t *conn, const char *failed) {
+    cgi_job_t *job = &conn->cgi;
+    cache_entry_t *entry = job->cache;
+    cgi_cache_rule_t *rule = cgi_cache_find_rule(entry->key); // 키는 스크립트 경로로 시작
+    char *data = NULL;
+    size_t len = 0, head_len = 0;
+
+    job->cache = NULL;
+
+    // 1. 직렬화: 상태 줄과 헤더 + Content-Length + 빈 줄 + 본문 (Connection 은 정적 캐시처럼 응답할 때 끼움)
+    if (failed == NULL && !job->capture_overflow && job->capture_head > 0) {
+        char length[64];
+        size_t body_len = job->capture.len - job->capture_head;
+        int n = snprintf(length, sizeof(length), "Content-Length: %zu\r\n", body_len);
+        head_len = job->capture_head + n;
+        len = head_len + 2 + body_len;
+        data = malloc(len);
+        if (data) {
+            memcpy(data, job->capture.data, job->capture_head);
+            memcpy(data + job->capture_head, length, n);
+            memcpy(data + head_len, "\r\n", 2);
+            memcpy(data + head_len + 2, job->capture.data + job->capture_head, body_len);
+        }
+    }
+    buffer_free(&job->capture);
+
+    // 2. 항목 채우기: 자리를 만들거나 제거하는 일은 실행 중 표시를 풀기 전에 함
+    // (실행 중인 항목은 용량에 세지 않았고 제거 대상도 아님)
+    pthread_rwlock_wrlock(&cgi_cache.lock);
+    int keep = data && rule && conn->status == 200 && len + entry->key_len <= config.cgi_cache_size;
+    if (keep)
+        cache_evict(&cgi_cache, len + entry->key_len, config.cgi_cache_size);
+    else
+        cache_unlink(&cgi_cache, entry); // 기다리는 연결과 실행한 연결의 참조는 남음
+    entry->data = data;
+    entry->len = len;
+    entry->head_len = head_len;
+    entry->failed = data ? NULL : failed ? failed : "502 Bad Gateway";
+    entry->expires = now_usec() / 1000 + (rule ? rule->ttl * 1000ULL : 0);
+    entry->pending = 0;
+    if (keep) {
+        atomic_store(&entry->referenced, 1);
+        cgi_cache.bytes += cache_charge(entry);
+    }
+    uint64_t wake = entry->wake_mask;
+    pthread_rwlock_unlock(&cgi_cache.lock);
+    cache_release(entry); // 실행한 연결의 참조
+
+    // 3. 기다리는 연결이 있는 워커 깨우기
+    for (int i = 0; wake && i < worker_count; i++) {
+        uint64_t one = 1;
+        if ((wake & (1ULL << (i % 64))) && write(workers[i].notify_fd, &one, sizeof(one)) == -1 && errno != EAGAIN)
+            perror("eventfd write() 오류");
+    }
+}
+
+// 워커가 깨어남: 대기 목록에서 실행이 끝난 요청을 기다리던 연결에 그 응답 (실패면 오류) 전송
+void cgi_cache_wake(worker_t *w) {
+    uint64_t count;
+    conn_t **pp = &w->cache_waiters;
+
+    if (read(w->notify_fd, &count, sizeof(count)) == -1 && errno != EAGAIN)
+        perror("eventfd read() 오류");
+
+    while (*pp) {
+        conn_t *conn = *pp;
+        cache_entry_t *entry = conn->cache_wait;
+
+        pthread_rwlock_rdlock(&cgi_cache.lock);
+        int pending = entry->pending;
+        pthread_rwlock_unlock(&cgi_cache.lock);
+        if (pending) {
+            pp = &conn->wait_next;
+            continue;
+        }
+
+        *pp = conn->wait_next;
+        conn->cache_wait = NULL;
+        if (entry->failed)
+            send_error(conn, (char *)entry->failed);
+        else
+            cache_serve(conn, entry);
+        cache_release(entry);
+        stats_request_end(conn);
+        conn_dispatch(conn); // 응답 전송과 보류했던 다음 요청 처리
+    }
+}
+
+// 기다리던 연결이 먼저 닫히거나 시간 초과: 대기 목록에서 빼고 항목 참조 반환
+void cgi_cache_unwait(conn_t *conn) {
+    conn_t **pp = &conn->worker->cache_waiters;
+
+    while (*pp != conn)
+        pp = &(*pp)->wait_next;
+    *pp = conn->wait_next;
+    cache_release(conn->cache_wait);
+    conn->cache_wait = NULL;
+}
+
+// --- 플러그인 ---
+
+// 모든 플러그인을 로드하고 디렉토리 변경 감시 시작 (로드하지 못한 플러그인은 파일이 생기면 로드)
+void plugins_init(void) {
+    pthread_t tid;
+
+    if (plugin_count == 0) return;
+
+    for (int i = 0; i < plugin_count; i++) {
+        pthread_mutex_init(&plugins[i].lock, NULL);
+        plugin_load(&plugins[i]);
+    }
+
+    plugin_inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (plugin_inotify_fd == -1 ||
+        inotify_add_watch(plugin_inotify_fd, config.plugin_dir, IN_CLOSE_WRITE | IN_MOVED_TO) == -1) {
+        perror("플러그인 디렉토리 감시 오류 (다시 로드 안 함)");
+        return;
+    }
+    if (pthread_create(&tid, NULL, plugin_watch_thread, NULL) != 0)
+        error_handling("pthread_create() 오류");
+    pthread_detach(tid);
+}
+
+// URI 에 연결된 플러그인 (접두어가 가장 긴 것, 접두어 뒤는 경로 구분자나 쿼리여야 함)
+plugin_t *plugin_find(const char *uri) {
+    plugin_t *found = NULL;
+
+    for (int i = 0; i < plugin_count; i++) {
+        plugin_t *plugin = &plugins[i];
+        // 접두어가 맞은 뒤에만 다음 글자를 봄 (URI 가 접두어보다 짧으면 문자열 끝을 넘어 읽게 됨)
+        if (strncmp(uri, plugin->prefix, plugin->prefix_len) != 0) continue;
+        char next = uri[plugin->prefix_len];
+        if ((next == '\0' || next == '/' || next == '?' || plugin->prefix[plugin->prefix_len - 1] == '/') &&
+            (found == NULL || plugin->prefix_len > found->prefix_len))
+            found = plugin;
+    }
+    return found;
+}
+
+// 플러그인 파일을 로드해 현재 버전으로 교체 (실패하면 이전 버전을 계속 사용)
+int plugin_load(plugin_t *plugin) {
+    char path[sizeof(plugin->file) + 512], dl_path[64];
+    struct stat st;
+
+    // 1. 파일 내용을 익명 메모리 파일로 복사해 /proc/self/fd/N 경로로 로드
+    // dlopen 은 이미 열린 경로면 이전 버전을 돌려주므로 버전마다 따로 두고, 닫을 때까지 fd 를 열어 두어
+    // 경로가 겹치지 않게 함 (원본을 제자리에서 덮어써도 실행 중인 코드는 바뀌지 않음)
+    snprintf(path, sizeof(path), "%s/%s", config.plugin_dir, plugin->file);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        fprintf(stderr, "[플러그인] %s 열기 실패: %s\n", path, strerror(errno));
+        if (fd != -1) close(fd);
+        return -1;
+    }
+    int memfd = memfd_create(plugin->file, MFD_CLOEXEC);
+    off_t copied = 0;
+    while (memfd != -1 && copied < st.st_size) {
+        ssize_t n = sendfile(memfd, fd, &copied, st.st_size - copied);
+        if (n <= 0) break;
+    }
+    close(fd);
+    if (memfd == -1 || copied < st.st_size) {
+        perror("플러그인 복사 오류");
+        if (memfd != -1) close(memfd);
+        return -1;
+    }
+    snprintf(dl_path, sizeof(dl_path), "/proc/self/fd/%d", memfd);
+    void *dl = dlopen(dl_path, RTLD_NOW | RTLD_LOCAL);
+
+    // 2. ABI 버전과 진입점 확인 후 초기화 함수가 있으면 호출
+    if (dl == NULL) {
+        fprintf(stderr, "[플러그인] %s 로드 실패: %s\n", path, dlerror());
+        close(memfd);
+        return -1;
+    }
+    const int *abi = dlsym(dl, "plugin_abi_version");
+    plugin_handler_t handle = (plugin_handler_t)dlsym(dl, "handle");
+    int (*init)(void) = (int (*)(void))dlsym(dl, "plugin_init");
+    if (abi == NULL || *abi != PLUGIN_ABI_VERSION || handle == NULL) {
+        fprintf(stderr, "[플러그인] %s: handle() 이 없거나 ABI 버전이 다름 (서버 %d)\n", path, PLUGIN_ABI_VERSION);
+        dlclose(dl);
+        close(memfd);
+        return -1;
+    }
+    if (init && init() != 0) {
+        fprintf(stderr, "[플러그인] %s: plugin_init() 실패\n", path);
+        dlclose(dl);
+        close(memfd);
+        return -1;
+    }
+
+    plugin_module_t *module = calloc(1, sizeof(plugin_module_t));
+    if (module == NULL) {
+        perror("플러그인 할당 오류");
+        dlclose(dl);
+        close(memfd);
+        return -1;
+    }
+    module->dl = dl;
+    module->memfd = memfd;
+    module->handle = handle;
+    module->fini = (void (*)(void))dlsym(dl, "plugin_fini");
+    atomic_init(&module->refs, 1);
+
+    // 3. 교체: 새 요청부터 새 버전을 쓰고, 이전 버전은 실행 중인 요청이 끝나면 닫힘
+    pthread_mutex_lock(&plugin->lock);
+    plugin_module_t *old = plugin->current;
+    module->version = ++plugin->loads;
+    plugin->current = module;
+    pthread_mutex_unlock(&plugin->lock);
+    if (old)
+        plugin_release(old);
+
+    printf("[플러그인] %s -> %s (버전 %d)\n", plugin->prefix, path, module->version);
+    return 0;
+}
+
+// 현재 버전을 요청 하나 동안 사용 (로드된 버전이 없으면 NULL)
+plugin_module_t *plugin_acquire(plugin_t *plugin) {
+    pthread_mutex_lock(&plugin->lock);
+    plugin_module_t *module = plugin->current;
+    if (module)
+        atomic_fetch_add(&module->refs, 1);
+    pthread_mutex_unlock(&plugin->lock);
+    return module;
+}
+
+// 마지막 참조가 사라진 (교체된) 버전은 정리 함수 호출 후 닫음
+void plugin_release(plugin_module_t *module) {
+    if (atomic_fetch_sub(&module->refs, 1) != 1) return;
+
+    if (module->fini)
+        module->fini();
+    dlclose(module->dl);
+    close(module->memfd);
+    free(module);
+}
+
+// 플러그인 디렉토리 감시 쓰레드: 파일 쓰기가 끝나거나 새 파일로 바뀌면 다시 로드
+void *plugin_watch_thread(void *arg) {
+    char events[BUF_SIZE * 4] __attribute__((aligned(__alignof__(struct inotify_event))));
+    (void)arg;
+
+    while (1) {
+        ssize_t len = read(plugin_inotify_fd, events, sizeof(events));
+        if (len <= 0) {
+            if (len == -1 && errno == EINTR) continue;
+            perror("inotify read() 오류");
+            return NULL;
+        }
+
+        for (char *p = events; p < events + len; ) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            for (int i = 0; i < plugin_count; i++) {
+                if ((ev->mask & IN_Q_OVERFLOW) || (ev->len && strcmp(ev->name, plugins[i].file) == 0))
+                    plugin_load(&plugins[i]);
+            }
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+    return NULL;
+}
+
+// 플러그인 요청 처리: 워커 쓰레드에서 바로 호출하고 모은 응답을 Content-Length 와 함께 전송
+// 호출하는 동안 같은 워커의 다른 연결은 기다리므로 플러그인은 블로킹하지 않아야 함
+void handle_plugin(conn_t *conn, plugin_t *plugin) {
+    http_request_t *req = &conn->req;
+    size_t path_len = strcspn(req->uri, "?");
+    plugin_call_t call;
+
+    conn->stat_route = ROUTE_PLUGIN;
+
+    // 1. 본문은 수신 버퍼에 다 모인 경우에만 넘김 (request_hold 가 모아 둠, 한도를 넘는 본문은 413)
+    if (conn->in.len - conn->in.off < conn->header_len + req->content_length) {
+        send_error(conn, conn->header_len + req->content_length > MAX_REQUEST_SIZE ? "413 Payload Too Large"
+                                                                                    : "400 Bad Request");
+        return;
+    }
+    plugin_module_t *module = plugin_acquire(plugin);
+    if (module == NULL) {
+        send_error(conn, "503 Service Unavailable");
+        return;
+    }
+
+    // 2. 요청 뷰와 응답 작성기 준비 (문자열은 수신 버퍼나 요청별 영역을 가리킴)
+    memset(&call, 0, sizeof(call));
+    call.conn = conn;
+    call.status = 200;
+    call.reason = "OK";
+    call.content_type = "text/html";
+    call.req.method = req->method;
+    call.req.path = arena_printf(&conn->arena, "%.*s", (int)path_len, req->uri);
+    call.req.path_info = call.req.path ? call.req.path + plugin->prefix_len : NULL;
+    call.req.query_string = req->uri[path_len] ? req->uri + path_len + 1 : "";
+    call.req.body = conn->in.data + conn->in.off + conn->header_len;
+    call.req.body_len = req->content_length;
+    call.req.header = plugin_req_header;
+    call.res.status = plugin_res_status;
+    call.res.header = plugin_res_header;
+    call.res.write = plugin_res_write;
+
+    // 3. 호출
+    int r = call.req.path ? module->handle(&call.req, &call.res) : -1;
+    plugin_release(module);
+
+    // 4. 응답 전송 (실패하면 플러그인이 쓴 내용은 버림)
+    char *head = NULL;
+    if (r == 0 && !call.failed)
+        head = arena_printf(&conn->arena,
+                            "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n%sConnection: %s\r\n\r\n",
+                            call.status, call.reason, call.content_type, call.body.len,
+                            call.headers.data ? call.headers.data : "",
+                            req->keep_alive ? "keep-alive" : "close");
+    if (head) {
+        conn_send(conn, head, strlen(head));
+        conn_send(conn, call.body.data, call.body.len);
+        conn->status = call.status;
+    } else {
+        send_error(conn, "500 Internal Server Error");
+    }
+    buffer_free(&call.headers);
+    buffer_free(&call.body);
+}
+
+const char *plugin_req_header(const plugin_request_t *req, const char *name) {
+    plugin_call_t *call = (plugin_call_t *)req;
+    return find_header(&call->conn->req, name);
+}
+
+void plugin_res_status(plugin_response_t *res, int code, const char *reason) {
+    plugin_call_t *call = (plugin_call_t *)((char *)res - offsetof(plugin_call_t, res));
+
+    if (code < 200 || code > 599 || (reason && strpbrk(reason, "\r\n"))) {
+        call->failed = 1;
+        return;
+    }
+    call->status = code;
+    call->reason = arena_printf(&call->conn->arena, "%s", reason ? reason : "");
+    if (call->reason == NULL)
+        call->failed = 1;
+}
+
+// 응답 헤더 추가: 본문 길이와 연결 관련 헤더는 서버가 정하므로 무시, 줄바꿈이 든 헤더는 실패로 처리
+void plugin_res_header(plugin_response_t *res, const char *name, const char *value) {
+    plugin_call_t *call = (plugin_call_t *)((char *)res - offsetof(plugin_call_t, res));
+
+    if (strpbrk(name, ":\r\n") || strpbrk(value, "\r\n")) {
+        call->failed = 1;
+        return;
+    }
+    if (strcasecmp(name, "Content-Length") == 0 || strcasecmp(name, "Connection") == 0 ||
+        strcasecmp(name, "Transfer-Encoding") == 0)
+        return;
+    if (strcasecmp(name, "Content-Type") == 0) {
+        call->content_type = arena_printf(&call->conn->arena, "%s", value);
+        if (call->content_type == NULL)
+            call->failed = 1;
+        return;
+    }
+    if (buffer_append(&call->headers, name, strlen(name)) == -1 || buffer_append(&call->headers, ": ", 2) == -1 ||
+        buffer_append(&call->headers, value, strlen(value)) == -1 || buffer_append(&call->headers, "\r\n", 2) == -1)
+        call->failed = 1;
+}
+
+void plugin_res_write(plugin_response_t *res, const void *data, size_t len) {
+    plugin_call_t *call = (plugin_call_t *)((char *)res - offsetof(plugin_call_t, res));
+
+    if (len > 0 && buffer_append(&call->body, data, len) == -1)
+        call->failed = 1;
+}
+
+// --- 상주 CGI 워커 풀 ---
+
+// 지정된 스크립트마다 최소 개수의 워커를 미리 띄우고 관리 쓰레드 시작
+void fcgi_pools_init(void) {
+    pthread_t tid;
+
+    if (fcgi_pool_count == 0) return;
+
+    for (int i = 0; i < fcgi_pool_count; i++) {
+        fcgi_pool_t *pool = &fcgi_pools[i];
+        pthread_mutex_init(&pool->lock, NULL);
+
+        pthread_mutex_lock(&pool->lock);
+        while (pool->total < config.fcgi_min) {
+            fcgi_worker_t *worker = fcgi_spawn(pool);
+            if (worker == NULL) break;
+            worker->next = pool->idle;
+            pool->idle = worker;
+        }
+        pthread_mutex_unlock(&pool->lock);
+        printf("[CGI 풀] %s: 워커 %d개 (최소 %d, 최대 %d, 교체 주기 %d요청)\n",
+               pool->uri, pool->total, config.fcgi_min, config.fcgi_max, config.fcgi_max_requests);
+    }
+
+    if (pthread_create(&tid, NULL, fcgi_maintain_thread, NULL) != 0)
+        error_handling("pthread_create() 오류");
+    pthread_detach(tid);
+}
+
+fcgi_pool_t *fcgi_find_pool(const char *path) {
+    for (int i = 0; i < fcgi_pool_count; i++) {
+        if (strcmp(fcgi_pools[i].path, path) == 0)
+            return &fcgi_pools[i];
+    }
+    return NULL;
+}
+
+// 워커 프로세스 생성 (pool->lock 을 쥔 상태에서 호출)
+// 워커의 fd 0 에 UNIX 소켓을 연결하고 FCGI_WORKER=1 로 프로토콜 모드임을 알림
+fcgi_worker_t *fcgi_spawn(fcgi_pool_t *pool) {
+    int sv[2];
+    pid_t pid;
+
+    fcgi_worker_t *worker = calloc(1, sizeof(fcgi_worker_t));
+    if (worker == NULL) return NULL;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1) {
+        perror("socketpair() 오류");
+        free(worker);
+        return NULL;
+    }
+
+    if ((pid = fork()) < 0) {
+        perror("fork() 오류");
+        close(sv[0]);
+        close(sv[1]);
+        free(worker);
+        return NULL;
+    }
+
+    if (pid == 0) { // 자식 프로세스 (상주 CGI 워커)
+        dup2(sv[1], STDIN_FILENO);
+        setenv("FCGI_WORKER", "1", 1);
+        execlp(pool->path, pool->path, NULL);
+        _exit(1);
+    }
+
+    close(sv[1]);
+    worker->pid = pid;
+    worker->fd = sv[0];
+    pool->total++;
+    return worker;
+}
+
+// 워커 종료 및 정리 (풀의 total 은 호출자가 조정)
+// 이벤트 루프 쓰레드에서도 불리므로 기다리지 않음: SIGTERM 을 무시하고 바쁜 워커도 SIGKILL 로 끝내고 회수는 reap_child 에 맡김
+void fcgi_kill(fcgi_worker_t *worker) {
+    close(worker->fd);
+    kill(worker->pid, SIGKILL); // 워커는 서버와 같은 프로세스 그룹이므로 그룹이 아닌 워커만
+    reap_child(worker->pid);
+    free(worker);
+}
+
+// 유휴 워커를 하나 가져옴. 없으면 최대 개수까지 새로 띄움
+// 모두 사용 중이면 NULL: 이벤트 루프를 멈추지 않도록 기다리지 않고 일회성 실행으로 넘김
+fcgi_worker_t *fcgi_acquire(fcgi_pool_t *pool) {
+    fcgi_worker_t *worker = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->idle) {
+        worker = pool->idle;
+        pool->idle = worker->next;
+    } else if (pool->total < config.fcgi_max) {
+        worker = fcgi_spawn(pool);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return worker;
+}
+
+// 워커 반납. 오류가 났거나 교체 주기에 도달한 워커는 종료
+void fcgi_release(fcgi_pool_t *pool, fcgi_worker_t *worker, int reusable) {
+    worker->requests++;
+    if (!reusable || worker->requests >= config.fcgi_max_requests) {
+        fcgi_kill(worker);
+        pthread_mutex_lock(&pool->lock);
+        pool->total--;
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    worker->idle_since = time(NULL);
+    worker->next = pool->idle;
+    pool->idle = worker;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// 풀 관리 쓰레드: 최소 개수를 유지하고, 초과분은 오래 쉬면 종료 (부하에 따라 축소)
+void *fcgi_maintain_thread(void *arg) {
+    (void)arg;
+
+    while (1) {
+        sleep(1);
+        time_t now = time(NULL);
+
+        for (int i = 0; i < fcgi_pool_count; i++) {
+            fcgi_pool_t *pool = &fcgi_pools[i];
+            fcgi_worker_t *expired = NULL;
+
+            pthread_mutex_lock(&pool->lock);
+            // 목록 앞쪽이 최근 반납된 워커이므로 뒤쪽부터 오래 쉰 워커가 모여 있음
+            fcgi_worker_t **pp = &pool->idle;
+            while (*pp) {
+                fcgi_worker_t *w = *pp;
+                if (pool->total > config.fcgi_min && now - w->idle_since >= FCGI_IDLE_SECS) {
+                    *pp = w->next;
+                    w->next = expired;
+                    expired = w;
+                    pool->total--;
+                } else {
+                    pp = &w->next;
+                }
+            }
+            while (pool->total < config.fcgi_min) {
+                fcgi_worker_t *w = fcgi_spawn(pool);
+                if (w == NULL) break;
+                w->idle_since = now;
+                w->next = pool->idle;
+                pool->idle = w;
+            }
+            pthread_mutex_unlock(&pool->lock);
+
+            while (expired) {
+                fcgi_worker_t *next = expired->next;
+                fcgi_kill(expired);
+                expired = next;
+            }
+        }
+    }
+    return NULL;
+}
+
+// 상주 워커에 요청 전송. 반환값 0: 시작됨 (응답은 이벤트 루프에서 수신), -1: 워커를 쓸 수 없음
+int fcgi_start(conn_t *conn, fcgi_pool_t *pool, char *query_string) {
+    size_t params_len = 0;
+    char content_length[32];
+    const char *content_type = find_header(&conn->req, "Content-Type");
+    snprintf(content_length, sizeof(content_length), "%zu", conn->req.content_length);
+
+    // 파라미터 블록은 요청별 영역에 (이름 + 길이 필드 여유 128바이트 + 값 길이)
+    char *params = arena_alloc(&conn->arena, 128 + strlen(query_string) + strlen(pool->uri) +
+                               strlen(content_length) + (content_type ? strlen(content_type) : 0));
+    if (params == NULL) return -1;
+
+    fcgi_worker_t *worker = fcgi_acquire(pool);
+    if (worker == NULL) return -1;
+
+    // 1. 요청 전송: BEGIN_REQUEST -> PARAMS(환경 변수) -> 빈 PARAMS
+    static const unsigned char begin[8] = { 0, 1, 0, 0, 0, 0, 0, 0 }; // role = RESPONDER
+
+    params_len += fcgi_put_param(params + params_len, "REQUEST_METHOD", "POST");
+    params_len += fcgi_put_param(params + params_len, "QUERY_STRING", query_string);
+    params_len += fcgi_put_param(params + params_len, "SCRIPT_NAME", pool->uri);
+    params_len += fcgi_put_param(params + params_len, "CONTENT_LENGTH", content_length);
+    if (content_type)
+        params_len += fcgi_put_param(params + params_len, "CONTENT_TYPE", content_type);
+
+    if (fcgi_write_record(worker->fd, FCGI_BEGIN_REQUEST, 1, begin, sizeof(begin)) == -1 ||
+        fcgi_write_record(worker->fd, FCGI_PARAMS, 1, params, params_len) == -1 ||
+        fcgi_write_record(worker->fd, FCGI_PARAMS, 1, NULL, 0) == -1) {
+        fcgi_release(pool, worker, 0);
+        return -1;
+    }
+
+    // 2. 응답 레코드는 이벤트 루프에서 받음 (소켓은 계속 워커 소유)
+    // 본문은 도착하는 대로 STDIN 레코드로 보내고, 끝나면 빈 STDIN 레코드 전송
+    conn->cgi.pool = pool;
+    conn->cgi.worker = worker;
+    cgi_attach(conn, worker->fd);
+    conn->cgi.stdin_open = 1;
+    if (conn->req.content_length == 0)
+        cgi_close_stdin(conn);
+    return 0;
+}
+
+// 워커 소켓에서 읽은 바이트를 레코드 단위로 해석 (레코드가 read 경계에 걸쳐도 이어서 처리)
+void fcgi_decode(conn_t *conn, const char *data, size_t len) {
+    cgi_job_t *job = &conn->cgi;
+
+    while (len > 0 && job->active) {
+        // 1. 레코드 헤더 8바이트 모으기
+        if (job->rec_header_got < sizeof(job->rec_header)) {
+            size_t n = sizeof(job->rec_header) - job->rec_header_got;
+            if (n > len) n = len;
+            memcpy(job->rec_header + job->rec_header_got, data, n);
+            job->rec_header_got += n;
+            data += n;
+            len -= n;
+            if (job->rec_header_got < sizeof(job->rec_header)) return;
+
+            if (job->rec_header[0] != FCGI_VERSION_1) {
+                cgi_finish(conn, 0);
+                return;
+            }
+            job->rec_left = (job->rec_header[4] << 8) | job->rec_header[5];
+            job->pad_left = job->rec_header[6];
+        }
+
+        // 2. 내용: STDOUT 은 클라이언트로, STDERR 는 로그로, 나머지는 버림
+        size_t n = job->rec_left < len ? job->rec_left : len;
+        int type = job->rec_header[1];
+        if (type == FCGI_STDOUT) {
+            cgi_forward(conn, data, n);
+        } else if (type == FCGI_STDERR) {
+            fprintf(stderr, "[CGI 풀] %.*s", (int)n, data);
+        }
+        job->rec_left -= n;
+        data += n;
+        len -= n;
+
+        // 3. 패딩을 건너뛰고 레코드 완료 처리
+        n = job->pad_left < len ? job->pad_left : len;
+        job->pad_left -= n;
+        data += n;
+        len -= n;
+        if (job->rec_left == 0 && job->pad_left == 0) {
+            job->rec_header_got = 0;
+            if (type == FCGI_END_REQUEST) {
+                cgi_finish(conn, 1);
+                return;
+            }
+        }
+    }
+}
+
+// 레코드 헤더(8바이트) + 내용 전송. 65535바이트를 넘는 내용은 여러 레코드로 나눔
+int fcgi_write_record(int fd, int type, int id, const void *data, size_t len) {
+    const char *p = data;
+    do {
+        size_t n = len < FCGI_MAX_CONTENT ? len : FCGI_MAX_CONTENT;
+        unsigned char header[8] = { FCGI_VERSION_1, type, id >> 8, id & 0xff, n >> 8, n & 0xff, 0, 0 };
+        if (write_full(fd, header, sizeof(header)) == -1 || write_full(fd, p, n) == -1)
+            return -1;
+        p += n;
+        len -= n;
+    } while (len > 0);
+    return 0;
+}
+
+// 이름-값 쌍 인코딩 (길이 < 128 이면 1바이트, 아니면 4바이트 길이)
+size_t fcgi_put_param(char *buf, const char *name, const char *value) {
+    size_t nlen = strlen(name), vlen = strlen(value);
+    unsigned char *p = (unsigned char *)buf;
+    size_t lens[2] = { nlen, vlen };
+
+    for (int i = 0; i < 2; i++) {
+        if (lens[i] < 128) {
+            *p++ = lens[i];
+        } else {
+            *p++ = (lens[i] >> 24) | 0x80;
+            *p++ = lens[i] >> 16;
+            *p++ = lens[i] >> 8;
+            *p++ = lens[i];
+        }
+    }
+    memcpy(p, name, nlen);
+    memcpy(p + nlen, value, vlen);
+    return (char *)p + nlen + vlen - buf;
+}
+
+// 블로킹 fd 에 len 바이트를 모두 씀 (부분 전송 처리)
+int write_full(int fd, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// --- 서버 통계 ---
+
+// 호출한 쓰레드의 통계 블록 (처음 호출될 때 할당해 목록에 등록)
+thread_stats_t *stats_local(void) {
+    if (my_stats) return my_stats;
+
+    thread_stats_t *stats = calloc(1, sizeof(thread_stats_t));
+    if (stats == NULL)
+        error_handling("통계 메모리 할당 실패");
+    pthread_mutex_lock(&stats_lock);
+    stats->next = stats_list;
+    stats_list = stats;
+    pthread_mutex_unlock(&stats_lock);
+    my_stats = stats;
+    return stats;
+}
+
+// 카운터 증가: 쓰는 쓰레드가 하나뿐이므로 lock 접두어가 붙는 fetch_add 대신 relaxed load/store
+// (읽는 쪽은 찢어지지 않은 값만 보면 되므로 충분)
+void stat_add(atomic_ullong *counter, unsigned long long n) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n,
+                          memory_order_relaxed);
+}
+
+uint64_t now_usec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// 값(µs)을 로그-선형 구간에 기록: 32 미만은 그대로, 그 이상은 최상위 비트 위치와 다음 5비트로 구간 결정
+void hist_record(histogram_t *hist, uint64_t value) {
+    uint64_t v = value < (1ULL << HIST_MAX_BITS) ? value : (1ULL << HIST_MAX_BITS) - 1;
+    int idx = (int)v;
+
+    if (v >= (1 << HIST_SUB_BITS)) {
+        int msb = 63 - __builtin_clzll(v);
+        int shift = msb - HIST_SUB_BITS;
+        idx = ((shift + 1) << HIST_SUB_BITS) + (int)((v >> shift) & ((1 << HIST_SUB_BITS) - 1));
+    }
+    stat_add(&hist->counts[idx], 1);
+    stat_add(&hist->total, 1);
+    stat_add(&hist->sum, value);
+    if (value > atomic_load_explicit(&hist->max, memory_order_relaxed))
+        atomic_store_explicit(&hist->max, value, memory_order_relaxed);
+}
+
+// 누적 비율 q 에 해당하는 값: 그 구간이 나타내는 값의 상한 (HDR 의 "동등한 최대값")
+uint64_t hist_percentile(histogram_t *hist, double q) {
+    unsigned long long total = atomic_load_explicit(&hist->total, memory_order_relaxed);
+    unsigned long long rank = (unsigned long long)(q * total + 0.5), seen = 0;
+
+    if (total == 0) return 0;
+    if (rank == 0) rank = 1;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += atomic_load_explicit(&hist->counts[i], memory_order_relaxed);
+        if (seen < rank) continue;
+        if (i < (1 << HIST_SUB_BITS)) return i;
+        int shift = (i >> HIST_SUB_BITS) - 1;
+        uint64_t lower = (uint64_t)((i & ((1 << HIST_SUB_BITS) - 1)) | (1 << HIST_SUB_BITS)) << shift;
+        uint64_t upper = lower + (1ULL << shift) - 1;
+        uint64_t max = atomic_load_explicit(&hist->max, memory_order_relaxed);
+        return upper < max ? upper : max;
+    }
+    return atomic_load_explicit(&hist->max, memory_order_relaxed);
+}
+
+// 요청 처리 시작: 메소드/경로 분류는 처리하면서 채움 (기본값은 OTHER)
+// parsed: 요청 줄이 해석되었는지 (아니면 접근 로그의 요청 줄은 "-")
+void stats_request_start(conn_t *conn, int parsed) {
+    conn->req_start = now_usec();
+    conn->stat_method = METHOD_OTHER;
+    conn->stat_route = ROUTE_OTHER;
+    conn->status = 0;
+    conn->out_start = conn->out_total;
+    conn->cgi_usec = -1;
+    if (!log_enabled) return;
+    if (parsed)
+        snprintf(conn->log_request, sizeof(conn->log_request), "%s %s %s", conn->req.method, conn->req.uri,
+                 conn->req.version);
+    else
+        strcpy(conn->log_request, "-");
+}
+
+// 응답 생성 완료: 메소드/상태 코드별 요청 수와 경로별 지연 시간 기록
+void stats_request_end(conn_t *conn) {
+    thread_stats_t *stats = stats_local();
+
+    if (conn->status >= 100 && conn->status < 100 + STATUS_CODES)
+        stat_add(&stats->requests[conn->stat_method][conn->status - 100], 1);
+    uint64_t usec = now_usec() - conn->req_start;
+    hist_record(&stats->latency[conn->stat_route], usec);
+    access_log_write(conn, usec);
+}
+
+// 모든 쓰레드의 통계를 합친 새 블록 (호출자가 free)
+thread_stats_t *stats_merge(void) {
+    thread_stats_t *total = calloc(1, sizeof(thread_stats_t));
+    if (total == NULL) return NULL;
+
+    pthread_mutex_lock(&stats_lock);
+    for (thread_stats_t *s = stats_list; s; s = s->next) {
+        for (int m = 0; m < METHOD_COUNT; m++)
+            for (int c = 0; c < STATUS_CODES; c++)
+                total->requests[m][c] += atomic_load_explicit(&s->requests[m][c], memory_order_relaxed);
+        total->bytes_in += atomic_load_explicit(&s->bytes_in, memory_order_relaxed);
+        total->bytes_out += atomic_load_explicit(&s->bytes_out, memory_order_relaxed);
+        total->conns_opened += atomic_load_explicit(&s->conns_opened, memory_order_relaxed);
+        total->conns_closed += atomic_load_explicit(&s->conns_closed, memory_order_relaxed);
+        for (int i = 0; i < ROUTE_COUNT; i++)
+            hist_merge(&total->latency[i], &s->latency[i]);
+        for (int i = 0; i < CGI_KIND_COUNT; i++)
+            hist_merge(&total->cgi_spawn[i], &s->cgi_spawn[i]);
+        hist_merge(&total->cgi_run, &s->cgi_run);
+        for (int i = 0; i < TIMEOUT_KINDS; i++)
+            total->timeouts[i] += atomic_load_explicit(&s->timeouts[i], memory_order_relaxed);
+        for (int i = 0; i < CGI_CACHE_RESULTS; i++)
+            total->cgi_cache[i] += atomic_load_explicit(&s->cgi_cache[i], memory_order_relaxed);
+        for (int i = 0; i < SHED_KINDS; i++)
+            total->shed[i] += atomic_load_explicit(&s->shed[i], memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&stats_lock);
+    return total;
+}
+
+void hist_merge(histogram_t *dst, histogram_t *src) {
+    for (int i = 0; i < HIST_BUCKETS; i++)
+        dst->counts[i] += atomic_load_explicit(&src->counts[i], memory_order_relaxed);
+    dst->total += atomic_load_explicit(&src->total, memory_order_relaxed);
+    dst->sum += atomic_load_explicit(&src->sum, memory_order_relaxed);
+    unsigned long long max = atomic_load_explicit(&src->max, memory_order_relaxed);
+    if (max > dst->max)
+        dst->max = max;
+}
+
+// GET /server-stats: 사람이 읽는 요약, ?format=prometheus 이면 Prometheus 텍스트 형식
+// 마스터/워커 모드에서는 요청을 받은 워커 프로세스의 통계만 보임
+void handle_stats(conn_t *conn, const char *query) {
+    int prometheus = strstr(query, "format=prometheus") != NULL;
+    char *body = NULL;
+    size_t body_len = 0;
+
+    thread_stats_t *total = stats_merge();
+    FILE *out = total ? open_memstream(&body, &body_len) : NULL;
+    if (out == NULL) {
+        free(total);
+        send_error(conn, "500 Internal Server Error");
+        return;
+    }
+    if (prometheus)
+        stats_write_prometheus(out, total);
+    else
+        stats_write_text(out, total);
+    fclose(out);
+    free(total);
+
+    send_header(conn, "200 OK", prometheus ? "text/plain; version=0.0.4; charset=utf-8" : "text/plain; charset=utf-8",
+                body_len, "Cache-Control: no-store\r\n");
+    conn_send(conn, body, body_len);
+    free(body);
+}
+
+const char *stat_method_names[METHOD_COUNT] = { "GET", "POST", "OTHER" };
+const char *stat_route_names[ROUTE_COUNT] = { "static", "cgi", "plugin", "stats", "other" };
+const char *cgi_kind_names[CGI_KIND_COUNT] = { "exec", "pool" };
+const char *timeout_kind_names[TIMEOUT_KINDS] = { "header", "body", "keepalive", "cgi" };
+const char *cgi_cache_result_names[CGI_CACHE_RESULTS] = { "hit", "miss", "coalesced" };
+const char *shed_kind_names[SHED_KINDS] = { "connections", "cgi" };
+
+void stats_write_text(FILE *out, thread_stats_t *total) {
+    unsigned long long opened = total->conns_opened, closed = total->conns_closed;
+
+    fprintf(out, "pid: %d\nuptime: %ld s\nheader parser: %s\n", (int)getpid(), (long)(time(NULL) - stats_started),
+            scan_delims_name);
+    fprintf(out, "connections: %llu active, %llu total\n", opened - closed, opened);
+    fprintf(out, "bytes: %llu in, %llu out\n", (unsigned long long)total->bytes_in,
+            (unsigned long long)total->bytes_out);
+
+    unsigned long long log_lines, log_dropped;
+    access_log_counts(&log_lines, &log_dropped);
+    fprintf(out, "access log: %llu written, %llu dropped\n", log_lines, log_dropped);
+    fprintf(out, "timeouts:");
+    for (int i = 0; i < TIMEOUT_KINDS; i++)
+        fprintf(out, " %llu %s%s", (unsigned long long)total->timeouts[i], timeout_kind_names[i],
+                i + 1 < TIMEOUT_KINDS ? "," : "\n");
+    fprintf(out, "load: %d cgi running, limits %d connections, %d cgi (0 = none)\n", atomic_load(&cgi_running),
+            config.max_conns, config.max_cgi);
+    fprintf(out, "shed:");
+    for (int i = 0; i < SHED_KINDS; i++)
+        fprintf(out, " %llu %s%s", (unsigned long long)total->shed[i], shed_kind_names[i],
+                i + 1 < SHED_KINDS ? "," : "\n");
+    if (cgi_cache_rule_count > 0) {
+        pthread_rwlock_rdlock(&cgi_cache.lock);
+        size_t bytes = cgi_cache.bytes;
+        pthread_rwlock_unlock(&cgi_cache.lock);
+        fprintf(out, "cgi cache:");
+        for (int i = 0; i < CGI_CACHE_RESULTS; i++)
+            fprintf(out, " %llu %s,", (unsigned long long)total->cgi_cache[i], cgi_cache_result_names[i]);
+        fprintf(out, " %zu bytes\n", bytes);
+    }
+
+    fprintf(out, "\nrequests:\n");
+    for (int m = 0; m < METHOD_COUNT; m++)
+        for (int c = 0; c < STATUS_CODES; c++)
+            if (total->requests[m][c])
+                fprintf(out, "  %-6s %d  %llu\n", stat_method_names[m], c + 100,
+                        (unsigned long long)total->requests[m][c]);
+
+    fprintf(out, "\nlatency (us)      count        p50        p99       p999        max\n");
+    for (int i = 0; i < ROUTE_COUNT + CGI_KIND_COUNT + 1; i++) {
+        histogram_t *h;
+        char name[32];
+        if (i < ROUTE_COUNT) {
+            h = &total->latency[i];
+            snprintf(name, sizeof(name), "%s", stat_route_names[i]);
+        } else if (i < ROUTE_COUNT + CGI_KIND_COUNT) {
+            h = &total->cgi_spawn[i - ROUTE_COUNT];
+            snprintf(name, sizeof(name), "cgi spawn/%s", cgi_kind_names[i - ROUTE_COUNT]);
+        } else {
+            h = &total->cgi_run;
+            snprintf(name, sizeof(name), "cgi run");
+        }
+        fprintf(out, "  %-14s %8llu %10llu %10llu %10llu %10llu\n", name, (unsigned long long)h->total,
+                (unsigned long long)hist_percentile(h, 0.5), (unsigned long long)hist_percentile(h, 0.99),
+                (unsigned long long)hist_percentile(h, 0.999), (unsigned long long)h->max);
+    }
+}
+
+// Prometheus 텍스트 형식: 지연 시간은 summary (초 단위 분위수 + _sum + _count)
+void stats_write_prometheus(FILE *out, thread_stats_t *total) {
+    static const double quantiles[] = { 0.5, 0.99, 0.999 };
+
+    fprintf(out, "# HELP sws_requests_total Requests handled, by method and status code.\n"
+                 "# TYPE sws_requests_total counter\n");
+    for (int m = 0; m < METHOD_COUNT; m++)
+        for (int c = 0; c < STATUS_CODES; c++)
+            if (total->requests[m][c])
+                fprintf(out, "sws_requests_total{method=\"%s\",status=\"%d\"} %llu\n", stat_method_names[m],
+                        c + 100, (unsigned long long)total->requests[m][c]);
+
+    fprintf(out, "# HELP sws_received_bytes_total Bytes read from client sockets.\n"
+                 "# TYPE sws_received_bytes_total counter\nsws_received_bytes_total %llu\n"
+                 "# HELP sws_sent_bytes_total Bytes written to client sockets.\n"
+                 "# TYPE sws_sent_bytes_total counter\nsws_sent_bytes_total %llu\n",
+            (unsigned long long)total->bytes_in, (unsigned long long)total->bytes_out);
+    fprintf(out, "# HELP sws_connections_active Open client connections.\n"
+                 "# TYPE sws_connections_active gauge\nsws_connections_active %llu\n"
+                 "# HELP sws_connections_total Accepted client connections.\n"
+                 "# TYPE sws_connections_total counter\nsws_connections_total %llu\n",
+            (unsigned long long)(total->conns_opened - total->conns_closed),
+            (unsigned long long)total->conns_opened);
+
+    unsigned long long log_lines, log_dropped;
+    access_log_counts(&log_lines, &log_dropped);
+    fprintf(out, "# HELP sws_access_log_written_total Access log records written.\n"
+                 "# TYPE sws_access_log_written_total counter\nsws_access_log_written_total %llu\n"
+                 "# HELP sws_access_log_dropped_total Access log records dropped because a ring was full.\n"
+                 "# TYPE sws_access_log_dropped_total counter\nsws_access_log_dropped_total %llu\n",
+            log_lines, log_dropped);
+
+    fprintf(out, "# HELP sws_timeouts_total Connections closed or CGI runs killed by a timeout, by kind.\n"
+                 "# TYPE sws_timeouts_total counter\n");
+    for (int i = 0; i < TIMEOUT_KINDS; i++)
+        fprintf(out, "sws_timeouts_total{kind=\"%s\"} %llu\n", timeout_kind_names[i],
+                (unsigned long long)total->timeouts[i]);
+
+    fprintf(out, "# HELP sws_shed_total Requests refused with 503 because a load limit was reached, by limit.\n"
+                 "# TYPE sws_shed_total counter\n");
+    for (int i = 0; i < SHED_KINDS; i++)
+        fprintf(out, "sws_shed_total{limit=\"%s\"} %llu\n", shed_kind_names[i],
+                (unsigned long long)total->shed[i]);
+    fprintf(out, "# HELP sws_cgi_running CGI programs currently running.\n"
+                 "# TYPE sws_cgi_running gauge\nsws_cgi_running %d\n", atomic_load(&cgi_running));
+
+    pthread_rwlock_rdlock(&cgi_cache.lock);
+    size_t cgi_cache_bytes = cgi_cache.bytes;
+    pthread_rwlock_unlock(&cgi_cache.lock);
+    fprintf(out, "# HELP sws_cgi_cache_requests_total Requests to cached CGI scripts, by result.\n"
+                 "# TYPE sws_cgi_cache_requests_total counter\n");
+    for (int i = 0; i < CGI_CACHE_RESULTS; i++)
+        fprintf(out, "sws_cgi_cache_requests_total{result=\"%s\"} %llu\n", cgi_cache_result_names[i],
+                (unsigned long long)total->cgi_cache[i]);
+    fprintf(out, "# HELP sws_cgi_cache_bytes Memory held by cached CGI responses and their keys.\n"
+                 "# TYPE sws_cgi_cache_bytes gauge\nsws_cgi_cache_bytes %zu\n", cgi_cache_bytes);
+
+    const char *names[] = { "sws_request_duration_seconds", "sws_cgi_spawn_duration_seconds",
+                            "sws_cgi_run_duration_seconds" };
+    const char *help[] = { "Time from request headers to complete response, by route.",
+                           "Time to fork/exec a CGI or hand the request to a pool worker.",
+                           "Time from CGI start to end of its output." };
+    for (int n = 0; n < 3; n++) {
+        fprintf(out, "# HELP %s %s\n# TYPE %s summary\n", names[n], help[n], names[n]);
+        int count = n == 0 ? ROUTE_COUNT : n == 1 ? CGI_KIND_COUNT : 1;
+        for (int i = 0; i < count; i++) {
+            histogram_t *h = n == 0 ? &total->latency[i] : n == 1 ? &total->cgi_spawn[i] : &total->cgi_run;
+            char label[32] = "";
+            if (n == 0) snprintf(label, sizeof(label), "route=\"%s\",", stat_route_names[i]);
+            if (n == 1) snprintf(label, sizeof(label), "kind=\"%s\",", cgi_kind_names[i]);
+            for (int q = 0; q < 3; q++)
+                fprintf(out, "%s{%squantile=\"%g\"} %.6f\n", names[n], label, quantiles[q],
+                        hist_percentile(h, quantiles[q]) / 1e6);
+            char braces[40] = ""; // _sum/_count 의 레이블 (끝의 쉼표 제거, 없으면 중괄호도 생략)
+            if (label[0])
+                snprintf(braces, sizeof(braces), "{%.*s}", (int)strlen(label) - 1, label);
+            fprintf(out, "%s_sum%s %.6f\n%s_count%s %llu\n", names[n], braces, h->sum / 1e6,
+                    names[n], braces, (unsigned long long)h->total);
+        }
+    }
+}
+
+// --- 접근 로그 ---
+
+// 로그 출력 준비 후 기록 쓰레드 시작 (마스터/워커 모드에서는 워커 프로세스마다 하나)
+void access_log_init(void) {
+    pthread_t tid;
+
+    if (config.access_log == NULL) return;
+    if (access_log_open() == -1) {
+        perror("접근 로그 파일 열기 오류");
+        return;
+    }
+    if (pthread_create(&tid, NULL, access_log_thread, NULL) != 0) {
+        perror("접근 로그 쓰레드 생성 오류");
+        return;
+    }
+    pthread_detach(tid);
+    log_enabled = 1;
+}
+
+// 로그 파일 (다시) 열기: 여러 워커 프로세스가 같은 파일에 써도 섞이지 않도록 O_APPEND
+int access_log_open(void) {
+    if (strcmp(config.access_log, "-") == 0) {
+        log_fd = STDOUT_FILENO;
+        return 0;
+    }
+    int fd = open(config.access_log, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1) return -1;
+    if (log_fd != -1) close(log_fd);
+    log_fd = fd;
+    return 0;
+}
+
+// 호출한 쓰레드의 링 (처음 호출될 때 할당해 목록에 등록)
+log_ring_t *log_ring_local(void) {
+    if (my_log_ring) return my_log_ring;
+
+    log_ring_t *ring = calloc(1, sizeof(log_ring_t));
+    if (ring == NULL)
+        error_handling("접근 로그 메모리 할당 실패");
+    pthread_mutex_lock(&log_lock);
+    ring->next = log_rings;
+    log_rings = ring;
+    pthread_mutex_unlock(&log_lock);
+    my_log_ring = ring;
+    return ring;
+}
+
+// 요청 하나를 링에 기록 (요청 쓰레드에서 호출, 가득 차면 버림)
+void access_log_write(conn_t *conn, uint64_t usec) {
+    if (!log_enabled) return;
+
+    log_ring_t *ring = log_ring_local();
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&ring->head, memory_order_acquire) == LOG_RING_SIZE) {
+        stat_add(&ring->dropped, 1);
+        return;
+    }
+
+    // 클라이언트 주소는 연결마다 한 번만 조회 (io_uring multishot accept 는 주소를 주지 않음)
+    if (!conn->peer_known) {
+        struct sockaddr_in addr;
+        socklen_t len = sizeof(addr);
+        conn->peer = getpeername(conn->fd, (struct sockaddr *)&addr, &len) == 0 ? addr.sin_addr.s_addr : 0;
+        conn->peer_known = 1;
+    }
+
+    log_record_t *rec = &ring->records[tail & (LOG_RING_SIZE - 1)];
+    rec->time = time(NULL);
+    rec->peer = conn->peer;
+    rec->status = conn->status;
+    rec->bytes = conn->out_total - conn->out_start;
+    rec->usec = usec;
+    rec->cgi_usec = conn->cgi_usec;
+    memcpy(rec->request, conn->log_request, sizeof(rec->request));
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+// 기록 쓰레드: 주기적으로 모든 링을 비워 로그 줄을 블록에 모으고 writev 로 한꺼번에 씀
+void *access_log_thread(void *arg) {
+    (void)arg;
+    char *blocks = malloc((size_t)LOG_BLOCKS * LOG_BLOCK_SIZE);
+    struct iovec iov[LOG_BLOCKS];
+
+    if (blocks == NULL) {
+        perror("접근 로그 버퍼 할당 오류"); // 링은 가득 찬 뒤 버린 수만 셈
+        return NULL;
+    }
+
+    int busy = 0; // 지난번에 링이 절반 넘게 차 있었음: 바로 다시 비움
+
+    while (1) {
+        struct timespec delay = { 0, LOG_FLUSH_MSEC * 1000000L };
+        int count = 0;
+        size_t used = 0;
+
+        if (!busy)
+            nanosleep(&delay, NULL);
+        busy = 0;
+
+        // 1. 링마다 쌓인 레코드를 텍스트로 변환 (블록이 다 차면 중간에 한 번 씀)
+        pthread_mutex_lock(&log_lock);
+        log_ring_t *ring = log_rings; // 목록 앞에만 추가되고 해제되지 않으므로 이후엔 잠금 없이 순회
+        pthread_mutex_unlock(&log_lock);
+
+        for (; ring; ring = ring->next) {
+            unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+            unsigned tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+            if (tail - head > LOG_RING_SIZE / 2)
+                busy = 1;
+            for (; head != tail; head++) {
+                char *block = blocks + (size_t)count * LOG_BLOCK_SIZE;
+                if (LOG_BLOCK_SIZE - used < LOG_REQUEST_MAX * 4 + 128) { // 가장 긴 줄도 들어갈 자리가 없음
+                    iov[count].iov_base = block;
+                    iov[count++].iov_len = used;
+                    used = 0;
+                    if (count == LOG_BLOCKS) {
+                        access_log_flush(iov, count);
+                        count = 0;
+                    }
+                    block = blocks + (size_t)count * LOG_BLOCK_SIZE;
+                }
+                used += access_log_format(block + used, LOG_BLOCK_SIZE - used,
+                                          &ring->records[head & (LOG_RING_SIZE - 1)]);
+            }
+            atomic_store_explicit(&ring->head, head, memory_order_release);
+        }
+
+        // 2. 남은 블록을 쓰고 파일 크기에 따라 회전
+        if (used > 0) {
+            iov[count].iov_base = blocks + (size_t)count * LOG_BLOCK_SIZE;
+            iov[count++].iov_len = used;
+        }
+        if (count > 0) {
+            access_log_flush(iov, count);
+            access_log_rotate_check();
+        }
+    }
+    return NULL;
+}
+
+// Common Log Format 한 줄 + 처리 시간(µs)과 CGI 실행 시간(µs, 없으면 "-")
+// 예: 127.0.0.1 - - [17/Oct/2026:10:00:00 +0900] "GET /index.html HTTP/1.1" 200 512 85 -
+size_t access_log_format(char *buf, size_t size, log_record_t *rec) {
+    static time_t cached_time = -1; // 같은 초의 레코드는 날짜 문자열을 재사용 (기록 쓰레드 전용)
+    static char cached_date[40];
+    char addr[INET_ADDRSTRLEN];
+    char request[LOG_REQUEST_MAX * 4];
+    size_t n = 0;
+
+    if (rec->time != cached_time) {
+        struct tm tm;
+        localtime_r(&rec->time, &tm);
+        strftime(cached_date, sizeof(cached_date), "%d/%b/%Y:%H:%M:%S %z", &tm);
+        cached_time = rec->time;
+    }
+    inet_ntop(AF_INET, &rec->peer, addr, sizeof(addr));
+
+    // 요청 줄의 따옴표와 제어 문자는 이스케이프 (로그 줄을 깨뜨리지 않도록)
+    for (const char *p = rec->request; p < rec->request + sizeof(rec->request) && *p; p++) {
+        unsigned char ch = *p;
+        if (ch == '"' || ch == '\\')
+            n += snprintf(request + n, sizeof(request) - n, "\\%c", ch);
+        else if (ch < 0x20 || ch == 0x7f)
+            n += snprintf(request + n, sizeof(request) - n, "\\x%02x", ch);
+        else
+            request[n++] = ch;
+    }
+    request[n] = '\0';
+
+    char bytes[24] = "-", cgi[24] = "-";
+    if (rec->bytes > 0) snprintf(bytes, sizeof(bytes), "%llu", rec->bytes);
+    if (rec->cgi_usec >= 0) snprintf(cgi, sizeof(cgi), "%lld", (long long)rec->cgi_usec);
+
+    int len = snprintf(buf, size, "%s - - [%s] \"%s\" %d %s %llu %s\n", addr, cached_date, request,
+                       rec->status, bytes, (unsigned long long)rec->usec, cgi);
+    return len < 0 ? 0 : ((size_t)len < size ? (size_t)len : size - 1);
+}
+
+// 모은 블록을 writev 로 기록 (짧게 쓰이면 남은 부분부터 이어서)
+void access_log_flush(struct iovec *iov, int count) {
+    unsigned long long lines = 0;
+
+    for (int i = 0; i < count; i++)
+        for (size_t j = 0; j < iov[i].iov_len; j++)
+            lines += ((char *)iov[i].iov_base)[j] == '\n';
+
+    while (count > 0) {
+        ssize_t n = writev(log_fd, iov, count);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            perror("접근 로그 쓰기 오류");
+            return;
+        }
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    atomic_fetch_add_explicit(&log_written, lines, memory_order_relaxed);
+}
+
+// 파일 크기가 한도를 넘으면 경로.1 ~ 경로.N 으로 밀어내고 새 파일을 엶
+// 다른 워커 프로세스가 이미 회전했으면 (경로의 inode 가 바뀜) 새 파일만 다시 엶
+void access_log_rotate_check(void) {
+    struct stat fd_st, path_st;
+    char from[512], to[512];
+
+    if (log_fd == STDOUT_FILENO || config.access_log_max == 0 || fstat(log_fd, &fd_st) == -1)
+        return;
+    if (stat(config.access_log, &path_st) == -1 || path_st.st_ino != fd_st.st_ino) {
+        access_log_open();
+        return;
+    }
+    if ((size_t)fd_st.st_size < config.access_log_max)
+        return;
+
+    for (int i = LOG_KEEP - 1; i >= 1; i--) {
+        snprintf(from, sizeof(from), "%s.%d", config.access_log, i);
+        snprintf(to, sizeof(to), "%s.%d", config.access_log, i + 1);
+        rename(from, to);
+    }
+    snprintf(to, sizeof(to), "%s.1", config.access_log);
+    if (rename(config.access_log, to) == -1)
+        perror("접근 로그 회전 오류");
+    if (access_log_open() == -1)
+        perror("접근 로그 파일 열기 오류");
+}
+
+// /server-stats 용: 기록한 레코드 수와 링이 가득 차 버린 레코드 수
+void access_log_counts(unsigned long long *written, unsigned long long *dropped) {
+    *written = atomic_load_explicit(&log_written, memory_order_relaxed);
+    *dropped = 0;
+    pthread_mutex_lock(&log_lock);
+    for (log_ring_t *ring = log_rings; ring; ring = ring->next)
+        *dropped += atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+    pthread_mutex_unlock(&log_lock);
+}
+
+// HTTP 응답 헤더 전송 (본문 길이와 연결 유지 여부를 함께 알림)
+// extra_headers: "이름: 값\r\n" 형식으로 추가할 헤더 (없으면 NULL)
+void send_header(conn_t *conn, const char *status, const char *content_type, size_t content_length,
+                 const char *extra_headers) {
+    char header[BUF_SIZE];
+    int len = snprintf(header, sizeof(header),
+                       "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n%sConnection: %s\r\n\r\n",
+                       status, content_type, content_length, extra_headers ? extra_headers : "",
+                       conn->req.keep_alive ? "keep-alive" : "close");
+    conn_send(conn, header, len);
+    conn->status = atoi(status);
+}
+
+// 304 Not Modified 응답 (본문 없음)
+void send_not_modified(conn_t *conn, const char *etag) {
+    char header[BUF_SIZE];
+    int len = snprintf(header, sizeof(header), "HTTP/1.1 304 Not Modified\r\nETag: %s\r\nConnection: %s\r\n\r\n",
+                       etag, conn->req.keep_alive ? "keep-alive" : "close");
+    conn_send(conn, header, len);
+    conn->status = 304;
+}
+
+// HTTP 에러 응답 전송
+void send_error(conn_t *conn, char *status) {
+    char body[BUF_SIZE];
+
+    // 응답 본문 생성
+    sprintf(body, "<html><head><title>오류</title></head><body><h1>%s</h1><p>요청한 자원을 처리할 수 없습니다.</p></body></html>", status);
+
+    // 과부하로 거절하는 경우 언제 다시 시도할지 알려 줌
+    char retry[64] = "";
+    if (strncmp(status, "503", 3) == 0)
+        snprintf(retry, sizeof(retry), "Retry-After: %d\r\n", config.retry_after);
+
+    // 헤더와 본문 전송
+    send_header(conn, status, "text/html", strlen(body), retry);
+    conn_send(conn, body, strlen(body));
+}
+
+void error_handling(char *message) {
+    fputs(message, stderr);
+    fputc('\n', stderr);
+    exit(1);
+}